@@ -0,0 +1,354 @@
+/** @file alert_rules.c
+ *  @brief Raise alerts when a metric or its rate crosses a threshold
+ *
+ *  This file includes the functions that compile the "--alert" rules once
+ *  at startup into a flat array, evaluate them against the metrics of each
+ *  sample, and report when a rule starts or stops firing to stderr, a file
+ *  or a local datagram socket. A firing rule only stops once the value is
+ *  back ALERT_HYSTERESIS past its threshold, so a value which hovers around
+ *  the threshold does not flap.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "alert_rules.h"
+
+/** @brief Skip the spaces of a rule.
+ *  @param ptr The position in the rule.
+ *  @return The first character which is not a space.
+ */
+static const char *skip_spaces(const char *ptr) {
+    while (isspace((unsigned char) *ptr)) ptr ++;
+    return ptr;
+}
+
+/** @brief The size in bytes of a unit, e.g. 1e6 for "MB" or "MB/s".
+ *  @param unit The unit.
+ *  @return The bytes, or 0 if the unit does not start with KB, MB, GB or TB.
+ */
+static double alert_size(const char *unit) {
+    static const char *sizes[] = {"KB", "MB", "GB", "TB"};
+    static const double bytes[] = {1e3, 1e6, 1e9, 1e12};
+
+    for (int i = 0; i < 4; i ++) {
+        if (strncasecmp(unit, sizes[i], 2) == 0) return bytes[i];
+    }
+    return 0;
+}
+
+/** @brief Compile a rule.
+ *
+ *  The syntax is "METRIC [rate] OP VALUE[UNIT][/PERIOD] [for N[s|m|h]]"
+ *  where OP is '>', ">=", '<' or "<=", UNIT is one of KB, MB, GB, TB (for
+ *  the metrics in bytes, e.g. GB or MB/s) or '%', and PERIOD is s, min or h
+ *  (for a rate). The threshold is converted to the unit of the metric
+ *  when the metric is first recorded, see alert_eval.
+ *
+ *  @param text The rule.
+ *  @param rule Where to store the compiled rule.
+ *  @return 1 on success, 0 if the rule is not valid.
+ */
+int alert_parse(const char *text, struct alert_rule *rule) {
+    const char *ptr = skip_spaces(text);
+    size_t len = 0;
+    char *end;
+
+    memset(rule, 0, sizeof(*rule));
+    snprintf(rule->text, sizeof(rule->text), "%s", text);
+    rule->input = -1;
+    rule->since = -1;
+
+    // the metric, e.g. "cpu" or "mem.used"
+    while (isalnum((unsigned char) *ptr) || *ptr == '.' || *ptr == '_') {
+        if (len == sizeof(rule->metric) - 1) return 0;
+        rule->metric[len ++] = *ptr ++;
+    }
+    if (len == 0) return 0;
+    ptr = skip_spaces(ptr);
+    if (strncmp(ptr, "rate", 4) == 0) {
+        rule->rate = 1;
+        ptr = skip_spaces(ptr + 4);
+    }
+
+    // the comparison and the threshold
+    if (*ptr != '>' && *ptr != '<') return 0;
+    rule->sign = *ptr ++ == '>' ? 1.0 : -1.0;
+    if (*ptr == '=') {
+        rule->bias = 1;  // scaled once the threshold is in the unit of the metric
+        ptr ++;
+    }
+    rule->threshold = strtod(skip_spaces(ptr), &end);
+    if (end == skip_spaces(ptr)) return 0;
+    ptr = end;
+    if (alert_size(ptr) > 0) {
+        rule->unit[0] = toupper((unsigned char) ptr[0]);
+        rule->unit[1] = 'B';
+        ptr += 2;
+    } else if (*ptr == '%') {
+        rule->unit[0] = *ptr ++;
+    }
+    if (*ptr == '/') {
+        // a rate is compared per second
+        if (!rule->rate) return 0;
+        if (strncmp(ptr, "/min", 4) == 0) {
+            rule->threshold /= 60.0;
+            ptr += 4;
+        } else if (strncmp(ptr, "/h", 2) == 0) {
+            rule->threshold /= 3600.0;
+            ptr += 2;
+        } else if (strncmp(ptr, "/s", 2) == 0) {
+            ptr += 2;
+        } else {
+            return 0;
+        }
+    }
+
+    // how long the condition must hold
+    ptr = skip_spaces(ptr);
+    if (strncmp(ptr, "for", 3) == 0) {
+        rule->hold = strtod(ptr + 3, &end);
+        if (end == ptr + 3 || rule->hold < 0) return 0;
+        ptr = end;
+        if (*ptr == 'm') {
+            rule->hold *= 60.0;
+            ptr ++;
+        } else if (*ptr == 'h') {
+            rule->hold *= 3600.0;
+            ptr ++;
+        } else if (*ptr == 's') {
+            ptr ++;
+        }
+    }
+    return *skip_spaces(ptr) == '\0';
+}
+
+/** @brief Bind a rule to its metric, converting the threshold to the unit of the metric.
+ *  @param rule The rule.
+ *  @param id The index of the metric.
+ *  @param metric The metric.
+ *  @return 1 on success, 0 if the unit of the rule does not fit the metric (e.g. "cpu>1GB").
+ */
+static int alert_bind(struct alert_rule *rule, int id, const struct metric *metric) {
+    double scale = 1.0;
+
+    if (rule->unit[0] == '%') {
+        if (strcmp(metric->unit, "%") != 0) return 0;
+    } else if (rule->unit[0] != '\0') {
+        // e.g. 100MB against "MB/s", or 512MB against "GB"
+        if (alert_size(metric->unit) == 0) return 0;
+        scale = alert_size(rule->unit) / alert_size(metric->unit);
+    }
+    rule->input = id;
+    rule->threshold *= scale;
+    rule->bias = rule->bias ? 1e-9 * (1.0 + fabs(rule->threshold)) : 0.0;
+    rule->clear = rule->threshold - rule->sign * ALERT_HYSTERESIS * fabs(rule->threshold);
+    return 1;
+}
+
+/** @brief Start the alert sinks: stderr, plus a file and a local socket if given.
+ *  @param alerts The rules to initialize.
+ *  @param file The file to append the alerts to, or NULL.
+ *  @param sock_path The path of a local datagram socket to send the alerts to, or NULL.
+ *  @return Void.
+ */
+void alert_init(struct alert_set *alerts, const char *file, const char *sock_path) {
+    memset(alerts, 0, sizeof(*alerts));
+    alerts->prev_time = -1;
+    alerts->sock = -1;
+
+    if (file != NULL && (alerts->file = fopen(file, "a")) == NULL) {
+        perror(file);
+        exit(1);
+    }
+    if (sock_path != NULL) {
+        // nobody may be listening yet, so the socket is not connected
+        if ((alerts->sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1) {
+            perror("socket");
+            exit(1);
+        }
+        alerts->addr.sun_family = AF_UNIX;
+        snprintf(alerts->addr.sun_path, sizeof(alerts->addr.sun_path), "%s", sock_path);
+    }
+}
+
+/** @brief Compile a rule and add it to the set.
+ *  @param alerts The rules.
+ *  @param text The rule.
+ *  @return 1 on success, 0 if the rule is not valid or there are too many rules.
+ */
+int alert_add(struct alert_set *alerts, const char *text) {
+    if (alerts->count == ALERT_MAX || !alert_parse(text, &alerts->rule[alerts->count])) {
+        return 0;
+    }
+    alerts->count ++;
+    alerts->unresolved ++;
+    return 1;
+}
+
+/** @brief Add the rules of a file, one per line ('#' starts a comment).
+ *  @param alerts The rules.
+ *  @param path The file.
+ *  @return The number of rules added, or -1 if the file cannot be read.
+ */
+int alert_load(struct alert_set *alerts, const char *path) {
+    char line[256];
+    int added = 0, number = 0;
+    FILE *file;
+
+    if ((file = fopen(path, "r")) == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        number ++;
+        line[strcspn(line, "#\n")] = '\0';
+        if (*skip_spaces(line) == '\0') continue;  // empty, or a comment
+        if (alert_add(alerts, line)) {
+            added ++;
+        } else {
+            // a bad line is skipped, the other rules still work
+            fprintf(stderr, "%s:%d: invalid rule \"%s\"\n", path, number, line);
+        }
+    }
+    fclose(file);
+    return added;
+}
+
+/** @brief Report that a rule started or stopped firing.
+ *  @param alerts The rules.
+ *  @param rule The rule.
+ *  @param metric The metric of the rule.
+ *  @param value The value compared to the threshold.
+ *  @return Void.
+ */
+static void alert_emit(struct alert_set *alerts, struct alert_rule *rule,
+    struct metric *metric, double value) {
+    char message[256], stamp[32];
+    time_t now = time(NULL);
+    int len;
+
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    len = snprintf(message, sizeof(message), "%s %s \"%s\": %s%s = %.2f %s%s\n", stamp,
+        rule->firing ? "ALERT" : "RESOLVED", rule->text, metric->name, rule->rate ? " rate" : "",
+        value, metric->unit, rule->rate ? "/s" : "");
+    if (len >= (int) sizeof(message)) len = sizeof(message) - 1;
+
+    // stderr, unless the alerts go elsewhere
+    if (alerts->file == NULL && alerts->sock == -1) {
+        fputs(message, stderr);
+    }
+    if (alerts->file != NULL) {
+        fputs(message, alerts->file);
+        fflush(alerts->file);
+    }
+    if (alerts->sock != -1) {
+        // never block the sampling, a missing listener only loses the message
+        sendto(alerts->sock, message, len, MSG_DONTWAIT,
+            (struct sockaddr *) &alerts->addr, sizeof(alerts->addr));
+    }
+}
+
+/** @brief Evaluate every rule against the last values of the metrics.
+ *
+ *  The values and the rates are first copied into one flat array, so each
+ *  rule is one load and a few arithmetic operations, and the branches are
+ *  only taken when a rule starts or stops firing. A metric not recorded
+ *  since the last evaluation (its collector is stale) is skipped, and a
+ *  rate is taken over the time between the last two values. A rule whose
+ *  metric still does not exist after ALERT_RESOLVE samples is reported on
+ *  stderr, once.
+ *
+ *  @param alerts The rules.
+ *  @param metrics The metrics, with the values of the current sample.
+ *  @return The number of rules which started or stopped firing.
+ */
+int alert_eval(struct alert_set *alerts, struct metric_set *metrics) {
+    struct timespec ts;
+    double now, last = alerts->prev_time;
+    int changes = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = ts.tv_sec + ts.tv_nsec * 1e-9;
+
+    if (metrics->count > alerts->size) {
+        int size = alerts->size;
+        alerts->size = metrics->count * 2;  // the collectors add metrics (e.g. a core)
+        if ((alerts->rate = realloc(alerts->rate, alerts->size * sizeof(double))) == NULL ||
+            (alerts->prev = realloc(alerts->prev, alerts->size * sizeof(double))) == NULL ||
+            (alerts->prev_at = realloc(alerts->prev_at, alerts->size * sizeof(double))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        for (; size < alerts->size; size ++) {
+            alerts->rate[size] = NAN;
+            alerts->prev_at[size] = -1;
+        }
+    }
+    for (int i = 0; i < metrics->count; i ++) {
+        const struct metric *metric = &metrics->metric[i];
+        if (metric->updated == alerts->prev_at[i]) continue;  // stale, e.g. its collector timed out
+        // the rate is taken over the time between the two values, which
+        // spans several samples after a stale one
+        alerts->rate[i] = alerts->prev_at[i] >= 0 ?
+            (metric->value - alerts->prev[i]) / (metric->updated - alerts->prev_at[i]) : NAN;
+        alerts->prev[i] = metric->value;
+        alerts->prev_at[i] = metric->updated;
+    }
+    alerts->prev_time = now;
+
+    // a metric is added the first time it is recorded
+    for (int i = 0; alerts->unresolved > 0 && i < alerts->count; i ++) {
+        struct alert_rule *rule = &alerts->rule[i];
+        int id;
+        if (rule->input == -1 && (id = metric_find(metrics, rule->metric)) != -1) {
+            alerts->unresolved --;
+            if (!alert_bind(rule, id, &metrics->metric[id])) {
+                fprintf(stderr, "alert \"%s\": the unit %s does not fit %s (%s), the rule is never evaluated\n",
+                    rule->text, rule->unit, rule->metric, metrics->metric[id].unit);
+                rule->input = -2;
+            }
+        }
+    }
+    // a worker sends its first values with its second run, so a metric
+    // still missing then is misspelled (or its section is not shown)
+    if (alerts->samples < ALERT_RESOLVE && ++ alerts->samples == ALERT_RESOLVE) {
+        for (int i = 0; alerts->unresolved > 0 && i < alerts->count; i ++) {
+            if (alerts->rule[i].input == -1) {
+                fprintf(stderr, "alert \"%s\": no metric \"%s\", the rule is never evaluated\n",
+                    alerts->rule[i].text, alerts->rule[i].metric);
+            }
+        }
+    }
+
+    for (int i = 0; i < alerts->count; i ++) {
+        struct alert_rule *rule = &alerts->rule[i];
+        // a value not recorded since the last evaluation (stale) neither
+        // holds nor clears a rule, nor does a metric without a rate yet
+        if (rule->input < 0 || metrics->metric[rule->input].updated <= last) continue;
+
+        double value = rule->rate ? alerts->rate[rule->input] : metrics->metric[rule->input].value;
+        if (isnan(value)) continue;
+        int over = rule->sign * (value - rule->threshold) + rule->bias > 0;
+        int cleared = rule->sign * (value - rule->clear) + rule->bias <= 0;
+        rule->since = over ? (rule->since < 0 ? now : rule->since) : -1;
+        int firing = rule->firing ? !cleared : over & (now - rule->since >= rule->hold);
+
+        if (firing != rule->firing) {
+            rule->firing = firing;
+            alert_emit(alerts, rule, &metrics->metric[rule->input], value);
+            changes ++;
+        }
+    }
+    return changes;
+}
+
+/** @brief Close the alert sinks.
+ *  @param alerts The rules.
+ *  @return Void.
+ */
+void alert_close(struct alert_set *alerts) {
+    free(alerts->rate);
+    free(alerts->prev);
+    free(alerts->prev_at);
+    if (alerts->file != NULL) fclose(alerts->file);
+    if (alerts->sock != -1) close(alerts->sock);
+}
@@ -0,0 +1,114 @@
+/*
+ * Header file for the threshold and rate alert rules
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "metrics.h"
+
+#ifndef __Alert_header
+#define __Alert_header
+
+#define ALERT_MAX 1024          // the maximum number of rules
+#define ALERT_HYSTERESIS 0.05   // a firing rule clears 5% of the threshold below (above) it
+#define ALERT_RESOLVE 2         // the samples after which a rule whose metric does not exist is reported
+
+/** @brief A compiled rule, e.g. "cpu>90 for 5s" or "mem.used rate>1GB/min". */
+struct alert_rule {
+    char text[64];              // the rule as given, for the messages
+    char metric[32];            // the name of the metric
+    int input;                  // the index of the metric, -1 until the metric exists, -2 if its unit does not fit
+    int rate;                   // 1 for "rate", the change per second
+    double sign;                // 1 for '>' and ">=", -1 for '<' and "<="
+    char unit[4];               // the unit of the threshold as given ("MB", "%"), "" if none
+    double threshold;           // per second for a rate, in the unit of the metric once bound
+    double bias;                // > 0 for ">=" and "<=", so that the equality fires
+    double clear;               // the threshold to go back past to stop firing
+    double hold;                // "for N": the seconds the condition must hold
+    double since;               // the time the condition became true, -1 if false
+    int firing;
+};
+
+/** @brief The rules and the sinks of the alerts. */
+struct alert_set {
+    int count;
+    struct alert_rule rule[ALERT_MAX];
+    int size;                       // the metrics rate, prev and prev_at have room for
+    double *rate;                   // the rate of each metric between its last two values, NAN before
+    double *prev;                   // the last value of each metric
+    double *prev_at;                // when it was recorded, -1 if never
+    double prev_time;               // the time of the previous evaluation, -1 before the first one
+    int unresolved;                 // the number of rules whose metric does not exist yet
+    int samples;                    // the samples evaluated, up to ALERT_RESOLVE
+    FILE *file;                     // "--alert-file=PATH", NULL if not given
+    int sock;                       // "--alert-socket=PATH", -1 if not given
+    struct sockaddr_un addr;
+};
+
+/** @brief Compile a rule.
+ *
+ *  The syntax is "METRIC [rate] OP VALUE[UNIT][/PERIOD] [for N[s|m|h]]"
+ *  where OP is '>', ">=", '<' or "<=", UNIT is one of KB, MB, GB, TB (for
+ *  the metrics in bytes, e.g. GB or MB/s) or '%', and PERIOD is s, min or h
+ *  (for a rate). The threshold is converted to the unit of the metric
+ *  when the metric is first recorded, see alert_eval.
+ *
+ *  @param text The rule.
+ *  @param rule Where to store the compiled rule.
+ *  @return 1 on success, 0 if the rule is not valid.
+ */
+int alert_parse(const char *text, struct alert_rule *rule);
+
+/** @brief Start the alert sinks: stderr, plus a file and a local socket if given.
+ *  @param alerts The rules to initialize.
+ *  @param file The file to append the alerts to, or NULL.
+ *  @param sock_path The path of a local datagram socket to send the alerts to, or NULL.
+ *  @return Void.
+ */
+void alert_init(struct alert_set *alerts, const char *file, const char *sock_path);
+
+/** @brief Compile a rule and add it to the set.
+ *  @param alerts The rules.
+ *  @param text The rule.
+ *  @return 1 on success, 0 if the rule is not valid or there are too many rules.
+ */
+int alert_add(struct alert_set *alerts, const char *text);
+
+/** @brief Add the rules of a file, one per line ('#' starts a comment).
+ *  @param alerts The rules.
+ *  @param path The file.
+ *  @return The number of rules added, or -1 if the file cannot be read.
+ */
+int alert_load(struct alert_set *alerts, const char *path);
+
+/** @brief Evaluate every rule against the last values of the metrics.
+ *
+ *  The values and the rates are first copied into one flat array, so each
+ *  rule is one load and a few arithmetic operations, and the branches are
+ *  only taken when a rule starts or stops firing. A metric not recorded
+ *  since the last evaluation (its collector is stale) is skipped, and a
+ *  rate is taken over the time between the last two values. A rule whose
+ *  metric still does not exist after ALERT_RESOLVE samples is reported on
+ *  stderr, once.
+ *
+ *  @param alerts The rules.
+ *  @param metrics The metrics, with the values of the current sample.
+ *  @return The number of rules which started or stopped firing.
+ */
+int alert_eval(struct alert_set *alerts, struct metric_set *metrics);
+
+/** @brief Close the alert sinks.
+ *  @param alerts The rules.
+ *  @return Void.
+ */
+void alert_close(struct alert_set *alerts);
+
+#endif
@@ -0,0 +1,200 @@
+/** @file anomaly.c
+ *  @brief Flag the unusual values of the sampled series
+ *
+ *  This file includes the functions that keep, for every series (a metric,
+ *  the utilization of a core...), an exponentially weighted mean and
+ *  variance and a streaming median and MAD, and flag the values far from
+ *  them. The state is O(1) per series, and is kept as a structure of
+ *  arrays so thousands of series update in one vectorizable loop.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "anomaly.h"
+
+/** @brief Start an empty set of series.
+ *  @param set The set to initialize.
+ *  @return Void.
+ */
+void anomaly_init(struct anomaly_set *set) {
+    memset(set, 0, sizeof(*set));
+}
+
+/** @brief Grow an array of the set.
+ *  @param array The array.
+ *  @param size The new size (in bytes).
+ *  @return Void.
+ */
+static void anomaly_grow(void *array, size_t size) {
+    void **ptr = array;
+
+    if ((*ptr = realloc(*ptr, size)) == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+}
+
+/** @brief Add a series, in the place of a removed one if any.
+ *  @param set The series.
+ *  @param name The name of the series (copied).
+ *  @return The index of the series, to set its value.
+ */
+int anomaly_add(struct anomaly_set *set, const char *name) {
+    int id = set->unused_count > 0 ? set->unused[-- set->unused_count] : set->count ++;
+
+    if (set->count > set->capacity) {
+        size_t n = set->capacity = set->capacity > 0 ? set->capacity * 2 : 64;
+        anomaly_grow(&set->name, n * ANOMALY_NAME);
+        anomaly_grow(&set->value, n * sizeof(double));
+        anomaly_grow(&set->mean, n * sizeof(double));
+        anomaly_grow(&set->var, n * sizeof(double));
+        anomaly_grow(&set->median, n * sizeof(double));
+        anomaly_grow(&set->mad, n * sizeof(double));
+        anomaly_grow(&set->z, n * sizeof(double));
+        anomaly_grow(&set->robust, n * sizeof(double));
+        anomaly_grow(&set->seen, n * sizeof(double));
+        anomaly_grow(&set->flag, n);
+        anomaly_grow(&set->unused, n * sizeof(int));
+    }
+    snprintf(set->name[id], ANOMALY_NAME, "%s", name);
+    set->value[id] = set->mean[id] = set->var[id] = 0.0;
+    set->median[id] = set->mad[id] = set->z[id] = set->robust[id] = 0.0;
+    set->seen[id] = 0.0;
+    set->flag[id] = 0;
+    return id;
+}
+
+/** @brief Remove a series (e.g. of a process which exited), its index is reused by anomaly_add.
+ *
+ *  The series stays in the arrays, so the update loop has no gap to skip:
+ *  with no value seen it is never judged, and it has no name to be shown.
+ *
+ *  @param set The series.
+ *  @param id The index of the series.
+ *  @return Void.
+ */
+void anomaly_remove(struct anomaly_set *set, int id) {
+    set->name[id][0] = '\0';
+    set->value[id] = set->mean[id] = set->var[id] = 0.0;
+    set->median[id] = set->mad[id] = 0.0;
+    set->seen[id] = 0.0;
+    set->unused[set->unused_count ++] = id;
+}
+
+/** @brief The update of anomaly_update, over the arrays of the series.
+ *
+ *  The arrays are parameters marked restrict, so the compiler knows they do
+ *  not overlap; this file is built with -O3, -fno-trapping-math and
+ *  -fno-math-errno (for sqrt(), see the makefile), so the loop vectorizes,
+ *  while the rest of the program keeps -O2.
+ *
+ *  @param count The number of series.
+ *  @return The number of unusual values.
+ */
+static int anomaly_lanes(int count, const double *restrict value, double *restrict mean,
+    double *restrict var, double *restrict median, double *restrict mad, double *restrict z,
+    double *restrict robust, double *restrict seen, unsigned char *restrict flag) {
+    int unusual = 0;
+
+    for (int i = 0; i < count; i ++) {
+        double x = value[i];
+        double diff = x - mean[i];
+        double dev = x - median[i];
+        double sd = sqrt(var[i]);
+        // the floor keeps a constant series from dividing by 0
+        double floor = 1e-3 * (fabs(median[i]) + 1e-3);
+        double warm = seen[i] >= ANOMALY_WARMUP ? 1.0 : 0.0;
+
+        // judge the value against the state of the previous samples
+        z[i] = diff / (sd + floor);
+        robust[i] = dev / (1.4826 * (mad[i] + floor));
+        int unusual_flag = (warm * (fabs(z[i]) > ANOMALY_Z)) * ANOMALY_EWMA +
+            (warm * (fabs(robust[i]) > ANOMALY_Z)) * ANOMALY_ROBUST;
+        flag[i] = unusual_flag;
+
+        mean[i] += ANOMALY_ALPHA * diff;
+        var[i] = (1.0 - ANOMALY_ALPHA) * (var[i] + ANOMALY_ALPHA * diff * diff);
+        // the median and MAD start as plain averages, then only move by
+        // fixed steps (the sign of the error), so a spike pulls them no more
+        // than any other value; the step follows the spread of the series
+        double step = ANOMALY_ETA * (mad[i] + sd + floor);
+        double rest = 1.0 / (seen[i] + 1.0);
+        double spread = fabs(dev) - mad[i];
+        // a step never goes past the value, so a flat series settles exactly
+        double dev_step = step < fabs(dev) ? step : fabs(dev);
+        double spread_step = step < fabs(spread) ? step : fabs(spread);
+        median[i] += warm * copysign(dev_step, dev) + (1.0 - warm) * dev * rest;
+        mad[i] += warm * copysign(spread_step, spread) + (1.0 - warm) * spread * rest;
+        seen[i] += 1.0;
+        unusual += unusual_flag != 0;
+    }
+    return unusual;
+}
+
+/** @brief Judge the new value of every series, then fold it into the state, in O(1) per series.
+ *
+ *  EWMA: diff = x - mean, mean += alpha diff, var = (1 - alpha) (var + alpha diff^2)
+ *  Median/MAD: median += step sign(x - median), MAD += step sign(|x - median| - MAD),
+ *  never past the value, where step = eta (MAD + sd), after ANOMALY_WARMUP plain averages.
+ *  A value is unusual when its score is over ANOMALY_Z, once the series has
+ *  ANOMALY_WARMUP values. The fixed median and MAD steps make them robust to
+ *  the spikes which drag the EWMA mean and inflate its variance.
+ *
+ *  @param set The series, with their new values.
+ *  @return The number of unusual values.
+ */
+int anomaly_update(struct anomaly_set *set) {
+    return anomaly_lanes(set->count, set->value, set->mean, set->var, set->median, set->mad,
+        set->z, set->robust, set->seen, set->flag);
+}
+
+/** @brief Prints the series whose last value is unusual, the most unusual first.
+ *  @param set The series.
+ *  @param title The title of the section, e.g. "Anomalies".
+ *  @return The number of lines printed.
+ */
+int show_anomalies(struct anomaly_set *set, const char *title) {
+    int shown[ANOMALY_TOP], count = 0, unusual = 0;
+
+    // keep the ANOMALY_TOP largest robust scores, by insertion
+    for (int i = 0; i < set->count; i ++) {
+        if (set->flag[i] == 0) continue;
+        unusual ++;
+        int j = count < ANOMALY_TOP ? count ++ : ANOMALY_TOP;
+        while (j > 0 && fabs(set->robust[shown[j - 1]]) < fabs(set->robust[i])) {
+            if (j < ANOMALY_TOP) shown[j] = shown[j - 1];
+            j --;
+        }
+        if (j < ANOMALY_TOP) shown[j] = i;
+    }
+
+    printf("### %s ### (%d of %d series unusual, z = EWMA, rz = median/MAD)\n",
+        title, unusual, set->count - set->unused_count);
+    for (int i = 0; i < count; i ++) {
+        int id = shown[i];
+        printf(" %-24s %12.2f  z %6.1f  rz %6.1f%s\n", set->name[id], set->value[id],
+            set->z[id], set->robust[id],
+            set->flag[id] == (ANOMALY_EWMA | ANOMALY_ROBUST) ? "" :
+            set->flag[id] == ANOMALY_EWMA ? "  (EWMA only)" : "  (median only)");
+    }
+    printf("---------------------------------------\n");
+    return count + 2;
+}
+
+/** @brief Free the series.
+ *  @param set The series.
+ *  @return Void.
+ */
+void anomaly_close(struct anomaly_set *set) {
+    free(set->name);
+    free(set->value);
+    free(set->mean);
+    free(set->var);
+    free(set->median);
+    free(set->mad);
+    free(set->z);
+    free(set->robust);
+    free(set->seen);
+    free(set->flag);
+    free(set->unused);
+}
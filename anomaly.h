@@ -0,0 +1,90 @@
+/*
+ * Header file for the online anomaly detector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef __Anomaly_header
+#define __Anomaly_header
+
+#define ANOMALY_NAME 32        // the size of the name of a series
+#define ANOMALY_ALPHA 0.1      // the weight of a new value in the EWMA (about the last 10 samples)
+#define ANOMALY_ETA 0.05       // the step of the median and MAD estimates, relative to the spread
+#define ANOMALY_Z 4.0          // a value this many standard deviations away is unusual
+#define ANOMALY_WARMUP 10      // the samples a series needs before being judged
+#define ANOMALY_TOP 8          // the number of unusual series listed
+
+/** @brief The flags of a judged value. */
+enum anomaly_flag {
+    ANOMALY_EWMA = 1,          // far from the EWMA mean, in EWMA standard deviations
+    ANOMALY_ROBUST = 2         // far from the median, in MADs
+};
+
+/** @brief The state of every series, one array per field (structure of arrays).
+ *
+ *  The update of all the series is one loop over flat arrays of doubles,
+ *  without branches, which the compiler can vectorize.
+ */
+struct anomaly_set {
+    int count, capacity;       // the number of series (removed ones included), and allocated
+    int *unused, unused_count; // the removed series, reused first by anomaly_add
+    char (*name)[ANOMALY_NAME];
+    double *value;             // the new value of each series, set before anomaly_update
+    double *mean, *var;        // the EWMA mean and variance
+    double *median, *mad;      // the streaming median and median absolute deviation
+    double *z, *robust;        // the last scores: (value - mean) / sd and (value - median) / (1.4826 MAD)
+    double *seen;              // the number of values of each series (a double, like the other lanes)
+    unsigned char *flag;       // the anomaly_flag of the last value
+};
+
+/** @brief Start an empty set of series.
+ *  @param set The set to initialize.
+ *  @return Void.
+ */
+void anomaly_init(struct anomaly_set *set);
+
+/** @brief Add a series, in the place of a removed one if any.
+ *  @param set The series.
+ *  @param name The name of the series (copied).
+ *  @return The index of the series, to set its value.
+ */
+int anomaly_add(struct anomaly_set *set, const char *name);
+
+/** @brief Remove a series (e.g. of a process which exited), its index is reused by anomaly_add.
+ *  @param set The series.
+ *  @param id The index of the series.
+ *  @return Void.
+ */
+void anomaly_remove(struct anomaly_set *set, int id);
+
+/** @brief Judge the new value of every series, then fold it into the state, in O(1) per series.
+ *
+ *  EWMA: diff = x - mean, mean += alpha diff, var = (1 - alpha) (var + alpha diff^2)
+ *  Median/MAD: median += step sign(x - median), MAD += step sign(|x - median| - MAD),
+ *  never past the value, where step = eta (MAD + sd), after ANOMALY_WARMUP plain averages.
+ *  A value is unusual when its score is over ANOMALY_Z, once the series has
+ *  ANOMALY_WARMUP values. The fixed median and MAD steps make them robust to
+ *  the spikes which drag the EWMA mean and inflate its variance.
+ *
+ *  @param set The series, with their new values.
+ *  @return The number of unusual values.
+ */
+int anomaly_update(struct anomaly_set *set);
+
+/** @brief Prints the series whose last value is unusual, the most unusual first.
+ *  @param set The series.
+ *  @param title The title of the section, e.g. "Anomalies".
+ *  @return The number of lines printed.
+ */
+int show_anomalies(struct anomaly_set *set, const char *title);
+
+/** @brief Free the series.
+ *  @param set The series.
+ *  @return Void.
+ */
+void anomaly_close(struct anomaly_set *set);
+
+#endif
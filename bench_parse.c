@@ -0,0 +1,121 @@
+/** @file bench_parse.c
+ *  @brief Microbenchmark of the number parsing kernels
+ *
+ *  Build a synthetic "/proc/interrupts" of a large host (many interrupt
+ *  lines, one right-aligned column per CPU), then parse it repeatedly with
+ *  each kernel supported by the CPU, check that all of them give the same
+ *  numbers as the scalar kernel, and report the throughput in GB/s.
+ *
+ *  Usage: ./bench_parse [cpus] [lines]
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "parse_numbers.h"
+#include <time.h>
+
+#define BENCH_SECONDS 0.5   // the minimum time spent on each kernel
+
+/** @brief Build the synthetic table.
+ *  @param ncpu The number of CPU columns.
+ *  @param lines The number of interrupt lines.
+ *  @param size Where to store the length of the text.
+ *  @return The text (to be freed by the caller).
+ */
+static char *build_table(int ncpu, int lines, size_t *size) {
+    size_t capacity = (size_t) lines * (ncpu * 21 + 64) + 1;
+    char *text = malloc(capacity), *ptr = text;
+
+    if (text == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    srand(1);
+    for (int line = 0; line < lines; line ++) {
+        ptr += sprintf(ptr, "%4d:", line);
+        for (int cpu = 0; cpu < ncpu; cpu ++) {
+            // Mostly small counters, with some very busy ones
+            uint64_t value = rand() % 4 == 0 ? (uint64_t) rand() * rand() : rand() % 100000;
+            ptr += sprintf(ptr, " %10llu", (unsigned long long) value);
+        }
+        ptr += sprintf(ptr, "  IR-PCI-MSI 524288-edge      nvme0q%d\n", line);
+    }
+    *size = ptr - text;
+    return text;
+}
+
+/** @brief Parse every line of the table once.
+ *  @param kernel The kernel to use.
+ *  @param text The table.
+ *  @param size The length of the table.
+ *  @param out Where to store the numbers (lines x ncpu).
+ *  @param ncpu The number of CPU columns.
+ *  @return The number of numbers parsed.
+ */
+static size_t parse_table(parse_kernel kernel, const char *text, size_t size,
+    uint64_t *out, int ncpu) {
+    const char *ptr = text, *end = text + size;
+    size_t total = 0;
+
+    while (ptr < end) {
+        ptr = strchr(ptr, ':') + 1;
+        total += kernel(&ptr, end, out + total, ncpu);
+        ptr = strchr(ptr, '\n') + 1;
+    }
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    int ncpu = argc > 1 ? atoi(argv[1]) : 256;
+    int lines = argc > 2 ? atoi(argv[2]) : 512;
+    const char *names[] = {"scalar", "sse4.2", "avx2"};
+    size_t size, cells = (size_t) ncpu * lines;
+
+    if (ncpu <= 0 || lines <= 0) {
+        fprintf(stderr, "Usage: %s [cpus] [lines]\n", argv[0]);
+        exit(1);
+    }
+    char *text = build_table(ncpu, lines, &size);
+    uint64_t *expected = malloc(cells * sizeof(uint64_t));
+    uint64_t *out = malloc(cells * sizeof(uint64_t));
+    if (expected == NULL || out == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    parse_table(parse_u64_scalar, text, size, expected, ncpu);
+
+    printf("%d CPUs x %d lines, %.1f MB, default kernel: %s\n",
+        ncpu, lines, size * 1e-6, parse_kernel_name());
+    for (int i = 0; i < 3; i ++) {
+        parse_kernel kernel = parse_kernel_get(names[i]);
+        if (kernel == NULL) {
+            printf(" %-7s not supported\n", names[i]);
+            continue;
+        }
+
+        struct timespec start, now;
+        double elapsed;
+        long rounds = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            if (parse_table(kernel, text, size, out, ncpu) != cells) {
+                fprintf(stderr, "%s: wrong number of values\n", names[i]);
+                exit(1);
+            }
+            rounds ++;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+        } while (elapsed < BENCH_SECONDS);
+
+        if (memcmp(out, expected, cells * sizeof(uint64_t)) != 0) {
+            fprintf(stderr, "%s: the values differ from the scalar kernel\n", names[i]);
+            exit(1);
+        }
+        printf(" %-7s %6.2f GB/s\n", names[i], size * rounds / elapsed * 1e-9);
+    }
+
+    free(text);
+    free(expected);
+    free(out);
+    return 0;
+}
@@ -0,0 +1,107 @@
+/** @file bench_utmp.c
+ *  @brief Microbenchmark of the utmp readers
+ *
+ *  Write a synthetic utmp file (100k records by default, 3 in 4 of them
+ *  USER_PROCESS), then walk it repeatedly with getutent() and with the
+ *  one-shot reader of session_stats.c, and report the time per pass.
+ *
+ *  Usage: ./bench_utmp [records] [path]
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "session_stats.h"
+#include <time.h>
+
+#define BENCH_SECONDS 0.5   // the minimum time spent on each reader
+
+/** @brief Write the synthetic utmp file.
+ *  @param path The file to write.
+ *  @param records The number of records.
+ *  @return Void.
+ */
+static void build_utmp(const char *path, int records) {
+    FILE *file = fopen(path, "w");
+    struct utmp record;
+
+    if (file == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    for (int i = 0; i < records; i ++) {
+        memset(&record, 0, sizeof(record));
+        record.ut_type = i % 4 == 0 ? DEAD_PROCESS : USER_PROCESS;
+        record.ut_pid = 1000 + i;
+        snprintf(record.ut_line, sizeof(record.ut_line), "pts/%d", i);
+        snprintf(record.ut_id, sizeof(record.ut_id), "%d", i % 1000);
+        snprintf(record.ut_user, sizeof(record.ut_user), "user%d", i % 500);
+        snprintf(record.ut_host, sizeof(record.ut_host), "10.0.%d.%d", i / 256 % 256, i % 256);
+        if (fwrite(&record, sizeof(record), 1, file) != 1) {
+            perror("fwrite");
+            exit(1);
+        }
+    }
+    fclose(file);
+}
+
+/** @brief Walk the file with getutent().
+ *  @param path The utmp file.
+ *  @return The number of USER_PROCESS records.
+ */
+static int walk_getutent(const char *path) {
+    struct utmp *record;
+    int count = 0;
+
+    utmpname(path);
+    setutent();
+    while ((record = getutent()) != NULL) {
+        count += record->ut_type == USER_PROCESS;
+    }
+    endutent();
+    return count;
+}
+
+/** @brief Read the file with session_parse().
+ *  @param sessions The collector state.
+ *  @return The number of USER_PROCESS records.
+ */
+static int walk_session(struct session_stats *sessions) {
+    session_parse(sessions);
+    return sessions->count;
+}
+
+int main(int argc, char *argv[]) {
+    int records = argc > 1 ? atoi(argv[1]) : 100000;
+    const char *path = argc > 2 ? argv[2] : "/tmp/bench_utmp.utmp";
+    struct session_stats sessions;
+
+    if (records <= 0) {
+        fprintf(stderr, "Usage: %s [records] [path]\n", argv[0]);
+        exit(1);
+    }
+    build_utmp(path, records);
+    session_init(&sessions, path);
+    printf("%d records, %.1f MB\n", records, records * sizeof(struct utmp) * 1e-6);
+
+    for (int reader = 0; reader < 2; reader ++) {
+        struct timespec start, now;
+        double elapsed;
+        long rounds = 0;
+        int count;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            count = reader == 0 ? walk_getutent(path) : walk_session(&sessions);
+            rounds ++;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+        } while (elapsed < BENCH_SECONDS);
+
+        printf(" %-13s %8.2f ms per pass  (%d sessions)\n",
+            reader == 0 ? "getutent" : "session_parse", elapsed / rounds * 1e3, count);
+    }
+
+    session_close(&sessions);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,305 @@
+/** @file cgroup_stats.c
+ *  @brief Report the memory and CPU usage of cgroups (v2)
+ *
+ *  This file includes the functions that read the memory and CPU files of
+ *  one or many cgroups, and report their usage relative to the limits of
+ *  the cgroup rather than the host. This is what matters for a service
+ *  running in a container, where "/proc/meminfo" and the number of cores
+ *  describe the whole host.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "cgroup_stats.h"
+
+/** @brief The names of the files read in each cgroup (see enum cgroup_file). */
+static const char *cgroup_files[CG_FILES] = {
+    "memory.current", "memory.stat", "memory.max", "cpu.stat", "cpu.max"
+};
+
+/** @brief Find the mount point of the cgroup2 hierarchy.
+ *
+ *  Read "/proc/self/mountinfo" and look for the "cgroup2" file system, so
+ *  that both the unified ("/sys/fs/cgroup") and the hybrid layout
+ *  ("/sys/fs/cgroup/unified") are supported.
+ *
+ *  @param root Where to store the mount point.
+ *  @param size The size of root.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_find_root(char *root, size_t size) {
+    FILE *mountinfo;        // a file pointer pointing to "/proc/self/mountinfo"
+    char line[1024];        // a string storing each line of the file
+    char mount[PATH_MAX];   // the mount point of the line
+    char *fstype;           // the file system type of the line
+    int found = 0;
+
+    if ((mountinfo = fopen("/proc/self/mountinfo", "r")) == NULL) {
+        return 0;
+    }
+    while (!found && fgets(line, sizeof(line), mountinfo)) {
+        // The file system type follows the " - " separator
+        if (sscanf(line, "%*s %*s %*s %*s %4095s", mount) == 1 &&
+            (fstype = strstr(line, " - ")) != NULL &&
+            strncmp(fstype, " - cgroup2 ", 11) == 0) {
+            snprintf(root, size, "%s", mount);
+            found = 1;
+        }
+    }
+    fclose(mountinfo);
+    return found;
+}
+
+/** @brief Get the cgroup2 path of the current process.
+ *
+ *  Read the "0::<path>" line of "/proc/self/cgroup".
+ *
+ *  @param path Where to store the path.
+ *  @param size The size of path.
+ *  @return 1 if the path has been found, 0 otherwise.
+ */
+int cgroup_self_path(char *path, size_t size) {
+    FILE *cgroup;        // a file pointer pointing to "/proc/self/cgroup"
+    char line[PATH_MAX]; // a string storing each line of the file
+    int found = 0;
+
+    if ((cgroup = fopen("/proc/self/cgroup", "r")) == NULL) {
+        return 0;
+    }
+    while (!found && fgets(line, sizeof(line), cgroup)) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            snprintf(path, size, "%s", line + 3);
+            found = 1;
+        }
+    }
+    fclose(cgroup);
+    return found;
+}
+
+/** @brief Read a whole (small) file of a cgroup into buf with pread().
+ *  @param fd The fd of the file.
+ *  @param buf Where to store the content, null-terminated.
+ *  @param size The size of buf.
+ *  @return The number of bytes read, or -1 on failure.
+ */
+ssize_t cgroup_read_file(int fd, char *buf, size_t size) {
+    ssize_t len;
+
+    if (fd == -1 || (len = pread(fd, buf, size - 1, 0)) < 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/** @brief Read the value of "memory.max" or the quota of "cpu.max".
+ *  @param text The content of the file.
+ *  @return The value, or -1 if the file says "max" (no limit).
+ */
+static long long cgroup_parse_limit(const char *text) {
+    long long value;
+
+    if (strncmp(text, "max", 3) == 0 || sscanf(text, "%lld", &value) != 1) {
+        return -1;
+    }
+    return value;
+}
+
+/** @brief Re-read the files of one cgroup.
+ *  @param cg The cgroup to read.
+ *  @return Void.
+ */
+static void cgroup_read(struct cgroup_stats *cg) {
+    char buf[4096];  // the content of each file
+    char key[64];    // the key of each "memory.stat" / "cpu.stat" line
+    unsigned long long value;
+    long long quota, period;
+    char *line;
+
+    if (cgroup_read_file(cg->fd[CG_MEMORY_CURRENT], buf, sizeof(buf)) > 0) {
+        cg->mem_current = atoll(buf);
+    }
+    if (cgroup_read_file(cg->fd[CG_MEMORY_MAX], buf, sizeof(buf)) > 0) {
+        cg->mem_max = cgroup_parse_limit(buf);
+    }
+
+    // Read "memory.stat" in one pass, keeping the keys we need
+    if (cgroup_read_file(cg->fd[CG_MEMORY_STAT], buf, sizeof(buf)) > 0) {
+        for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+            if (*line == '\n') line ++;
+            if (sscanf(line, "%63s %llu", key, &value) != 2) continue;
+            if (strcmp(key, "anon") == 0) cg->anon = value;
+            else if (strcmp(key, "file") == 0) cg->file = value;
+            else if (strcmp(key, "slab") == 0) cg->slab = value;
+        }
+    }
+
+    if (cgroup_read_file(cg->fd[CG_CPU_STAT], buf, sizeof(buf)) > 0) {
+        for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+            if (*line == '\n') line ++;
+            if (sscanf(line, "%63s %llu", key, &value) != 2) continue;
+            if (strcmp(key, "usage_usec") == 0) cg->usage_usec = value;
+            else if (strcmp(key, "nr_periods") == 0) cg->nr_periods = value;
+            else if (strcmp(key, "nr_throttled") == 0) cg->nr_throttled = value;
+            else if (strcmp(key, "throttled_usec") == 0) cg->throttled_usec = value;
+        }
+    }
+
+    // "cpu.max" is "<quota> <period>", quota is "max" if there is no limit
+    if (cgroup_read_file(cg->fd[CG_CPU_MAX], buf, sizeof(buf)) > 0) {
+        quota = cgroup_parse_limit(buf);
+        if (quota > 0 && sscanf(buf, "%*s %lld", &period) == 1 && period > 0) {
+            cg->cpu_quota = (double) quota / period;
+        } else {
+            cg->cpu_quota = -1;
+        }
+    }
+}
+
+/** @brief Initialize an empty set of cgroups.
+ *  @param set The set to initialize.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_init(struct cgroup_set *set) {
+    struct sysinfo info;  // to get the memory of the host
+
+    memset(set, 0, sizeof(*set));
+    if (sysinfo(&info) == 0) {
+        set->host_memory = (long long) info.totalram * info.mem_unit;
+    }
+    time_since(&set->last);
+    return cgroup_find_root(set->root, sizeof(set->root));
+}
+
+/** @brief Add a cgroup to the set and take its first sample.
+ *
+ *  Every file of the cgroup is opened once here, and re-read with pread()
+ *  at every sample. A path which does not start with the cgroup2 root is
+ *  considered relative to the root.
+ *
+ *  @param set The set of cgroups.
+ *  @param path The path of the cgroup.
+ *  @return 1 if the cgroup has been added, 0 otherwise.
+ */
+int cgroup_add(struct cgroup_set *set, const char *path) {
+    char dir[2 * PATH_MAX], file[2 * PATH_MAX + 32];
+    size_t root_len = strlen(set->root);
+    struct cgroup_stats *cg;
+    int opened = 0;   // the number of files opened
+
+    if (set->count == CGROUP_MAX) {
+        fprintf(stderr, "Too many cgroups, \"%s\" is ignored\n", path);
+        return 0;
+    }
+
+    // Accept both "/sys/fs/cgroup/a/b" and "/a/b" (or "a/b")
+    if (strncmp(path, set->root, root_len) == 0 &&
+        (path[root_len] == '/' || path[root_len] == '\0')) {
+        path += root_len;
+    }
+    while (*path == '/') path ++;
+    snprintf(dir, sizeof(dir), "%s/%s", set->root, path);
+
+    cg = &set->cg[set->count];
+    memset(cg, 0, sizeof(*cg));
+    snprintf(cg->path, sizeof(cg->path), "/%s", path);
+    for (int i = 0; i < CG_FILES; i ++) {
+        snprintf(file, sizeof(file), "%s/%s", dir, cgroup_files[i]);
+        // The root cgroup has no "memory.max" or "cpu.max", and a controller
+        // may be disabled, so a missing file is not an error
+        if ((cg->fd[i] = open(file, O_RDONLY | O_CLOEXEC)) != -1) {
+            opened ++;
+        }
+    }
+    if (opened == 0) {
+        fprintf(stderr, "Cannot read cgroup \"%s\"\n", dir);
+        return 0;
+    }
+
+    cg->mem_max = -1;
+    cg->cpu_quota = -1;
+    cgroup_read(cg);
+    cg->usage_prev = cg->usage_usec;
+    cg->throttled_prev = cg->throttled_usec;
+    cg->periods_prev = cg->nr_periods;
+    cg->nr_throttled_prev = cg->nr_throttled;
+    set->count ++;
+    return 1;
+}
+
+/** @brief Re-read the files of every cgroup and compute the CPU deltas.
+ *
+ *  CPU used (cores) = (usage_usec_curr - usage_usec_prev) / interval
+ *  Throttled (secs) = (throttled_usec_curr - throttled_usec_prev) * 1e-6
+ *
+ *  @param set The set of cgroups.
+ *  @return Void.
+ */
+void cgroup_sample(struct cgroup_set *set) {
+    set->interval = time_since(&set->last);
+
+    for (int i = 0; i < set->count; i ++) {
+        struct cgroup_stats *cg = &set->cg[i];
+        cgroup_read(cg);
+
+        if (set->interval > 0) {
+            cg->cpu_use = (cg->usage_usec - cg->usage_prev) * 1e-6 / set->interval;
+        }
+        cg->throttled = (cg->throttled_usec - cg->throttled_prev) * 1e-6;
+        cg->periods = cg->nr_periods - cg->periods_prev;
+        cg->throttled_periods = cg->nr_throttled - cg->nr_throttled_prev;
+
+        cg->usage_prev = cg->usage_usec;
+        cg->throttled_prev = cg->throttled_usec;
+        cg->periods_prev = cg->nr_periods;
+        cg->nr_throttled_prev = cg->nr_throttled;
+    }
+}
+
+/** @brief Prints the cgroup section, usage is relative to the cgroup limits.
+ *  @param set The set of cgroups.
+ *  @return The number of lines printed.
+ */
+int show_cgroup_info(struct cgroup_set *set) {
+    int lines = 1;   // the number of lines printed
+
+    printf("### Cgroups ### (memory used/limit -- CPU used/quota, throttled)\n");
+    for (int i = 0; i < set->count; i ++) {
+        struct cgroup_stats *cg = &set->cg[i];
+        // If the cgroup has no limit, the limit is the host itself
+        long long mem_limit = cg->mem_max >= 0 ? cg->mem_max : set->host_memory;
+        double cores = cg->cpu_quota > 0 ? cg->cpu_quota : sysconf(_SC_NPROCESSORS_ONLN);
+
+        printf(" %s\n", cg->path);
+        if (cg->fd[CG_MEMORY_CURRENT] == -1) {
+            printf("   memory n/a (memory controller not enabled)\n");
+        } else {
+            printf("   memory %.2f GB / %.2f GB%s (%.2f%%)  anon %.2f GB  file %.2f GB  slab %.2f GB\n",
+                cg->mem_current * 1e-9, mem_limit * 1e-9, cg->mem_max >= 0 ? "" : " (host)",
+                mem_limit > 0 ? 100.0 * cg->mem_current / mem_limit : 0.0,
+                cg->anon * 1e-9, cg->file * 1e-9, cg->slab * 1e-9);
+        }
+        printf("   cpu %.2f / %.2f cores%s (%.2f%%)  throttled %llu/%llu periods, %.3f secs\n",
+            cg->cpu_use, cores, cg->cpu_quota > 0 ? "" : " (host)",
+            cores > 0 ? 100.0 * cg->cpu_use / cores : 0.0, cg->throttled_periods, cg->periods,
+            cg->throttled);
+        lines += 3;
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Close every file opened by the collector.
+ *  @param set The set of cgroups.
+ *  @return Void.
+ */
+void cgroup_close(struct cgroup_set *set) {
+    for (int i = 0; i < set->count; i ++) {
+        for (int j = 0; j < CG_FILES; j ++) {
+            if (set->cg[i].fd[j] != -1) close(set->cg[i].fd[j]);
+        }
+    }
+    set->count = 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Header file for the cgroup v2 memory and CPU collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/sysinfo.h>
+
+#ifndef __Cgroup_header
+#define __Cgroup_header
+
+#define CGROUP_MAX 64   // the maximum number of cgroups reported at once
+
+/** @brief The files read from each cgroup directory. */
+enum cgroup_file {
+    CG_MEMORY_CURRENT,  // "memory.current"
+    CG_MEMORY_STAT,     // "memory.stat"
+    CG_MEMORY_MAX,      // "memory.max"
+    CG_CPU_STAT,        // "cpu.stat"
+    CG_CPU_MAX,         // "cpu.max"
+    CG_FILES
+};
+
+/** @brief State of one cgroup kept between two samples. */
+struct cgroup_stats {
+    char path[PATH_MAX];   // path of the cgroup relative to the cgroup2 root
+    int fd[CG_FILES];      // one fd per file, -1 if the file does not exist
+
+    long long mem_current; // memory used (in bytes)
+    long long mem_max;     // memory limit (in bytes), -1 if unlimited
+    long long anon, file, slab;  // breakdown from "memory.stat" (in bytes)
+
+    double cpu_quota;      // CPU limit (in cores), -1 if unlimited
+    unsigned long long usage_usec, throttled_usec, nr_periods, nr_throttled;
+    unsigned long long usage_prev, throttled_prev, periods_prev, nr_throttled_prev;
+    double cpu_use;        // CPU used over the interval (in cores)
+    double throttled;      // time throttled over the interval (in seconds)
+    unsigned long long periods, throttled_periods;  // periods over the interval
+};
+
+/** @brief The set of cgroups reported by the collector. */
+struct cgroup_set {
+    char root[PATH_MAX];   // mount point of the cgroup2 hierarchy
+    int count;             // number of cgroups in the set
+    struct cgroup_stats cg[CGROUP_MAX];
+    long long host_memory; // MemTotal of the host, used when there is no limit
+    struct timespec last;  // time of the previous sample
+    double interval;       // seconds between the last two samples
+};
+
+/** @brief Find the mount point of the cgroup2 hierarchy.
+ *
+ *  Read "/proc/self/mountinfo" and look for the "cgroup2" file system, so
+ *  that both the unified ("/sys/fs/cgroup") and the hybrid layout
+ *  ("/sys/fs/cgroup/unified") are supported.
+ *
+ *  @param root Where to store the mount point.
+ *  @param size The size of root.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_find_root(char *root, size_t size);
+
+/** @brief Get the cgroup2 path of the current process.
+ *
+ *  Read the "0::<path>" line of "/proc/self/cgroup".
+ *
+ *  @param path Where to store the path.
+ *  @param size The size of path.
+ *  @return 1 if the path has been found, 0 otherwise.
+ */
+int cgroup_self_path(char *path, size_t size);
+
+/** @brief Initialize an empty set of cgroups.
+ *  @param set The set to initialize.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_init(struct cgroup_set *set);
+
+/** @brief Add a cgroup to the set and take its first sample.
+ *
+ *  Every file of the cgroup is opened once here, and re-read with pread()
+ *  at every sample. A path which does not start with the cgroup2 root is
+ *  considered relative to the root.
+ *
+ *  @param set The set of cgroups.
+ *  @param path The path of the cgroup.
+ *  @return 1 if the cgroup has been added, 0 otherwise.
+ */
+int cgroup_add(struct cgroup_set *set, const char *path);
+
+/** @brief Re-read the files of every cgroup and compute the CPU deltas.
+ *
+ *  CPU used (cores) = (usage_usec_curr - usage_usec_prev) / interval
+ *  Throttled (secs) = (throttled_usec_curr - throttled_usec_prev) * 1e-6
+ *
+ *  @param set The set of cgroups.
+ *  @return Void.
+ */
+void cgroup_sample(struct cgroup_set *set);
+
+/** @brief Prints the cgroup section, usage is relative to the cgroup limits.
+ *  @param set The set of cgroups.
+ *  @return The number of lines printed.
+ */
+int show_cgroup_info(struct cgroup_set *set);
+
+/** @brief Close every file opened by the collector.
+ *  @param set The set of cgroups.
+ *  @return Void.
+ */
+void cgroup_close(struct cgroup_set *set);
+
+/** @brief Read a whole (small) file of a cgroup into buf with pread().
+ *  @param fd The fd of the file.
+ *  @param buf Where to store the content, null-terminated.
+ *  @param size The size of buf.
+ *  @return The number of bytes read, or -1 on failure.
+ */
+ssize_t cgroup_read_file(int fd, char *buf, size_t size);
+
+#endif
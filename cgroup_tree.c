@@ -0,0 +1,477 @@
+/** @file cgroup_tree.c
+ *  @brief Report the top consumers among all the cgroups of a system
+ *
+ *  This file includes the functions that walk the whole cgroup2 hierarchy
+ *  (every systemd slice, service and container), and report which cgroups
+ *  use the most CPU, memory and I/O. The tree is walked only once at start,
+ *  then inotify tells which cgroups are created or removed, and the state of
+ *  each cgroup is kept in a hash table between two samples.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "cgroup_stats.h"
+#include "cgroup_tree.h"
+
+/** @brief Hash a path (FNV-1a) into a bucket index.
+ *  @param path The path to hash.
+ *  @return The bucket index.
+ */
+static unsigned int cgtree_hash(const char *path) {
+    unsigned int hash = 2166136261u;
+
+    while (*path) {
+        hash = (hash ^ (unsigned char) *path ++) * 16777619u;
+    }
+    return hash % CGTREE_BUCKETS;
+}
+
+/** @brief Find the entry of a cgroup by its path.
+ *  @param tree The walker state.
+ *  @param path The path relative to the cgroup2 root.
+ *  @return The entry, or NULL if the cgroup is unknown.
+ */
+static struct cgtree_entry *cgtree_find_path(struct cgroup_tree *tree, const char *path) {
+    struct cgtree_entry *entry = tree->by_path[cgtree_hash(path)];
+
+    while (entry != NULL && strcmp(entry->path, path) != 0) {
+        entry = entry->next_path;
+    }
+    return entry;
+}
+
+/** @brief Find the entry of a cgroup by its inotify watch descriptor.
+ *  @param tree The walker state.
+ *  @param wd The watch descriptor.
+ *  @return The entry, or NULL if the cgroup is unknown.
+ */
+static struct cgtree_entry *cgtree_find_wd(struct cgroup_tree *tree, int wd) {
+    struct cgtree_entry *entry = tree->by_wd[wd % CGTREE_BUCKETS];
+
+    while (entry != NULL && entry->wd != wd) {
+        entry = entry->next_wd;
+    }
+    return entry;
+}
+
+/** @brief The names of the files read from each cgroup (see enum cgtree_file). */
+static const char *cgtree_files[CGT_FILES] = { "cpu.stat", "memory.current", "io.stat" };
+
+/** @brief Open the files of a cgroup, kept open between two samples.
+ *
+ *  A file the cgroup does not have (e.g. "io.stat" without the io
+ *  controller) stays -1. When no fd is left, the file is opened at each
+ *  read instead.
+ *
+ *  @param tree The walker state.
+ *  @param entry The cgroup.
+ *  @return Void.
+ */
+static void cgtree_open(struct cgroup_tree *tree, struct cgtree_entry *entry) {
+    char file[2 * PATH_MAX];
+
+    for (int i = 0; i < CGT_FILES; i ++) {
+        snprintf(file, sizeof(file), "%s%s/%s", tree->root, entry->path, cgtree_files[i]);
+        if ((entry->fd[i] = open(file, O_RDONLY | O_CLOEXEC)) == -1 &&
+            (errno == EMFILE || errno == ENFILE)) {
+            entry->fd[i] = CGTREE_REOPEN;
+        }
+    }
+}
+
+/** @brief Close the files of a cgroup.
+ *  @param entry The cgroup.
+ *  @return Void.
+ */
+static void cgtree_close_files(struct cgtree_entry *entry) {
+    for (int i = 0; i < CGT_FILES; i ++) {
+        if (entry->fd[i] >= 0) {
+            close(entry->fd[i]);
+        }
+        entry->fd[i] = -1;
+    }
+}
+
+/** @brief Watch a cgroup directory for the cgroups created or removed in it.
+ *  @param tree The walker state.
+ *  @param entry The cgroup, without a watch.
+ *  @param dir The directory of the cgroup.
+ *  @return Void.
+ */
+static void cgtree_watch(struct cgroup_tree *tree, struct cgtree_entry *entry, const char *dir) {
+    if ((entry->wd = inotify_add_watch(tree->inotify_fd, dir, IN_CREATE | IN_DELETE | IN_ONLYDIR)) == -1) {
+        tree->unwatched ++;  // rescanned at each sample, see cgroup_tree_sample
+        return;
+    }
+    entry->next_wd = tree->by_wd[entry->wd % CGTREE_BUCKETS];
+    tree->by_wd[entry->wd % CGTREE_BUCKETS] = entry;
+}
+
+/** @brief Add a cgroup and all its descendants to the tables.
+ *
+ *  Cgroups which are already known are kept (with their state), but their
+ *  sub-directories are still walked. Every cgroup found is marked with the
+ *  current generation of the walk.
+ *
+ *  @param tree The walker state.
+ *  @param path The path relative to the cgroup2 root ("" for the root).
+ *  @return Void.
+ */
+static void cgtree_add(struct cgroup_tree *tree, const char *path) {
+    char dir[2 * PATH_MAX], child[PATH_MAX];
+    struct cgtree_entry *entry;
+    struct dirent *dirent;
+    DIR *stream;
+
+    snprintf(dir, sizeof(dir), "%s%s", tree->root, path);
+    if ((entry = cgtree_find_path(tree, path)) == NULL) {
+        if ((entry = calloc(1, sizeof(*entry))) == NULL ||
+            (entry->path = strdup(path)) == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        cgtree_watch(tree, entry, dir);
+        cgtree_open(tree, entry);
+
+        unsigned int bucket = cgtree_hash(path);
+        entry->next_path = tree->by_path[bucket];
+        tree->by_path[bucket] = entry;
+        tree->count ++;
+    } else if (entry->wd == -1) {
+        tree->unwatched --;  // a watch may have been freed since
+        cgtree_watch(tree, entry, dir);
+    }
+    entry->generation = tree->generation;
+
+    // Each sub-directory of a cgroup is a child cgroup
+    if ((stream = opendir(dir)) == NULL) {
+        return;
+    }
+    while ((dirent = readdir(stream)) != NULL) {
+        if (dirent->d_type == DT_DIR && dirent->d_name[0] != '.') {
+            snprintf(child, sizeof(child), "%s/%s", path, dirent->d_name);
+            cgtree_add(tree, child);
+        }
+    }
+    closedir(stream);
+}
+
+/** @brief Unlink an entry from both tables and free it.
+ *  @param tree The walker state.
+ *  @param link The link pointing to the entry in the path table.
+ *  @return Void.
+ */
+static void cgtree_unlink(struct cgroup_tree *tree, struct cgtree_entry **link) {
+    struct cgtree_entry *entry = *link;
+
+    *link = entry->next_path;  // unlink from the path table
+    if (entry->wd != -1) {     // unlink from the wd table
+        struct cgtree_entry **wd_link = &tree->by_wd[entry->wd % CGTREE_BUCKETS];
+        while (*wd_link != entry) wd_link = &(*wd_link)->next_wd;
+        *wd_link = entry->next_wd;
+    } else {
+        tree->unwatched --;
+    }
+    cgtree_close_files(entry);
+    free(entry->path);
+    free(entry);
+    tree->count --;
+}
+
+/** @brief Remove a cgroup from the tables.
+ *
+ *  A cgroup can only be removed once it has no child, so the children
+ *  have already been removed by their own events.
+ *
+ *  @param tree The walker state.
+ *  @param path The path relative to the cgroup2 root.
+ *  @return Void.
+ */
+static void cgtree_remove(struct cgroup_tree *tree, const char *path) {
+    struct cgtree_entry **link = &tree->by_path[cgtree_hash(path)];
+
+    while (*link != NULL && strcmp((*link)->path, path) != 0) {
+        link = &(*link)->next_path;
+    }
+    if (*link != NULL) {
+        cgtree_unlink(tree, link);
+    }
+}
+
+/** @brief Walk the whole tree again, e.g. after inotify lost events.
+ *
+ *  The cgroups not found during the walk have been removed meanwhile.
+ *
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+static void cgtree_rescan(struct cgroup_tree *tree) {
+    tree->generation ++;
+    cgtree_add(tree, "");
+    for (int i = 0; i < CGTREE_BUCKETS; i ++) {
+        struct cgtree_entry **link = &tree->by_path[i];
+        while (*link != NULL) {
+            if ((*link)->generation != tree->generation) {
+                cgtree_unlink(tree, link);
+            } else {
+                link = &(*link)->next_path;
+            }
+        }
+    }
+}
+
+/** @brief Read the pending inotify events, without blocking.
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+static void cgtree_handle_events(struct cgroup_tree *tree) {
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    char path[PATH_MAX];
+    int overflow = 0;   // whether the kernel dropped events
+    ssize_t len;
+
+    while ((len = read(tree->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+            struct cgtree_entry *parent;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = 1;
+            }
+            if (event->wd < 0) {  // the overflow event has no watch
+                continue;
+            }
+            parent = cgtree_find_wd(tree, event->wd);
+            if (parent == NULL || event->len == 0 || !(event->mask & IN_ISDIR)) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", parent->path, event->name);
+            if (event->mask & IN_CREATE) {
+                cgtree_add(tree, path);
+            } else if (event->mask & IN_DELETE) {
+                cgtree_remove(tree, path);
+            }
+        }
+    }
+    if (overflow || tree->unwatched > 0) {
+        cgtree_rescan(tree);
+    }
+}
+
+/** @brief Read a small file of a cgroup, from its fd kept open.
+ *  @param tree The walker state.
+ *  @param entry The cgroup.
+ *  @param file The file (see enum cgtree_file).
+ *  @param buf Where to store the content.
+ *  @param size The size of buf.
+ *  @return The number of bytes read, or -1 on failure (or if the cgroup has no such file).
+ */
+static ssize_t cgtree_read(struct cgroup_tree *tree, struct cgtree_entry *entry,
+    int file, char *buf, size_t size) {
+    char path[2 * PATH_MAX];
+    ssize_t len;
+    int fd;
+
+    if (entry->fd[file] != CGTREE_REOPEN) {
+        return cgroup_read_file(entry->fd[file], buf, size);
+    }
+    snprintf(path, sizeof(path), "%s%s/%s", tree->root, entry->path, cgtree_files[file]);
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    len = cgroup_read_file(fd, buf, size);
+    close(fd);
+    return len;
+}
+
+/** @brief Walk the whole cgroup2 hierarchy once and start watching it.
+ *
+ *  Every cgroup directory gets an entry in the hash tables and an inotify
+ *  watch, so that later samples only need to handle the cgroups created or
+ *  removed since, instead of rescanning the tree.
+ *
+ *  @param tree The walker state to initialize.
+ *  @param top The number of top consumers to report.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_tree_init(struct cgroup_tree *tree, int top) {
+    struct rlimit limit;
+
+    memset(tree, 0, sizeof(*tree));
+    tree->top = top;
+    if (!cgroup_find_root(tree->root, sizeof(tree->root))) {
+        return 0;
+    }
+    if ((tree->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) {
+        perror("inotify_init1");
+        exit(1);
+    }
+    // Three fds per cgroup: use the hard limit, if it is not enough
+    // cgtree_read falls back to opening the files at every sample
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    cgtree_add(tree, "");
+    cgroup_tree_sample(tree);  // take the first sample of every cgroup
+    return 1;
+}
+
+/** @brief Apply the pending inotify events and sample every cgroup.
+ *
+ *  While a cgroup has no inotify watch (fs.inotify.max_user_watches is
+ *  reached), its children are only found by walking the tree again, at
+ *  each sample, and the watch is tried again.
+ *
+ *  CPU used (cores) = (usage_usec_curr - usage_usec_prev) / interval
+ *  I/O (bytes/sec) = (io_bytes_curr - io_bytes_prev) / interval
+ *
+ *  A delta is only taken between two successful reads of a counter which
+ *  did not go backwards: a cgroup removed between the inotify events and
+ *  the read (its files fail with ENODEV) gets no value for this sample,
+ *  and its files are opened again in case the path was re-created.
+ *
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+void cgroup_tree_sample(struct cgroup_tree *tree) {
+    char buf[4096], *line;
+    unsigned long long usage, rbytes, wbytes, io;
+    int ok;
+
+    cgtree_handle_events(tree);
+    tree->interval = time_since(&tree->last);
+
+    for (int i = 0; i < CGTREE_BUCKETS; i ++) {
+        for (struct cgtree_entry *entry = tree->by_path[i]; entry; entry = entry->next_path) {
+            usage = io = 0;
+            ok = 1;
+            entry->memory = -1;
+
+            // A file the cgroup does not have counts as 0, one which fails is a failed read
+            if (entry->fd[CGT_CPU_STAT] != -1) {
+                if (cgtree_read(tree, entry, CGT_CPU_STAT, buf, sizeof(buf)) < 0 ||
+                    sscanf(buf, "usage_usec %llu", &usage) != 1) {
+                    ok = 0;
+                }
+            }
+            if (cgtree_read(tree, entry, CGT_MEMORY_CURRENT, buf, sizeof(buf)) > 0) {
+                entry->memory = atoll(buf);
+            }
+            // "io.stat" has one line per device: "<maj:min> rbytes=.. wbytes=.. ..."
+            if (entry->fd[CGT_IO_STAT] != -1) {
+                if (cgtree_read(tree, entry, CGT_IO_STAT, buf, sizeof(buf)) < 0) {
+                    ok = 0;
+                } else {
+                    for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+                        if (*line == '\n') line ++;
+                        if (sscanf(line, "%*s rbytes=%llu wbytes=%llu", &rbytes, &wbytes) == 2) {
+                            io += rbytes + wbytes;
+                        }
+                    }
+                }
+            }
+
+            if (!ok) {
+                // Removed (or re-created) since the fds were opened: no delta,
+                // and the path is opened again for the next sample
+                entry->cpu_use = entry->io_rate = 0;
+                entry->sampled = 0;
+                cgtree_close_files(entry);
+                cgtree_open(tree, entry);
+                continue;
+            }
+            if (entry->sampled && tree->interval > 0 &&
+                usage >= entry->usage_prev && io >= entry->io_prev) {
+                entry->cpu_use = (usage - entry->usage_prev) * 1e-6 / tree->interval;
+                entry->io_rate = (io - entry->io_prev) / tree->interval;
+            } else {
+                entry->cpu_use = entry->io_rate = 0;
+            }
+            entry->usage_prev = usage;
+            entry->io_prev = io;
+            entry->sampled = 1;
+        }
+    }
+}
+
+/** @brief Insert a cgroup in a top N array sorted in decreasing order.
+ *  @param top The array of the top entries.
+ *  @param values The values of the top entries.
+ *  @param n The size of the array.
+ *  @param entry The cgroup to insert.
+ *  @param value Its value.
+ *  @return Void.
+ */
+static void cgtree_insert_top(struct cgtree_entry **top, double *values, int n,
+    struct cgtree_entry *entry, double value) {
+    int j = n - 1;
+
+    if (value <= 0 || (top[j] != NULL && value <= values[j])) {
+        return;
+    }
+    // shift the smaller values down, then insert
+    while (j > 0 && (top[j - 1] == NULL || values[j - 1] < value)) {
+        top[j] = top[j - 1];
+        values[j] = values[j - 1];
+        j --;
+    }
+    top[j] = entry;
+    values[j] = value;
+}
+
+/** @brief Prints the top N cgroups by CPU, memory and I/O.
+ *  @param tree The walker state.
+ *  @return The number of lines printed.
+ */
+int show_cgroup_tree(struct cgroup_tree *tree) {
+    struct cgtree_entry *top[3][CGTREE_TOP_MAX] = {{NULL}};
+    double values[3][CGTREE_TOP_MAX];
+    const char *titles[3] = {"CPU (cores)", "Memory (GB)", "I/O (MB/s)"};
+    const double scales[3] = {1, 1e-9, 1e-6};
+    int lines = 1;   // the number of lines printed
+
+    for (int i = 0; i < CGTREE_BUCKETS; i ++) {
+        for (struct cgtree_entry *entry = tree->by_path[i]; entry; entry = entry->next_path) {
+            if (entry->path[0] == '\0') continue;  // the root is the whole host
+            cgtree_insert_top(top[0], values[0], tree->top, entry, entry->cpu_use);
+            cgtree_insert_top(top[1], values[1], tree->top, entry, entry->memory);
+            cgtree_insert_top(top[2], values[2], tree->top, entry, entry->io_rate);
+        }
+    }
+
+    printf("### Cgroup tree ### (%d cgroups, top %d)\n", tree->count, tree->top);
+    if (tree->unwatched > 0) {
+        printf(" %d cgroups not watched (fs.inotify.max_user_watches), the tree is walked at each sample\n",
+            tree->unwatched);
+        lines ++;
+    }
+    for (int k = 0; k < 3; k ++) {
+        printf(" %s\n", titles[k]);
+        for (int j = 0; j < tree->top; j ++) {
+            if (top[k][j] == NULL) {
+                printf("   %8s  -\n", "");
+            } else {
+                printf("   %8.2f  %s\n", values[k][j] * scales[k], top[k][j]->path);
+            }
+        }
+        lines += tree->top + 1;
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Free every entry and stop watching the tree.
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+void cgroup_tree_close(struct cgroup_tree *tree) {
+    for (int i = 0; i < CGTREE_BUCKETS; i ++) {
+        while (tree->by_path[i] != NULL) {
+            cgtree_unlink(tree, &tree->by_path[i]);
+        }
+    }
+    if (tree->inotify_fd > 0) close(tree->inotify_fd);
+}
@@ -0,0 +1,111 @@
+/*
+ * Header file for the cgroup tree walker (top consumers per cgroup)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+
+#ifndef __Cgroup_tree_header
+#define __Cgroup_tree_header
+
+#define CGTREE_BUCKETS 1024  // number of buckets of the hash tables
+#define CGTREE_TOP_MAX 32    // the maximum N of "--cgroup-top=N"
+#define CGTREE_REOPEN -2     // an fd not kept open (no fd left), opened at each read
+
+/** @brief The files read from each cgroup of the tree. */
+enum cgtree_file {
+    CGT_CPU_STAT,        // "cpu.stat"
+    CGT_MEMORY_CURRENT,  // "memory.current"
+    CGT_IO_STAT,         // "io.stat"
+    CGT_FILES
+};
+
+/** @brief Per-cgroup state kept between two samples.
+ *
+ *  Each entry is linked in two hash tables: by path (to find a cgroup
+ *  again when it is removed) and by inotify watch descriptor (to find the
+ *  directory an event comes from).
+ */
+struct cgtree_entry {
+    char *path;                     // path relative to the cgroup2 root
+    int wd;                         // inotify watch descriptor, -1 if none
+    struct cgtree_entry *next_path; // next entry in the same path bucket
+    struct cgtree_entry *next_wd;   // next entry in the same wd bucket
+    int fd[CGT_FILES];              // the files kept open, -1 if absent
+
+    unsigned long long usage_prev;  // "usage_usec" of "cpu.stat"
+    unsigned long long io_prev;     // rbytes + wbytes of "io.stat"
+    long long memory;               // "memory.current" (in bytes)
+    double cpu_use;                 // CPU used over the interval (in cores)
+    double io_rate;                 // I/O over the interval (in bytes/sec)
+    int sampled;                    // whether usage_prev / io_prev are valid (the last reads succeeded)
+    int generation;                 // the last walk which found the cgroup
+};
+
+/** @brief State of the cgroup tree walker. */
+struct cgroup_tree {
+    char root[PATH_MAX];            // mount point of the cgroup2 hierarchy
+    int inotify_fd;                 // inotify instance watching every cgroup
+    int count;                      // number of cgroups in the tables
+    int unwatched;                  // number of cgroups without an inotify watch (e.g. ENOSPC)
+    int top;                        // number of consumers reported
+    int generation;                 // incremented at each walk of the tree
+    struct cgtree_entry *by_path[CGTREE_BUCKETS];
+    struct cgtree_entry *by_wd[CGTREE_BUCKETS];
+    struct timespec last;           // time of the previous sample
+    double interval;                // seconds between the last two samples
+};
+
+/** @brief Walk the whole cgroup2 hierarchy once and start watching it.
+ *
+ *  Every cgroup directory gets an entry in the hash tables and an inotify
+ *  watch, so that later samples only need to handle the cgroups created or
+ *  removed since, instead of rescanning the tree.
+ *
+ *  @param tree The walker state to initialize.
+ *  @param top The number of top consumers to report.
+ *  @return 1 if a cgroup2 hierarchy is mounted, 0 otherwise.
+ */
+int cgroup_tree_init(struct cgroup_tree *tree, int top);
+
+/** @brief Apply the pending inotify events and sample every cgroup.
+ *
+ *  While a cgroup has no inotify watch (fs.inotify.max_user_watches is
+ *  reached), its children are only found by walking the tree again, at
+ *  each sample, and the watch is tried again.
+ *
+ *  CPU used (cores) = (usage_usec_curr - usage_usec_prev) / interval
+ *  I/O (bytes/sec) = (io_bytes_curr - io_bytes_prev) / interval
+ *
+ *  A delta is only taken between two successful reads of a counter which
+ *  did not go backwards: a cgroup removed between the inotify events and
+ *  the read (its files fail with ENODEV) gets no value for this sample,
+ *  and its files are opened again in case the path was re-created.
+ *
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+void cgroup_tree_sample(struct cgroup_tree *tree);
+
+/** @brief Prints the top N cgroups by CPU, memory and I/O.
+ *  @param tree The walker state.
+ *  @return The number of lines printed.
+ */
+int show_cgroup_tree(struct cgroup_tree *tree);
+
+/** @brief Free every entry and stop watching the tree.
+ *  @param tree The walker state.
+ *  @return Void.
+ */
+void cgroup_tree_close(struct cgroup_tree *tree);
+
+#endif
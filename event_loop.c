@@ -0,0 +1,617 @@
+/** @file event_loop.c
+ *  @brief Multiplex the timers, the collectors, the signals and the keyboard
+ *
+ *  This file includes the functions of the event loop of the samples: one
+ *  epoll set watches a periodic timerfd (the samples start on its ticks,
+ *  which do not drift however long a sample takes), the pipes of the
+ *  collector children (each is read as soon as it writes, in any order),
+ *  the signalfd, stdin and the PSI triggers. Each collector runs under its
+ *  own deadline: one which has not closed its pipe by then is killed, and
+ *  its last good output is shown marked stale with its age, so a slow
+ *  source never blocks the others. A collector which keeps a state between
+ *  the samples (e.g. a cache) runs in a worker instead, a child which
+ *  stays between the runs and is sent the pipe of each run, so it is
+ *  timed out the same way. The latency and the timeouts of each
+ *  collector are counted.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "event_loop.h"
+
+/** @brief Add milliseconds to a time.
+ *  @param t The time.
+ *  @param ms The milliseconds to add.
+ *  @return The sum.
+ */
+static struct timespec timespec_add_ms(struct timespec t, long ms) {
+    t.tv_sec += ms / 1000;
+    t.tv_nsec += ms % 1000 * 1000000L;
+    if (t.tv_nsec >= 1000000000L) {
+        t.tv_sec ++;
+        t.tv_nsec -= 1000000000L;
+    }
+    return t;
+}
+
+/** @brief The difference between two times.
+ *  @param a The later time.
+ *  @param b The earlier time.
+ *  @return a - b, in milliseconds.
+ */
+static double timespec_ms(const struct timespec *a, const struct timespec *b) {
+    return (a->tv_sec - b->tv_sec) * 1e3 + (a->tv_nsec - b->tv_nsec) * 1e-6;
+}
+
+/** @brief Create the epoll set and start the tick timer, which fires now and every tdelay secs.
+ *  @param loop The loop to initialize.
+ *  @param tdelay Period of time the statistics refresh (in seconds).
+ *  @return Void.
+ */
+void event_init(struct event_loop *loop, int tdelay) {
+    struct itimerspec spec;
+
+    memset(loop, 0, sizeof(*loop));
+    if ((loop->epfd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    if ((loop->tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1 ||
+        (loop->deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        perror("timerfd_create");
+        exit(1);
+    }
+
+    // the first tick is now, the next ones are absolute: no drift
+    loop->period.tv_sec = tdelay;
+    clock_gettime(CLOCK_MONOTONIC, &loop->next_tick);
+    spec.it_value = loop->next_tick;
+    spec.it_interval = loop->period;
+    if (tdelay == 0) spec.it_interval.tv_nsec = loop->period.tv_nsec = 1000000L;  // 1 ms at least
+    if (timerfd_settime(loop->tick_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+    event_add(loop, loop->tick_fd, EPOLLIN, EVENT_TICK, 0);
+    event_add(loop, loop->deadline_fd, EPOLLIN, EVENT_DEADLINE, 0);
+}
+
+/** @brief Watch an fd.
+ *  @param loop The loop.
+ *  @param fd The fd.
+ *  @param events The epoll events, e.g. EPOLLIN.
+ *  @param kind The source (see enum event_kind).
+ *  @param index The collector or fd the event is for.
+ *  @return Void.
+ */
+void event_add(struct event_loop *loop, int fd, uint32_t events, int kind, int index) {
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.u64 = EVENT_DATA(kind, index);
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+/** @brief Stop watching an fd.
+ *  @param loop The loop.
+ *  @param fd The fd.
+ *  @return Void.
+ */
+void event_del(struct event_loop *loop, int fd) {
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+/** @brief Watch stdin (while an answer is awaited), or stop watching it.
+ *  @param loop The loop.
+ *  @param on 1 to watch stdin, 0 otherwise.
+ *  @return Void.
+ */
+void event_watch_stdin(struct event_loop *loop, int on) {
+    struct epoll_event event;
+
+    if (on == loop->stdin_watched) return;
+    event.events = EPOLLIN;
+    event.data.u64 = EVENT_DATA(EVENT_STDIN, STDIN_FILENO);
+    // a regular file cannot be watched (EPERM), it is always readable
+    if (epoll_ctl(loop->epfd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, STDIN_FILENO, &event) == -1 &&
+        errno != EPERM) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    loop->stdin_watched = on;
+}
+
+/** @brief Wait for the next events.
+ *  @param loop The loop.
+ *  @param events Where to store the events (EVENT_MAX long).
+ *  @return The number of events, 0 if interrupted.
+ */
+int event_wait(struct event_loop *loop, struct epoll_event *events) {
+    int count;
+
+    if ((count = epoll_wait(loop->epfd, events, EVENT_MAX, -1)) == -1) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait");
+        exit(1);
+    }
+    return count;
+}
+
+/** @brief Read the tick timer, and move next_tick past the ticks fired.
+ *
+ *  When the timer fired more than once since it was read, the samples
+ *  are late (e.g. a collector missed its deadline): the ticks in between
+ *  are counted as missed instead of being sampled one after another.
+ *
+ *  @param loop The loop.
+ *  @return The number of ticks fired.
+ */
+unsigned long event_tick(struct event_loop *loop) {
+    uint64_t fired;
+
+    if (read(loop->tick_fd, &fired, sizeof(fired)) != sizeof(fired)) {
+        return 0;  // EAGAIN: read already
+    }
+    for (uint64_t j = 0; j < fired; j ++) {
+        loop->next_tick.tv_sec += loop->period.tv_sec;
+        loop->next_tick = timespec_add_ms(loop->next_tick, loop->period.tv_nsec / 1000000L);
+    }
+    loop->ticks += fired;
+    loop->missed += fired - 1;
+    // a late sample starts at once, the ones in between are skipped
+    loop->missed += loop->pending;
+    loop->pending = 1;
+    return fired;
+}
+
+/** @brief Arm the deadline timer.
+ *  @param loop The loop.
+ *  @param at When it fires (CLOCK_MONOTONIC), NULL to disarm it.
+ *  @return Void.
+ */
+void event_deadline(struct event_loop *loop, const struct timespec *at) {
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    if (at != NULL) spec.it_value = *at;
+    if (timerfd_settime(loop->deadline_fd, TFD_TIMER_ABSTIME, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        exit(1);
+    }
+}
+
+/** @brief Read the deadline timer.
+ *  @param loop The loop.
+ *  @return 1 if the deadline has passed, 0 otherwise.
+ */
+int event_expired(struct event_loop *loop) {
+    uint64_t fired;
+
+    return read(loop->deadline_fd, &fired, sizeof(fired)) == sizeof(fired);
+}
+
+/** @brief Close the timers and the epoll set.
+ *  @param loop The loop.
+ *  @return Void.
+ */
+void event_close(struct event_loop *loop) {
+    close(loop->tick_fd);
+    close(loop->deadline_fd);
+    close(loop->epfd);
+}
+
+/** @brief Initialize a collector, not running.
+ *  @param coll The collector.
+ *  @param name The name of the collector.
+ *  @return Void.
+ */
+void collector_init(struct collector *coll, const char *name) {
+    memset(coll, 0, sizeof(*coll));
+    coll->name = name;
+    coll->pid = -1;
+    coll->fd = -1;
+    coll->worker = -1;
+    coll->sock = -1;
+    coll->size = coll->last_size = COLLECTOR_BUF;
+    if ((coll->buf = malloc(coll->size)) == NULL || (coll->last = malloc(coll->last_size)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/** @brief Watch the pipe of a collector child which was just forked.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @param index The index of the collector, reported with its events.
+ *  @param pid The child.
+ *  @param fd The reading end of its pipe.
+ *  @param due When its output is expected, its latency is counted from then.
+ *  @param timeout_ms How long after due the child is killed.
+ *  @return Void.
+ */
+void collector_start(struct event_loop *loop, struct collector *coll, int index, pid_t pid, int fd,
+    const struct timespec *due, long timeout_ms) {
+    // the pipe is read as the child writes, never waiting for the rest
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        exit(1);
+    }
+    coll->pid = pid;
+    coll->fd = fd;
+    coll->len = 0;
+    coll->done = coll->stale = 0;
+    coll->due = *due;
+    coll->deadline = timespec_add_ms(*due, timeout_ms);
+    coll->runs ++;
+    event_add(loop, fd, EPOLLIN, EVENT_COLLECTOR, index);
+}
+
+/** @brief Fork the worker of a collector.
+ *
+ *  The worker waits for its runs with worker_next, so the state it keeps
+ *  (e.g. a cache) lives out of the parent, and its slow reads can be timed
+ *  out like any child: a worker killed at a deadline is forked again at
+ *  the next run. It dies with the parent.
+ *
+ *  @param coll The collector.
+ *  @return 0 in the worker, the pid of the worker in the parent.
+ */
+pid_t worker_fork(struct collector *coll) {
+    int sv[2];
+    pid_t pid;
+
+    // a datagram per run, each carrying the writing end of the pipe of the run
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+        perror("socketpair");
+        exit(1);
+    }
+    if ((pid = fork()) == -1) {
+        perror("fork");
+        exit(1);
+    } else if (pid == 0) {
+        close(sv[0]);
+        coll->sock = sv[1];
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        return 0;
+    }
+    close(sv[1]);
+    coll->sock = sv[0];
+    coll->worker = pid;
+    return pid;
+}
+
+/** @brief Wait for the next run, in the worker, and make its pipe the standard output.
+ *  @param coll The collector of the worker.
+ *  @return 1 when a run is asked, 0 when the parent is gone.
+ */
+int worker_next(struct collector *coll) {
+    char byte, control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fd;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(coll->sock, &msg, 0) <= 0 ||
+        (cmsg = CMSG_FIRSTHDR(&msg)) == NULL || cmsg->cmsg_type != SCM_RIGHTS) {
+        return 0;  // end of file: the parent has closed its end
+    }
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    if (fd == STDOUT_FILENO) {
+        return 1;  // the lowest fd, free since the previous run
+    }
+    if (dup2(fd, STDOUT_FILENO) == -1) {
+        perror("dup2");
+        exit(1);
+    }
+    close(fd);
+    return 1;
+}
+
+/** @brief End a run, in the worker: flush and close the pipe, the parent reads the end of file.
+ *  @return Void.
+ */
+void worker_done(void) {
+    fflush(stdout);
+    close(STDOUT_FILENO);
+}
+
+/** @brief Kill the worker of a collector and close its socket.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+static void worker_stop(struct collector *coll) {
+    if (coll->worker == -1) return;
+    kill(coll->worker, SIGKILL);  // reaped by the kernel, SIGCHLD is ignored
+    close(coll->sock);
+    coll->worker = -1;
+    coll->sock = -1;
+}
+
+/** @brief Ask the worker of a collector for a run, and watch the pipe of the run.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @param index The index of the collector, reported with its events.
+ *  @param due When its output is expected (now), its latency is counted from then.
+ *  @param timeout_ms How long after due the worker is killed.
+ *  @return 1 if the run started, 0 if there is no worker (or it died).
+ */
+int collector_request(struct event_loop *loop, struct collector *coll, int index,
+    const struct timespec *due, long timeout_ms) {
+    char byte = 0, control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = { &byte, 1 };
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    int fd[2];
+
+    coll->done = 0;  // no output for this sample until the run is done
+    if (coll->worker == -1) return 0;
+    if (pipe(fd) == -1) {
+        perror("pipe");
+        exit(1);
+    }
+    memset(&msg, 0, sizeof(msg));
+    memset(control, 0, sizeof(control));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd[1], sizeof(int));
+
+    // the worker waits for this datagram, the socket is never full
+    if (sendmsg(coll->sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) == -1) {
+        close(fd[0]);
+        close(fd[1]);
+        worker_stop(coll);  // it died (EPIPE): forked again by the caller
+        return 0;
+    }
+    close(fd[1]);  // only the worker writes, its close is the end of the run
+    collector_start(loop, coll, index, coll->worker, fd[0], due, timeout_ms);
+    return 1;
+}
+
+/** @brief Arm the deadline timer at the first deadline of the running collectors.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return Void.
+ */
+void collector_arm(struct event_loop *loop, struct collector *coll, int count) {
+    const struct timespec *first = NULL;
+
+    for (int j = 0; j < count; j ++) {
+        if (coll[j].fd != -1 && (first == NULL || timespec_ms(&coll[j].deadline, first) < 0)) {
+            first = &coll[j].deadline;
+        }
+    }
+    event_deadline(loop, first);  // disarmed when none is running
+}
+
+/** @brief Kill the children past their deadline, and mark their collectors stale.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return The number of children killed.
+ */
+int collector_timeouts(struct event_loop *loop, struct collector *coll, int count) {
+    struct timespec now;
+    int killed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (int j = 0; j < count; j ++) {
+        if (coll[j].fd != -1 && timespec_ms(&now, &coll[j].deadline) >= 0) {
+            collector_expire(loop, &coll[j]);
+            coll[j].timeouts ++;
+            killed ++;
+        }
+    }
+    return killed;
+}
+
+/** @brief Count a run which was done in time.
+ *  @param coll The collector.
+ *  @param start When its output was due.
+ *  @return Void.
+ */
+static void collector_done(struct collector *coll, const struct timespec *start) {
+    clock_gettime(CLOCK_MONOTONIC, &coll->finished);
+    coll->latency = timespec_ms(&coll->finished, start);
+    if (coll->latency < 0) coll->latency = 0;  // e.g. the CPU child wrote just before the tick
+    if (coll->latency > coll->max_latency) coll->max_latency = coll->latency;
+    coll->total_latency += coll->latency;
+    coll->good = 1;
+}
+
+/** @brief Count a run of a collector of the parent, which cannot be timed out.
+ *  @param coll The collector.
+ *  @param start When the run started.
+ *  @return Void.
+ */
+void collector_note(struct collector *coll, const struct timespec *start) {
+    coll->runs ++;
+    coll->done = 1;
+    collector_done(coll, start);
+}
+
+/** @brief The age of the last good output of a collector.
+ *  @param coll The collector.
+ *  @return The seconds since it was read.
+ */
+double collector_age(const struct collector *coll) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return timespec_ms(&now, &coll->finished) * 1e-3;
+}
+
+/** @brief Stop watching the pipe of a collector, and close it.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+static void collector_stop(struct event_loop *loop, struct collector *coll) {
+    event_del(loop, coll->fd);
+    close(coll->fd);
+    coll->fd = -1;
+    coll->pid = -1;
+}
+
+/** @brief Read what the child wrote, without blocking.
+ *  @param loop The loop.
+ *  @param coll The collector, whose pipe is readable.
+ *  @return 1 if the child has closed its pipe (the collector is done), 0 otherwise.
+ */
+int collector_read(struct event_loop *loop, struct collector *coll) {
+    ssize_t len;
+
+    if (coll->fd == -1) return coll->done;
+    for (;;) {
+        if (coll->size - coll->len < COLLECTOR_BUF / 2) {
+            // e.g. many sessions: double the buffer
+            coll->size *= 2;
+            if ((coll->buf = realloc(coll->buf, coll->size)) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        // keep a byte for the terminating null byte
+        if ((len = read(coll->fd, coll->buf + coll->len, coll->size - coll->len - 1)) > 0) {
+            coll->len += len;
+        } else if (len == 0) {
+            break;  // the child has written everything
+        } else if (errno == EAGAIN) {
+            return 0;
+        } else if (errno != EINTR) {
+            perror("read");
+            exit(1);
+        }
+    }
+    coll->buf[coll->len] = '\0';
+    coll->done = 1;
+    collector_stop(loop, coll);
+    collector_done(coll, &coll->due);
+
+    // keep this output as the last good one, the other buffer is reused
+    char *buf = coll->last;
+    size_t size = coll->last_size;
+    coll->last = coll->buf;
+    coll->last_size = coll->size;
+    coll->last_len = coll->len;
+    coll->buf = buf;
+    coll->size = size;
+    return 1;
+}
+
+/** @brief Kill a child (or worker) still running, and mark its collector stale.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+void collector_expire(struct event_loop *loop, struct collector *coll) {
+    if (coll->fd == -1) return;
+    kill(coll->pid, SIGKILL);  // reaped by the kernel, SIGCHLD is ignored
+    coll->stale = 1;
+    collector_stop(loop, coll);
+    worker_stop(coll);         // its state is lost, a new one is forked at the next run
+}
+
+/** @brief Kill the child if it is still running (and the worker), and free the buffer.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+void collector_close(struct event_loop *loop, struct collector *coll) {
+    collector_expire(loop, coll);
+    worker_stop(coll);
+    free(coll->buf);
+    free(coll->last);
+}
+
+/** @brief Prints that a collector missed its deadline, in place of its section.
+ *  @param coll The collector.
+ *  @return The number of lines printed.
+ */
+int show_collector_stale(const struct collector *coll) {
+    if (coll->good) {
+        printf(" [stale %.0fs] the %s collector missed its deadline, its last value is shown\n",
+            collector_age(coll), coll->name);
+    } else {
+        printf(" [stale] the %s collector missed its deadline, no value yet\n", coll->name);
+    }
+    return 1;
+}
+
+/** @brief Prints a part of the last good output of a collector, after a stale note if this run is not done.
+ *
+ *  The output of a worker may hold the sections of several collectors
+ *  sharing a state, printed at different places: they are separated by
+ *  a line holding a form feed.
+ *
+ *  @param coll The collector.
+ *  @param part The index of the part (0 for the first one).
+ *  @return The number of lines printed.
+ */
+int show_collector_part(const struct collector *coll, int part) {
+    const char *line = coll->last;
+    int lines = 0;
+
+    if (!coll->done) {
+        lines += show_collector_stale(coll);
+    }
+    if (!coll->good) {
+        return lines;
+    }
+    for (int k = 0; k < part && line != NULL; k ++) {
+        if ((line = strstr(line, "\f\n")) != NULL) line += 2;  // the next part
+    }
+    while (line != NULL && *line != '\0' && *line != '\f') {
+        size_t len = strcspn(line, "\n");
+        printf("%.*s\n", (int) len, line);
+        line += len + (line[len] == '\n');
+        lines ++;
+    }
+    return lines;
+}
+
+/** @brief Prints the collectors section: runs, timeouts and latencies.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return The number of lines printed.
+ */
+int show_collectors(struct event_loop *loop, struct collector *coll, int count) {
+    int lines = 3;
+
+    printf("### Collectors ### (latency past due: last / avg / max)\n");
+    for (int j = 0; j < count; j ++) {
+        unsigned long good = coll[j].runs - coll[j].timeouts - (coll[j].fd != -1);
+        if (coll[j].runs == 0) continue;  // e.g. no memory child with "--user"
+        printf(" %-8s runs %6lu  timeouts %4lu  latency %7.1f / %7.1f / %7.1f ms", coll[j].name,
+            coll[j].runs, coll[j].timeouts, coll[j].latency,
+            good > 0 ? coll[j].total_latency / good : 0.0, coll[j].max_latency);
+        if (coll[j].stale && coll[j].good) {
+            printf("  [stale %.0fs]", collector_age(&coll[j]));
+        } else if (coll[j].stale) {
+            printf("  [stale, no value yet]");
+        }
+        printf("\n");
+        lines ++;
+    }
+    printf(" ticks %lu  missed %lu\n", loop->ticks, loop->missed);
+    printf("---------------------------------------\n");
+    return lines;
+}
@@ -0,0 +1,283 @@
+/*
+ * Header file for the event loop of the samples (epoll, timerfd and the collector pipes)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+
+#ifndef __Event_loop_header
+#define __Event_loop_header
+
+#define EVENT_MAX 16             // the events handled per epoll_wait()
+#define COLLECTOR_TIMEOUT_MS 500 // how long a collector may run past its due time (default)
+#define COLLECTOR_BUF 4096       // the initial size of a collector buffer
+
+// an event carries its source and an index (a collector, or an fd) in data.u64
+#define EVENT_DATA(kind, index) (((uint64_t) (kind) << 32) | (uint32_t) (index))
+#define EVENT_KIND(data) ((int) ((data) >> 32))
+#define EVENT_INDEX(data) ((int) (uint32_t) (data))
+
+/** @brief The sources of the event loop. */
+enum event_kind {
+    EVENT_TICK,         // the periodic timer of the samples
+    EVENT_DEADLINE,     // the timer of the collectors still running
+    EVENT_SIGNAL,       // the signalfd (see service.c)
+    EVENT_STDIN,        // the answer to the quit question
+    EVENT_COLLECTOR,    // the pipe of a collector child
+    EVENT_PSI           // a PSI trigger (see pressure_stats.c)
+};
+
+/** @brief An epoll set, with the timers of the samples. */
+struct event_loop {
+    int epfd;                    // the epoll fd
+    int tick_fd;                 // timerfd firing every tdelay secs
+    int deadline_fd;             // one-shot timerfd of the collectors
+    struct timespec period;      // tdelay
+    struct timespec next_tick;   // when the timer fires next, the end of the current sample
+    unsigned long pending;       // the ticks fired and not waited for yet
+    unsigned long ticks;         // the ticks fired
+    unsigned long missed;        // the ticks fired while a sample was late
+    int stdin_watched;           // 1 while stdin is in the set
+};
+
+/** @brief A child writing its section to a pipe, read without blocking.
+ *
+ *  The output of the last run done in time is kept, so a run which misses
+ *  its deadline shows the last good value, marked stale with its age.
+ *  A run is either a child forked for it, or a run of a worker: a child
+ *  which keeps the state of its collector between the runs, and gets the
+ *  pipe of each run on its socket (see worker_fork).
+ */
+struct collector {
+    const char *name;            // e.g. "memory"
+    pid_t pid;                   // the child, -1 when not running
+    int fd;                      // the reading end of its pipe, -1 when not running
+    pid_t worker;                // the worker doing the runs, -1 if none (or a child per run)
+    int sock;                    // the socket the runs are asked on, -1 if no worker
+    char *buf;                   // what the running child wrote so far
+    size_t len, size;
+    char *last;                  // the output of the last run done in time
+    size_t last_len, last_size;
+    int good;                    // 1 once a run was done in time (last is valid)
+    int done;                    // the child of this run closed the pipe in time
+    int stale;                   // the child of this run missed the deadline and was killed
+    struct timespec due;         // when the output is expected (the fork, or the tick)
+    struct timespec deadline;    // due + the timeout, the child is killed after it
+    struct timespec finished;    // when the last good output was read
+    unsigned long runs;          // the runs started
+    unsigned long timeouts;      // the runs killed at the deadline
+    double latency;              // the time past due of the last good run (ms)
+    double max_latency, total_latency;
+};
+
+/** @brief Create the epoll set and start the tick timer, which fires now and every tdelay secs.
+ *  @param loop The loop to initialize.
+ *  @param tdelay Period of time the statistics refresh (in seconds).
+ *  @return Void.
+ */
+void event_init(struct event_loop *loop, int tdelay);
+
+/** @brief Watch an fd.
+ *  @param loop The loop.
+ *  @param fd The fd.
+ *  @param events The epoll events, e.g. EPOLLIN.
+ *  @param kind The source (see enum event_kind).
+ *  @param index The collector or fd the event is for.
+ *  @return Void.
+ */
+void event_add(struct event_loop *loop, int fd, uint32_t events, int kind, int index);
+
+/** @brief Stop watching an fd.
+ *  @param loop The loop.
+ *  @param fd The fd.
+ *  @return Void.
+ */
+void event_del(struct event_loop *loop, int fd);
+
+/** @brief Watch stdin (while an answer is awaited), or stop watching it.
+ *  @param loop The loop.
+ *  @param on 1 to watch stdin, 0 otherwise.
+ *  @return Void.
+ */
+void event_watch_stdin(struct event_loop *loop, int on);
+
+/** @brief Wait for the next events.
+ *  @param loop The loop.
+ *  @param events Where to store the events (EVENT_MAX long).
+ *  @return The number of events, 0 if interrupted.
+ */
+int event_wait(struct event_loop *loop, struct epoll_event *events);
+
+/** @brief Read the tick timer, and move next_tick past the ticks fired.
+ *
+ *  When the timer fired more than once since it was read, the samples
+ *  are late (e.g. a collector missed its deadline): the ticks in between
+ *  are counted as missed instead of being sampled one after another.
+ *
+ *  @param loop The loop.
+ *  @return The number of ticks fired.
+ */
+unsigned long event_tick(struct event_loop *loop);
+
+/** @brief Arm the deadline timer.
+ *  @param loop The loop.
+ *  @param at When it fires (CLOCK_MONOTONIC), NULL to disarm it.
+ *  @return Void.
+ */
+void event_deadline(struct event_loop *loop, const struct timespec *at);
+
+/** @brief Read the deadline timer.
+ *  @param loop The loop.
+ *  @return 1 if the deadline has passed, 0 otherwise.
+ */
+int event_expired(struct event_loop *loop);
+
+/** @brief Close the timers and the epoll set.
+ *  @param loop The loop.
+ *  @return Void.
+ */
+void event_close(struct event_loop *loop);
+
+/** @brief Initialize a collector, not running.
+ *  @param coll The collector.
+ *  @param name The name of the collector.
+ *  @return Void.
+ */
+void collector_init(struct collector *coll, const char *name);
+
+/** @brief Watch the pipe of a collector child which was just forked.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @param index The index of the collector, reported with its events.
+ *  @param pid The child.
+ *  @param fd The reading end of its pipe.
+ *  @param due When its output is expected, its latency is counted from then.
+ *  @param timeout_ms How long after due the child is killed.
+ *  @return Void.
+ */
+void collector_start(struct event_loop *loop, struct collector *coll, int index, pid_t pid, int fd,
+    const struct timespec *due, long timeout_ms);
+
+/** @brief Fork the worker of a collector.
+ *
+ *  The worker waits for its runs with worker_next, so the state it keeps
+ *  (e.g. a cache) lives out of the parent, and its slow reads can be timed
+ *  out like any child: a worker killed at a deadline is forked again at
+ *  the next run. It dies with the parent.
+ *
+ *  @param coll The collector.
+ *  @return 0 in the worker, the pid of the worker in the parent.
+ */
+pid_t worker_fork(struct collector *coll);
+
+/** @brief Wait for the next run, in the worker, and make its pipe the standard output.
+ *  @param coll The collector of the worker.
+ *  @return 1 when a run is asked, 0 when the parent is gone.
+ */
+int worker_next(struct collector *coll);
+
+/** @brief End a run, in the worker: flush and close the pipe, the parent reads the end of file.
+ *  @return Void.
+ */
+void worker_done(void);
+
+/** @brief Ask the worker of a collector for a run, and watch the pipe of the run.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @param index The index of the collector, reported with its events.
+ *  @param due When its output is expected (now), its latency is counted from then.
+ *  @param timeout_ms How long after due the worker is killed.
+ *  @return 1 if the run started, 0 if there is no worker (or it died).
+ */
+int collector_request(struct event_loop *loop, struct collector *coll, int index,
+    const struct timespec *due, long timeout_ms);
+
+/** @brief Arm the deadline timer at the first deadline of the running collectors.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return Void.
+ */
+void collector_arm(struct event_loop *loop, struct collector *coll, int count);
+
+/** @brief Kill the children past their deadline, and mark their collectors stale.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return The number of children killed.
+ */
+int collector_timeouts(struct event_loop *loop, struct collector *coll, int count);
+
+/** @brief Count a run of a collector of the parent, which cannot be timed out.
+ *  @param coll The collector.
+ *  @param start When the run started.
+ *  @return Void.
+ */
+void collector_note(struct collector *coll, const struct timespec *start);
+
+/** @brief The age of the last good output of a collector.
+ *  @param coll The collector.
+ *  @return The seconds since it was read.
+ */
+double collector_age(const struct collector *coll);
+
+/** @brief Prints that a collector missed its deadline, in place of its section.
+ *  @param coll The collector.
+ *  @return The number of lines printed.
+ */
+int show_collector_stale(const struct collector *coll);
+
+/** @brief Prints a part of the last good output of a collector, after a stale note if this run is not done.
+ *
+ *  The output of a worker may hold the sections of several collectors
+ *  sharing a state, printed at different places: they are separated by
+ *  a line holding a form feed.
+ *
+ *  @param coll The collector.
+ *  @param part The index of the part (0 for the first one).
+ *  @return The number of lines printed.
+ */
+int show_collector_part(const struct collector *coll, int part);
+
+/** @brief Prints the collectors section: runs, timeouts and latencies.
+ *  @param loop The loop.
+ *  @param coll The collectors.
+ *  @param count The number of collectors.
+ *  @return The number of lines printed.
+ */
+int show_collectors(struct event_loop *loop, struct collector *coll, int count);
+
+/** @brief Read what the child wrote, without blocking.
+ *  @param loop The loop.
+ *  @param coll The collector, whose pipe is readable.
+ *  @return 1 if the child has closed its pipe (the collector is done), 0 otherwise.
+ */
+int collector_read(struct event_loop *loop, struct collector *coll);
+
+/** @brief Kill a child (or worker) still running, and mark its collector stale.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+void collector_expire(struct event_loop *loop, struct collector *coll);
+
+/** @brief Kill the child if it is still running (and the worker), and free the buffer.
+ *  @param loop The loop.
+ *  @param coll The collector.
+ *  @return Void.
+ */
+void collector_close(struct event_loop *loop, struct collector *coll);
+
+#endif
@@ -0,0 +1,337 @@
+/** @file freq_stats.c
+ *  @brief Report the effective frequency and temperature of the cores
+ *
+ *  This file includes the functions that read the current frequency of
+ *  each core (cpufreq), its thermal throttle count, and the temperature
+ *  of the thermal zones, so that a throttled core is visible even when
+ *  its utilization looks fine. Each file is opened once and re-read with
+ *  pread(), so 128 cores x 2 files per sample cost only 256 syscalls.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "freq_stats.h"
+
+#define FREQ_CPU_DIR "/sys/devices/system/cpu"
+#define THERMAL_DIR "/sys/class/thermal"
+
+/** @brief Read a number from a small sysfs file.
+ *  @param fd An fd of the file.
+ *  @return The number, or -1 on failure (e.g. the CPU is offline).
+ */
+static long long read_number(int fd) {
+    char buf[32];
+    ssize_t len;
+
+    if (fd == -1 || (len = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+        return -1;
+    }
+    buf[len] = '\0';
+    return strtoll(buf, NULL, 10);
+}
+
+/** @brief Read a number from a sysfs file opened once.
+ *  @param path The path of the file.
+ *  @return The number, or -1 on failure.
+ */
+static long long read_number_at(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    long long value = read_number(fd);
+
+    if (fd != -1) close(fd);
+    return value;
+}
+
+/** @brief Open the "Core N" sensors of every coretemp hwmon device.
+ *
+ *  A coretemp device covers one package: its "Package id P" sensor gives
+ *  P, and each "Core N" sensor the temperature of the core with core_id N.
+ *
+ *  @param freq The collector state.
+ *  @return Void.
+ */
+static void coretemp_init(struct freq_stats *freq) {
+    char path[PATH_MAX], label[32], suffix[16];
+    struct dirent *dirent, *file;
+    DIR *stream, *sensors;
+    int hwmon, capacity = 0;
+
+    if ((stream = opendir(HWMON_DIR)) == NULL) {
+        return;
+    }
+    while ((dirent = readdir(stream)) != NULL) {
+        if (sscanf(dirent->d_name, "hwmon%d", &hwmon) != 1) continue;
+        snprintf(path, sizeof(path), HWMON_DIR "/hwmon%d/name", hwmon);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        ssize_t len = fd != -1 ? pread(fd, label, sizeof(label) - 1, 0) : -1;
+        if (fd != -1) close(fd);
+        if (len <= 0 || strncmp(label, "coretemp\n", 9) != 0) continue;
+
+        // Each sensor K has a "tempK_label" and a "tempK_input" (K may skip numbers)
+        int package = -1, first = freq->sensors, core, k;
+        snprintf(path, sizeof(path), HWMON_DIR "/hwmon%d", hwmon);
+        sensors = opendir(path);
+        while (sensors != NULL && (file = readdir(sensors)) != NULL) {
+            if (sscanf(file->d_name, "temp%d_%15s", &k, suffix) != 2 || strcmp(suffix, "label") != 0) continue;
+            snprintf(path, sizeof(path), HWMON_DIR "/hwmon%d/temp%d_label", hwmon, k);
+            if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) continue;
+            len = pread(fd, label, sizeof(label) - 1, 0);
+            close(fd);
+            if (len <= 0) continue;
+            label[len] = '\0';
+            if (sscanf(label, "Package id %d", &package) == 1 ||
+                sscanf(label, "Core %d", &core) != 1) continue;
+
+            if (freq->sensors == capacity &&
+                (freq->sensor = realloc(freq->sensor,
+                    (capacity = capacity ? 2 * capacity : 64) * sizeof(struct core_sensor))) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+            snprintf(path, sizeof(path), HWMON_DIR "/hwmon%d/temp%d_input", hwmon, k);
+            if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) continue;
+            freq->sensor[freq->sensors].core = core;
+            freq->sensor[freq->sensors].fd = fd;
+            freq->sensor[freq->sensors ++].temp = 0.0;
+        }
+        if (sensors != NULL) closedir(sensors);
+        for (int i = first; i < freq->sensors; i ++) {
+            freq->sensor[i].package = package;
+        }
+    }
+    closedir(stream);
+}
+
+/** @brief Find the coretemp sensor of a CPU.
+ *  @param freq The collector state.
+ *  @param id The CPU number.
+ *  @return The index of the sensor, or -1 if none.
+ */
+static int coretemp_find(struct freq_stats *freq, int id) {
+    char path[PATH_MAX];
+    long long package, core;
+
+    snprintf(path, sizeof(path), FREQ_CPU_DIR "/cpu%d/topology/physical_package_id", id);
+    package = read_number_at(path);
+    snprintf(path, sizeof(path), FREQ_CPU_DIR "/cpu%d/topology/core_id", id);
+    core = read_number_at(path);
+    for (int i = 0; i < freq->sensors; i ++) {
+        if (freq->sensor[i].package == package && freq->sensor[i].core == core) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/** @brief Compare two cores by the ratio of their frequency to the maximum, for qsort().
+ *  @param a The first core.
+ *  @param b The second core.
+ *  @return A negative, zero or positive integer.
+ */
+static int freq_compare(const void *a, const void *b) {
+    const struct freq_cpu *x = *(struct freq_cpu * const *) a;
+    const struct freq_cpu *y = *(struct freq_cpu * const *) b;
+    double rx = x->max_khz > 0 ? (double) x->cur_khz / x->max_khz : 1.0;
+    double ry = y->max_khz > 0 ? (double) y->cur_khz / y->max_khz : 1.0;
+
+    if (rx != ry) return rx < ry ? -1 : 1;
+    return x->id - y->id;
+}
+
+/** @brief Find the cores and thermal zones and take the first sample.
+ *
+ *  List "/sys/devices/system/cpu/cpu*" and "/sys/class/thermal/thermal_zone*",
+ *  and open the files of each of them once for the whole run. The per core
+ *  temperature comes from the "coretemp" hwmon driver ("Core N" sensors,
+ *  matched to each CPU by its package and core id): other drivers (e.g.
+ *  AMD k10temp) only have a package temperature, shown by the zones.
+ *
+ *  @param freq The collector state to initialize.
+ *  @return Void.
+ */
+void freq_init(struct freq_stats *freq) {
+    char path[PATH_MAX];
+    struct dirent *dirent;
+    DIR *stream;
+    int id, capacity = 64;
+
+    memset(freq, 0, sizeof(*freq));
+    coretemp_init(freq);
+    if ((freq->cpu = malloc(capacity * sizeof(struct freq_cpu))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    if ((stream = opendir(FREQ_CPU_DIR)) != NULL) {
+        while ((dirent = readdir(stream)) != NULL) {
+            if (sscanf(dirent->d_name, "cpu%d", &id) != 1) continue;
+            if (freq->count == capacity &&
+                (freq->cpu = realloc(freq->cpu, (capacity *= 2) * sizeof(struct freq_cpu))) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+
+            struct freq_cpu *cpu = &freq->cpu[freq->count ++];
+            memset(cpu, 0, sizeof(*cpu));
+            cpu->id = id;
+            cpu->sensor = coretemp_find(freq, id);
+            snprintf(path, sizeof(path), FREQ_CPU_DIR "/cpu%d/cpufreq/scaling_cur_freq", id);
+            cpu->freq_fd = open(path, O_RDONLY | O_CLOEXEC);
+            snprintf(path, sizeof(path), FREQ_CPU_DIR "/cpu%d/thermal_throttle/core_throttle_count", id);
+            cpu->throttle_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+            // The maximum does not change, read it once
+            snprintf(path, sizeof(path), FREQ_CPU_DIR "/cpu%d/cpufreq/cpuinfo_max_freq", id);
+            cpu->max_khz = read_number_at(path);
+        }
+        closedir(stream);
+    }
+    if ((freq->order = malloc((freq->count + 1) * sizeof(struct freq_cpu *))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+
+    if ((stream = opendir(THERMAL_DIR)) != NULL) {
+        while ((dirent = readdir(stream)) != NULL && freq->zones < THERMAL_MAX_ZONES) {
+            if (sscanf(dirent->d_name, "thermal_zone%d", &id) != 1) continue;
+
+            struct thermal_zone *zone = &freq->zone[freq->zones];
+            snprintf(path, sizeof(path), THERMAL_DIR "/thermal_zone%d/temp", id);
+            if ((zone->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) continue;
+
+            // The type names the sensor (e.g. "x86_pkg_temp"), read it once
+            snprintf(path, sizeof(path), THERMAL_DIR "/thermal_zone%d/type", id);
+            snprintf(zone->type, sizeof(zone->type), "zone%d", id);
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            ssize_t len = fd != -1 ? pread(fd, zone->type, sizeof(zone->type) - 1, 0) : -1;
+            if (len > 0) {
+                zone->type[len] = '\0';
+                zone->type[strcspn(zone->type, "\n")] = '\0';
+            }
+            if (fd != -1) close(fd);
+            freq->zones ++;
+        }
+        closedir(stream);
+    }
+    freq_sample(freq);
+}
+
+/** @brief Re-read the frequency, throttle count and temperature files with pread().
+ *
+ *  rate (per sec) = (throttle_curr - throttle_prev) / interval
+ *
+ *  The rate of a core is only taken once a previous count was read, so
+ *  the first throttling of a core whose count started at 0 is reported.
+ *
+ *  @param freq The collector state.
+ *  @return Void.
+ */
+void freq_sample(struct freq_stats *freq) {
+    double interval = time_since(&freq->last);
+    long long value;
+
+    for (int i = 0; i < freq->count; i ++) {
+        struct freq_cpu *cpu = &freq->cpu[i];
+        cpu->cur_khz = (value = read_number(cpu->freq_fd)) > 0 ? value : 0;
+        if ((value = read_number(cpu->throttle_fd)) >= 0) {
+            cpu->throttle = value;
+            cpu->throttle_rate = interval > 0 && cpu->throttle_seen && cpu->throttle >= cpu->throttle_prev ?
+                (cpu->throttle - cpu->throttle_prev) / interval : 0.0;
+            cpu->throttle_prev = cpu->throttle;
+            cpu->throttle_seen = 1;
+        }
+    }
+    for (int i = 0; i < freq->sensors; i ++) {
+        // in millidegree Celsius
+        freq->sensor[i].temp = (value = read_number(freq->sensor[i].fd)) != -1 ? value * 1e-3 : 0.0;
+    }
+    for (int i = 0; i < freq->zones; i ++) {
+        // in millidegree Celsius
+        freq->zone[i].temp = (value = read_number(freq->zone[i].fd)) != -1 ? value * 1e-3 : 0.0;
+    }
+}
+
+/** @brief Prints the frequency and thermal section.
+ *
+ *  Print the average frequency, then the slowest cores with their
+ *  utilization (if the scheduler collector is sampled), and the zones.
+ *
+ *  @param freq The collector state.
+ *  @param sched The scheduler collector giving the per core utilization.
+ *  @return The number of lines printed.
+ */
+int show_freq_info(struct freq_stats *freq, struct sched_stats *sched) {
+    double sum = 0, throttle = 0;
+    long min = 0;
+    int count = 0, throttled = 0, lines = 0;
+
+    for (int i = 0; i < freq->count; i ++) {
+        struct freq_cpu *cpu = &freq->cpu[i];
+        throttle += cpu->throttle_rate;
+        throttled += cpu->throttle_rate > 0;
+        if (cpu->cur_khz == 0) continue;   // no cpufreq, or offline
+        sum += cpu->cur_khz;
+        min = count == 0 || cpu->cur_khz < min ? cpu->cur_khz : min;
+        freq->order[count ++] = cpu;
+    }
+    qsort(freq->order, count, sizeof(struct freq_cpu *), freq_compare);
+
+    printf("### CPU frequency ### (per core: util, MHz, %% of max, temperature; thermal zones)\n");
+    lines ++;
+    if (count == 0) {
+        printf(" frequency n/a (no cpufreq driver)\n");
+        lines ++;
+    } else {
+        printf(" average %.0f MHz  slowest %ld MHz  throttled cores %d (%.0f events/s)\n",
+            sum / count * 1e-3, min / 1000, throttled, throttle);
+        lines ++;
+        for (int i = 0; i < count && i < FREQ_TOP; i ++) {
+            struct freq_cpu *cpu = freq->order[i];
+            printf(" cpu%-4d", cpu->id);
+            if (sched != NULL && cpu->id < sched->ncpu && sched->cpu[cpu->id].seen) {
+                printf(" util %6.2f%%", sched->cpu[cpu->id].util);
+            } else {
+                printf("%13s", "");   // keep the columns aligned
+            }
+            printf("  %5ld MHz", cpu->cur_khz / 1000);
+            if (cpu->max_khz > 0) printf("  %3.0f%% of max", 100.0 * cpu->cur_khz / cpu->max_khz);
+            if (cpu->sensor != -1) printf("  %.0fC", freq->sensor[cpu->sensor].temp);
+            if (cpu->throttle_rate > 0) printf("  throttled %.0f/s", cpu->throttle_rate);
+            printf("\n");
+            lines ++;
+        }
+    }
+
+    if (freq->zones == 0) {
+        printf(" temperature n/a (no thermal zones)\n");
+    } else {
+        printf(" ");
+        for (int i = 0; i < freq->zones; i ++) {
+            printf(" %s %.1fC", freq->zone[i].type, freq->zone[i].temp);
+        }
+        printf("\n");
+    }
+    printf("---------------------------------------\n");
+    return lines + 2;
+}
+
+/** @brief Close every file opened by the collector.
+ *  @param freq The collector state.
+ *  @return Void.
+ */
+void freq_close(struct freq_stats *freq) {
+    for (int i = 0; i < freq->count; i ++) {
+        if (freq->cpu[i].freq_fd != -1) close(freq->cpu[i].freq_fd);
+        if (freq->cpu[i].throttle_fd != -1) close(freq->cpu[i].throttle_fd);
+    }
+    for (int i = 0; i < freq->zones; i ++) {
+        close(freq->zone[i].fd);
+    }
+    for (int i = 0; i < freq->sensors; i ++) {
+        close(freq->sensor[i].fd);
+    }
+    free(freq->sensor);
+    free(freq->cpu);
+    free(freq->order);
+}
@@ -0,0 +1,104 @@
+/*
+ * Header file for the CPU frequency and thermal collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "sched_stats.h"
+
+#ifndef __Freq_header
+#define __Freq_header
+
+#define FREQ_TOP 8             // the number of cores listed, slowest first
+#define THERMAL_MAX_ZONES 32   // the maximum number of thermal zones reported
+#define HWMON_DIR "/sys/class/hwmon"
+
+/** @brief State of one core kept between two samples. */
+struct freq_cpu {
+    int id;                  // the CPU number
+    int freq_fd;             // fd of ".../cpufreq/scaling_cur_freq", -1 if unavailable
+    int throttle_fd;         // fd of ".../thermal_throttle/core_throttle_count", or -1
+    long max_khz;            // cpuinfo_max_freq, read once
+    long cur_khz;            // the current frequency, 0 if unknown
+    uint64_t throttle, throttle_prev;  // the times the core was throttled
+    int throttle_seen;       // whether throttle_prev was read (it may be 0)
+    double throttle_rate;    // throttle events per second
+    int sensor;              // index of its coretemp sensor in freq_stats.sensor, -1 if none
+};
+
+/** @brief A coretemp sensor of one physical core, shared by its hyper-threads. */
+struct core_sensor {
+    int package, core;       // "physical_package_id" and "core_id" of the core
+    int fd;                  // fd of ".../hwmonN/tempK_input"
+    double temp;             // the temperature (in degree Celsius)
+};
+
+/** @brief State of one thermal zone. */
+struct thermal_zone {
+    int fd;                  // fd of ".../thermal_zoneN/temp"
+    char type[32];           // e.g. "x86_pkg_temp"
+    double temp;             // the temperature (in degree Celsius)
+};
+
+/** @brief State of the frequency and thermal collector. */
+struct freq_stats {
+    int count;                  // the number of cores
+    struct freq_cpu *cpu;       // the cores, in the order of the directory (not by CPU number)
+    struct freq_cpu **order;    // the cores sorted for the report
+    int sensors;                // the number of coretemp sensors
+    struct core_sensor *sensor; // the per core temperatures (Intel coretemp only)
+    int zones;                  // the number of thermal zones
+    struct thermal_zone zone[THERMAL_MAX_ZONES];
+    struct timespec last;       // time of the previous sample
+};
+
+/** @brief Find the cores and thermal zones and take the first sample.
+ *
+ *  List "/sys/devices/system/cpu/cpu*" and "/sys/class/thermal/thermal_zone*",
+ *  and open the files of each of them once for the whole run. The per core
+ *  temperature comes from the "coretemp" hwmon driver ("Core N" sensors,
+ *  matched to each CPU by its package and core id): other drivers (e.g.
+ *  AMD k10temp) only have a package temperature, shown by the zones.
+ *
+ *  @param freq The collector state to initialize.
+ *  @return Void.
+ */
+void freq_init(struct freq_stats *freq);
+
+/** @brief Re-read the frequency, throttle count and temperature files with pread().
+ *
+ *  rate (per sec) = (throttle_curr - throttle_prev) / interval
+ *
+ *  The rate of a core is only taken once a previous count was read, so
+ *  the first throttling of a core whose count started at 0 is reported.
+ *
+ *  @param freq The collector state.
+ *  @return Void.
+ */
+void freq_sample(struct freq_stats *freq);
+
+/** @brief Prints the frequency and thermal section.
+ *
+ *  Print the average frequency, then the slowest cores with their
+ *  utilization (if the scheduler collector is sampled), and the zones.
+ *
+ *  @param freq The collector state.
+ *  @param sched The scheduler collector giving the per core utilization.
+ *  @return The number of lines printed.
+ */
+int show_freq_info(struct freq_stats *freq, struct sched_stats *sched);
+
+/** @brief Close every file opened by the collector.
+ *  @param freq The collector state.
+ *  @return Void.
+ */
+void freq_close(struct freq_stats *freq);
+
+#endif
@@ -0,0 +1,84 @@
+/** @file hdr_histogram.c
+ *  @brief Count the values of a metric in constant memory
+ *
+ *  This file includes the functions of a high dynamic range (HDR)
+ *  histogram: the bucket of a value is found with one count of the leading
+ *  zeros and a shift, so recording is O(1), and the percentiles of a whole
+ *  run are read from the counts, without keeping the values.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "hdr_histogram.h"
+
+/** @brief Find the counter of a value.
+ *
+ *  bucket = the position of the highest bit above the sub-bucket range
+ *  sub = value >> bucket, which is in [HDR_HALF, HDR_SUB_COUNT) for bucket > 0
+ *
+ *  @param value The value, below 2^HDR_MAX_BITS.
+ *  @return The index in counts.
+ */
+static inline int hdr_index(uint64_t value) {
+    int bucket = 63 - __builtin_clzll(value | (HDR_SUB_COUNT - 1)) - (HDR_SUB_BITS - 1);
+    int sub = (int) (value >> bucket);
+
+    return ((bucket + 1) << (HDR_SUB_BITS - 1)) + sub - HDR_HALF;
+}
+
+/** @brief Get the highest value counted by a counter.
+ *  @param index The index in counts.
+ *  @return The highest value of the counter.
+ */
+static uint64_t hdr_highest(int index) {
+    int bucket = (index >> (HDR_SUB_BITS - 1)) - 1;
+    uint64_t sub = (index & (HDR_HALF - 1)) + HDR_HALF;
+
+    if (bucket < 0) {  // the first HDR_SUB_COUNT values are exact
+        sub -= HDR_HALF;
+        bucket = 0;
+    }
+    return (sub << bucket) + ((uint64_t) 1 << bucket) - 1;
+}
+
+/** @brief Empty a histogram.
+ *  @param hist The histogram.
+ *  @return Void.
+ */
+void hdr_init(struct hdr_histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->min = UINT64_MAX;
+}
+
+/** @brief Count a value, in O(1).
+ *  @param hist The histogram.
+ *  @param value The value, clamped to 2^HDR_MAX_BITS - 1.
+ *  @return Void.
+ */
+void hdr_record(struct hdr_histogram *hist, uint64_t value) {
+    if (value >= (uint64_t) 1 << HDR_MAX_BITS) value = ((uint64_t) 1 << HDR_MAX_BITS) - 1;
+    hist->counts[hdr_index(value)] ++;
+    hist->total ++;
+    if (value < hist->min) hist->min = value;
+    if (value > hist->max) hist->max = value;
+}
+
+/** @brief Get the value at a percentile.
+ *  @param hist The histogram.
+ *  @param percentile The percentile (0 to 100).
+ *  @return The highest value of the bucket holding the percentile, at most the maximum.
+ */
+uint64_t hdr_percentile(const struct hdr_histogram *hist, double percentile) {
+    uint64_t target = (uint64_t) ceil(percentile / 100.0 * hist->total), seen = 0;
+
+    if (hist->total == 0) return 0;
+    if (target < 1) target = 1;
+    for (int i = 0; i < HDR_COUNTS; i ++) {
+        seen += hist->counts[i];
+        if (seen >= target) {
+            uint64_t value = hdr_highest(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
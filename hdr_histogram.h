@@ -0,0 +1,52 @@
+/*
+ * Header file for the constant memory HDR histogram
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#ifndef __Hdr_header
+#define __Hdr_header
+
+#define HDR_SUB_BITS 8                        // 256 sub-buckets: a relative error below 1%
+#define HDR_MAX_BITS 40                       // the values are clamped to 2^40 - 1
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_HALF (1 << (HDR_SUB_BITS - 1))
+#define HDR_COUNTS ((HDR_MAX_BITS - HDR_SUB_BITS + 2) * HDR_HALF)
+
+/** @brief A histogram of integer values, with log-spaced buckets split in linear sub-buckets.
+ *
+ *  The values below HDR_SUB_COUNT are counted exactly, then every power of
+ *  2 is split in HDR_HALF sub-buckets, so a percentile is reported with 2
+ *  significant digits, in 17 KB whatever the number of values.
+ */
+struct hdr_histogram {
+    uint64_t total;                 // the number of values
+    uint64_t min, max;              // the exact extremes
+    uint32_t counts[HDR_COUNTS];
+};
+
+/** @brief Empty a histogram.
+ *  @param hist The histogram.
+ *  @return Void.
+ */
+void hdr_init(struct hdr_histogram *hist);
+
+/** @brief Count a value, in O(1).
+ *  @param hist The histogram.
+ *  @param value The value, clamped to 2^HDR_MAX_BITS - 1.
+ *  @return Void.
+ */
+void hdr_record(struct hdr_histogram *hist, uint64_t value);
+
+/** @brief Get the value at a percentile.
+ *  @param hist The histogram.
+ *  @param percentile The percentile (0 to 100).
+ *  @return The highest value of the bucket holding the percentile, at most the maximum.
+ */
+uint64_t hdr_percentile(const struct hdr_histogram *hist, double percentile);
+
+#endif
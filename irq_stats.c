@@ -0,0 +1,348 @@
+/** @file irq_stats.c
+ *  @brief Report which interrupts and softirqs keep the CPUs busy
+ *
+ *  This file includes the functions that read "/proc/interrupts" and
+ *  "/proc/softirqs", which are wide matrices with one column per CPU, and
+ *  report the hottest interrupt lines and how they are spread over the
+ *  CPUs. On large hosts "/proc/interrupts" is hundreds of KB, so the file
+ *  is read in one go into a reused buffer, parsed with the SIMD number
+ *  parser into matrices allocated once, and the deltas are computed in
+ *  one flat loop.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "irq_stats.h"
+#include "parse_numbers.h"
+
+/** @brief Read a whole file into the buffer of a table, growing it if needed.
+ *
+ *  Large files of "/proc" are produced in chunks, so read until the end.
+ *
+ *  @param table The table to read.
+ *  @return The number of bytes read, or -1 on failure.
+ */
+static ssize_t irq_read_file(struct irq_table *table) {
+    size_t len = 0;
+    ssize_t n;
+
+    while ((n = pread(table->fd, table->buf + len, table->buf_size - len - 1, len)) > 0) {
+        len += n;
+        if (len + 1 == table->buf_size) {
+            table->buf_size *= 2;
+            if ((table->buf = realloc(table->buf, table->buf_size)) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+    }
+    if (n < 0) {
+        return -1;
+    }
+    table->buf[len] = '\0';
+    return len;
+}
+
+/** @brief Allocate the matrices of a table for the given number of rows and CPUs.
+ *  @param table The table.
+ *  @param rows The number of rows.
+ *  @param ncpu The number of CPU columns.
+ *  @return Void.
+ */
+static void irq_resize(struct irq_table *table, int rows, int ncpu) {
+    size_t cells = (size_t) rows * ncpu;
+    int old = table->ncpu == ncpu ? table->capacity : 0;  // the rows kept
+
+    if ((table->cpu_id = realloc(table->cpu_id, ncpu * sizeof(int))) == NULL ||
+        (table->label = realloc(table->label, rows * sizeof(*table->label))) == NULL ||
+        (table->desc = realloc(table->desc, rows * sizeof(*table->desc))) == NULL ||
+        (table->count = realloc(table->count, cells * sizeof(uint64_t))) == NULL ||
+        (table->prev = realloc(table->prev, cells * sizeof(uint64_t))) == NULL ||
+        (table->delta = realloc(table->delta, cells * sizeof(uint64_t))) == NULL ||
+        (table->rate = realloc(table->rate, rows * sizeof(double))) == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    if (ncpu != table->ncpu) {
+        memset(table->cpu_id, -1, ncpu * sizeof(int));  // read from the header by irq_parse
+    }
+    // The new rows have no label yet
+    memset(table->label + old, 0, (rows - old) * sizeof(*table->label));
+    table->capacity = rows;
+    table->ncpu = ncpu;
+    table->valid = 0;  // the previous sample has another layout
+}
+
+/** @brief Parse the content of a table into its counter matrix.
+ *
+ *  The first line lists the online CPUs ("CPU0 CPU2 ..."), then each line is
+ *  "<label>: <one counter per CPU> [description]". Some lines (e.g. "ERR")
+ *  have a single counter, the missing ones are set to 0.
+ *
+ *  @param table The table.
+ *  @param size The number of bytes read into the buffer of the table.
+ *  @return Void.
+ */
+static void irq_parse(struct irq_table *table, size_t size) {
+    char *line = table->buf, *end, *next, *colon;
+    const char *ptr;
+    int ncpu = 0, row = 0;
+
+    // Count the CPU columns of the header
+    end = strchr(line, '\n');
+    for (ptr = line; (ptr = strstr(ptr, "CPU")) != NULL && (end == NULL || ptr < end); ptr += 3) {
+        ncpu ++;
+    }
+    if (end == NULL || ncpu == 0) {
+        table->rows = 0;
+        return;
+    }
+    if (ncpu != table->ncpu) {
+        irq_resize(table, table->capacity > 0 ? table->capacity : 64, ncpu);
+    }
+    // The number of each column, the CPUs offline have none
+    ptr = line;
+    for (int cpu = 0; cpu < ncpu; cpu ++) {
+        ptr = strstr(ptr, "CPU") + 3;
+        int id = atoi(ptr);
+        if (id != table->cpu_id[cpu]) {
+            table->cpu_id[cpu] = id;
+            table->valid = 0;  // a CPU went offline and another one online
+        }
+    }
+
+    for (line = end + 1; *line; line = next) {
+        // Cut the line, so that the description stops at its end
+        if ((end = strchr(line, '\n')) != NULL) {
+            *end = '\0';
+            next = end + 1;
+        } else {
+            next = line + strlen(line);
+        }
+        if ((colon = strchr(line, ':')) == NULL) {
+            continue;
+        }
+        if (row == table->capacity) {
+            irq_resize(table, table->capacity * 2, ncpu);
+        }
+
+        // The label, without the leading spaces
+        while (*line == ' ') line ++;
+        int len = colon - line < IRQ_LABEL_LEN - 1 ? colon - line : IRQ_LABEL_LEN - 1;
+        if (strncmp(table->label[row], line, len) != 0 || table->label[row][len] != '\0') {
+            memcpy(table->label[row], line, len);
+            table->label[row][len] = '\0';
+            table->valid = 0;  // another interrupt line is at this row
+        }
+
+        // The counters, then the description
+        uint64_t *count = table->count + (size_t) row * ncpu;
+        ptr = colon + 1;
+        int n = parse_u64_run(&ptr, table->buf + size, count, ncpu);
+        memset(count + n, 0, (ncpu - n) * sizeof(uint64_t));
+        while (*ptr == ' ') ptr ++;
+        snprintf(table->desc[row], IRQ_DESC_LEN, "%s", ptr);
+        row ++;
+    }
+    if (row != table->rows) {
+        table->valid = 0;
+    }
+    table->rows = row;
+}
+
+/** @brief Compute the deltas of every counter, in one flat loop.
+ *
+ *  The arrays do not overlap and are contiguous, so the compiler can
+ *  vectorize this loop.
+ *
+ *  @param delta Where to store the deltas.
+ *  @param count The counters of the current sample.
+ *  @param prev The counters of the previous sample.
+ *  @param cells The number of counters.
+ *  @return Void.
+ */
+static void irq_delta(uint64_t *restrict delta, const uint64_t *restrict count,
+    const uint64_t *restrict prev, size_t cells) {
+    for (size_t i = 0; i < cells; i ++) {
+        delta[i] = count[i] - prev[i];
+    }
+}
+
+/** @brief Read and parse a table, then compute the rate of each line.
+ *  @param table The table.
+ *  @param interval The seconds since the previous sample.
+ *  @return Void.
+ */
+static void irq_table_sample(struct irq_table *table, double interval) {
+    ssize_t len;
+
+    if (table->fd == -1 || (len = irq_read_file(table)) <= 0) {
+        return;
+    }
+    irq_parse(table, len);
+
+    size_t cells = (size_t) table->rows * table->ncpu;
+    if (table->valid) {
+        irq_delta(table->delta, table->count, table->prev, cells);
+    } else {
+        memset(table->delta, 0, cells * sizeof(uint64_t));
+    }
+    for (int row = 0; row < table->rows; row ++) {
+        const uint64_t *delta = table->delta + (size_t) row * table->ncpu;
+        uint64_t total = 0;
+        for (int cpu = 0; cpu < table->ncpu; cpu ++) {
+            total += delta[cpu];
+        }
+        table->rate[row] = interval > 0 ? total / interval : 0.0;
+    }
+
+    // The current counters become the previous ones, just swap the arrays
+    uint64_t *tmp = table->prev;
+    table->prev = table->count;
+    table->count = tmp;
+    table->valid = 1;
+}
+
+/** @brief Open a table and take its first sample.
+ *  @param table The table.
+ *  @param path The file of the table.
+ *  @return Void.
+ */
+static void irq_table_init(struct irq_table *table, const char *path) {
+    memset(table, 0, sizeof(*table));
+    table->path = path;
+    table->buf_size = 65536;
+    if ((table->buf = malloc(table->buf_size)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    table->fd = open(path, O_RDONLY | O_CLOEXEC);
+    irq_table_sample(table, 0);
+}
+
+/** @brief Open "/proc/interrupts" and "/proc/softirqs" and take the first sample.
+ *  @param stats The collector state to initialize.
+ *  @return Void.
+ */
+void irq_init(struct irq_stats *stats) {
+    irq_table_init(&stats->irq, "/proc/interrupts");
+    irq_table_init(&stats->softirq, "/proc/softirqs");
+    time_since(&stats->last);
+}
+
+/** @brief Re-read both tables and compute the per-line and per-CPU rates.
+ *
+ *  delta = count_curr - count_prev (for each line and CPU)
+ *  rate (per sec) = sum of the deltas of a line / interval
+ *
+ *  @param stats The collector state.
+ *  @return Void.
+ */
+void irq_sample(struct irq_stats *stats) {
+    double interval = time_since(&stats->last);
+
+    irq_table_sample(&stats->irq, interval);
+    irq_table_sample(&stats->softirq, interval);
+}
+
+/** @brief Prints the hottest lines of a table and their CPU spread.
+ *  @param table The table.
+ *  @param title The title of the table.
+ *  @return The number of lines printed.
+ */
+static int show_irq_table(struct irq_table *table, const char *title) {
+    int top[IRQ_TOP], ntop = 0, lines = 0;
+
+    if (table->fd == -1) {
+        printf(" %-7s unavailable\n", title);
+        return 1;
+    }
+    // Select the IRQ_TOP lines with the highest rate
+    for (int row = 0; row < table->rows; row ++) {
+        if (table->rate[row] <= 0) continue;
+        int j = ntop < IRQ_TOP ? ntop ++ : IRQ_TOP;
+        if (j == IRQ_TOP && table->rate[row] <= table->rate[top[IRQ_TOP - 1]]) continue;
+        if (j == IRQ_TOP) j = IRQ_TOP - 1;
+        while (j > 0 && table->rate[top[j - 1]] < table->rate[row]) {
+            top[j] = top[j - 1];
+            j --;
+        }
+        top[j] = row;
+    }
+
+    for (int k = 0; k < ntop; k ++) {
+        int row = top[k];
+        // delta holds the latest deltas, find the CPUs taking most of them
+        const uint64_t *delta = table->delta + (size_t) row * table->ncpu;
+        uint64_t total = 0;
+        int spread[IRQ_SPREAD], nspread = 0;
+        for (int cpu = 0; cpu < table->ncpu; cpu ++) {
+            total += delta[cpu];
+            if (delta[cpu] == 0) continue;
+            int j = nspread < IRQ_SPREAD ? nspread ++ : IRQ_SPREAD;
+            if (j == IRQ_SPREAD && delta[cpu] <= delta[spread[IRQ_SPREAD - 1]]) continue;
+            if (j == IRQ_SPREAD) j = IRQ_SPREAD - 1;
+            while (j > 0 && delta[spread[j - 1]] < delta[cpu]) {
+                spread[j] = spread[j - 1];
+                j --;
+            }
+            spread[j] = cpu;
+        }
+
+        printf(" %-7s %-8s %10.0f/s ", k == 0 ? title : "", table->label[row], table->rate[row]);
+        for (int j = 0; j < IRQ_SPREAD; j ++) {
+            if (j < nspread) {
+                printf(" cpu%-3d %3.0f%%", table->cpu_id[spread[j]], 100.0 * delta[spread[j]] / total);
+            } else {
+                printf("  %9s", "");
+            }
+        }
+        printf("  %s\n", table->desc[row]);
+        lines ++;
+    }
+    if (ntop == 0) {
+        printf(" %-7s none\n", title);
+        lines ++;
+    }
+    return lines;
+}
+
+/** @brief Prints the hottest interrupt and softirq lines and their CPU spread.
+ *  @param stats The collector state.
+ *  @return The number of lines printed.
+ */
+int show_irq_info(struct irq_stats *stats) {
+    int lines = 1;  // the number of lines printed
+
+    printf("### Interrupts ### (hottest lines per sec, and the CPUs serving them)\n");
+    lines += show_irq_table(&stats->irq, "IRQ");
+    lines += show_irq_table(&stats->softirq, "SOFTIRQ");
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Free the matrices of a table and close its file.
+ *  @param table The table.
+ *  @return Void.
+ */
+static void irq_table_close(struct irq_table *table) {
+    if (table->fd != -1) close(table->fd);
+    free(table->buf);
+    free(table->cpu_id);
+    free(table->label);
+    free(table->desc);
+    free(table->count);
+    free(table->prev);
+    free(table->delta);
+    free(table->rate);
+}
+
+/** @brief Free the matrices and close the files.
+ *  @param stats The collector state.
+ *  @return Void.
+ */
+void irq_close(struct irq_stats *stats) {
+    irq_table_close(&stats->irq);
+    irq_table_close(&stats->softirq);
+}
@@ -0,0 +1,81 @@
+/*
+ * Header file for the interrupt and softirq rate collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef __Irq_header
+#define __Irq_header
+
+#define IRQ_TOP 5          // the number of hottest lines reported per table
+#define IRQ_SPREAD 3       // the number of CPUs shown for each hot line
+#define IRQ_LABEL_LEN 16   // the maximum length of a line label (e.g. "LOC")
+#define IRQ_DESC_LEN 40    // the maximum length of a line description
+
+/** @brief A per-CPU counter matrix read from "/proc/interrupts" or "/proc/softirqs".
+ *
+ *  The counters are stored row by row (one row per interrupt line, one
+ *  column per CPU) in flat arrays, which are allocated once and only grow
+ *  when the kernel adds lines or CPUs.
+ */
+struct irq_table {
+    const char *path;     // the file the table is read from
+    int fd;               // fd of the file, -1 if unavailable
+    char *buf;            // the buffer the whole file is read into
+    size_t buf_size;      // the size of buf
+
+    int ncpu;             // the number of CPU columns
+    int *cpu_id;          // the CPU of each column, e.g. 0 2 3 with CPU1 offline
+    int rows;             // the number of interrupt lines
+    int capacity;         // the number of rows allocated
+    char (*label)[IRQ_LABEL_LEN];  // the label of each row
+    char (*desc)[IRQ_DESC_LEN];    // the description of each row
+    uint64_t *count;      // the counters of the current sample (rows x ncpu)
+    uint64_t *prev;       // the counters of the previous sample
+    uint64_t *delta;      // count - prev
+    double *rate;         // the total rate of each row (in interrupts/sec)
+    int valid;            // whether prev has the same layout as count
+};
+
+/** @brief State of the interrupt collector. */
+struct irq_stats {
+    struct irq_table irq;      // "/proc/interrupts"
+    struct irq_table softirq;  // "/proc/softirqs"
+    struct timespec last;      // time of the previous sample
+};
+
+/** @brief Open "/proc/interrupts" and "/proc/softirqs" and take the first sample.
+ *  @param stats The collector state to initialize.
+ *  @return Void.
+ */
+void irq_init(struct irq_stats *stats);
+
+/** @brief Re-read both tables and compute the per-line and per-CPU rates.
+ *
+ *  delta = count_curr - count_prev (for each line and CPU)
+ *  rate (per sec) = sum of the deltas of a line / interval
+ *
+ *  @param stats The collector state.
+ *  @return Void.
+ */
+void irq_sample(struct irq_stats *stats);
+
+/** @brief Prints the hottest interrupt and softirq lines and their CPU spread.
+ *  @param stats The collector state.
+ *  @return The number of lines printed.
+ */
+int show_irq_info(struct irq_stats *stats);
+
+/** @brief Free the matrices and close the files.
+ *  @param stats The collector state.
+ *  @return Void.
+ */
+void irq_close(struct irq_stats *stats);
+
+#endif
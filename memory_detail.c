@@ -0,0 +1,122 @@
+/** @file memory_detail.c
+ *  @brief Report where the memory of a system goes
+ *
+ *  This file includes the functions that break the memory usage down into
+ *  anonymous memory, page cache, slab, huge pages and dirty writeback, and
+ *  report the page fault, reclaim (pgscan/pgsteal) and swap activity, so
+ *  that the source of a memory pressure can be told apart.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "memory_detail.h"
+
+/** @brief The keys of "/proc/vmstat" (see enum vmstat_counter). */
+static const char *vmstat_keys[VM_COUNTERS] = {
+    "pgfault", "pgmajfault",
+    "pgscan_kswapd", "pgscan_direct",
+    "pgsteal_kswapd", "pgsteal_direct",
+    "pswpin", "pswpout"
+};
+
+/** @brief Read "/proc/vmstat" in one pass.
+ *  @param fd An fd of "/proc/vmstat".
+ *  @param vm Where to store the counters.
+ *  @return Void.
+ */
+static void read_vmstat(int fd, unsigned long long *vm) {
+    char buf[16384];   // the whole file (about 5 KB)
+    char *line, *space;
+    ssize_t len;
+
+    if ((len = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+        return;
+    }
+    buf[len] = '\0';
+
+    for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') line ++;
+        if ((space = strchr(line, ' ')) == NULL) break;
+        for (int i = 0; i < VM_COUNTERS; i ++) {
+            if (strncmp(line, vmstat_keys[i], space - line) == 0 &&
+                vmstat_keys[i][space - line] == '\0') {
+                vm[i] = strtoull(space + 1, NULL, 10);
+                break;
+            }
+        }
+    }
+}
+
+/** @brief Open "/proc/meminfo" and "/proc/vmstat" and take the first sample.
+ *  @param detail The collector state to initialize.
+ *  @return Void.
+ */
+void memory_detail_init(struct memory_detail *detail) {
+    memset(detail, 0, sizeof(*detail));
+    if ((detail->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC)) == -1 ||
+        (detail->vmstat_fd = open("/proc/vmstat", O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    read_meminfo(detail->meminfo_fd, &detail->mem);
+    read_vmstat(detail->vmstat_fd, detail->vm_prev);
+    time_since(&detail->last);
+}
+
+/** @brief Re-read both files (one pass each) and compute the vmstat rates.
+ *
+ *  rate (per sec) = (counter_curr - counter_prev) / interval
+ *
+ *  @param detail The collector state.
+ *  @return Void.
+ */
+void memory_detail_sample(struct memory_detail *detail) {
+    double interval = time_since(&detail->last);
+
+    read_meminfo(detail->meminfo_fd, &detail->mem);
+    read_vmstat(detail->vmstat_fd, detail->vm);
+    for (int i = 0; i < VM_COUNTERS; i ++) {
+        detail->rate[i] = interval > 0 ? (detail->vm[i] - detail->vm_prev[i]) / interval : 0.0;
+        detail->vm_prev[i] = detail->vm[i];
+    }
+}
+
+/** @brief Prints the memory detail section.
+ *
+ *  Print AnonPages, Shmem, Slab, Dirty/Writeback, HugePages and
+ *  MemAvailable, then the page fault, pgscan/pgsteal and swap-in/out rates.
+ *
+ *  @param detail The collector state.
+ *  @return The number of lines printed.
+ */
+int show_memory_detail(struct memory_detail *detail) {
+    struct meminfo *mem = &detail->mem;
+    double *rate = detail->rate;
+
+    printf("### Memory detail ### (in GB, and events/s)\n");
+    printf(" Available %.2f  Anon %.2f  Shmem %.2f  Slab %.2f (reclaimable %.2f)\n",
+        mem->available * 1e-9, mem->anon * 1e-9, mem->shmem * 1e-9,
+        mem->slab * 1e-9, mem->sreclaimable * 1e-9);
+    printf(" Dirty %.3f  Writeback %.3f  HugePages %lld free / %lld (%.2f GB)\n",
+        mem->dirty * 1e-9, mem->writeback * 1e-9, mem->huge_free, mem->huge_total,
+        mem->huge_total * mem->huge_size * 1e-9);
+    printf(" faults %.0f (major %.0f)  pgscan %.0f / pgsteal %.0f (kswapd %.0f / %.0f)"
+        "  swap in %.0f / out %.0f\n",
+        rate[VM_PGFAULT], rate[VM_PGMAJFAULT],
+        rate[VM_PGSCAN_KSWAPD] + rate[VM_PGSCAN_DIRECT],
+        rate[VM_PGSTEAL_KSWAPD] + rate[VM_PGSTEAL_DIRECT],
+        rate[VM_PGSCAN_KSWAPD], rate[VM_PGSTEAL_KSWAPD],
+        rate[VM_PSWPIN], rate[VM_PSWPOUT]);
+    printf("---------------------------------------\n");
+    return 5;
+}
+
+/** @brief Close the files opened by the collector.
+ *  @param detail The collector state.
+ *  @return Void.
+ */
+void memory_detail_close(struct memory_detail *detail) {
+    close(detail->meminfo_fd);
+    close(detail->vmstat_fd);
+}
@@ -0,0 +1,68 @@
+/*
+ * Header file for the extended memory breakdown ("--memory-detail")
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats_functions.h"
+
+#ifndef __Memory_detail_header
+#define __Memory_detail_header
+
+/** @brief The counters read from "/proc/vmstat" (see vmstat_keys). */
+enum vmstat_counter {
+    VM_PGFAULT, VM_PGMAJFAULT,
+    VM_PGSCAN_KSWAPD, VM_PGSCAN_DIRECT,
+    VM_PGSTEAL_KSWAPD, VM_PGSTEAL_DIRECT,
+    VM_PSWPIN, VM_PSWPOUT,
+    VM_COUNTERS
+};
+
+/** @brief State of the memory detail collector kept between two samples. */
+struct memory_detail {
+    int meminfo_fd;                     // fd of "/proc/meminfo"
+    int vmstat_fd;                      // fd of "/proc/vmstat"
+    struct meminfo mem;                 // the last values of "/proc/meminfo"
+    unsigned long long vm[VM_COUNTERS]; // the last values of "/proc/vmstat"
+    unsigned long long vm_prev[VM_COUNTERS];
+    double rate[VM_COUNTERS];           // the rates (in events per second)
+    struct timespec last;               // time of the previous sample
+};
+
+/** @brief Open "/proc/meminfo" and "/proc/vmstat" and take the first sample.
+ *  @param detail The collector state to initialize.
+ *  @return Void.
+ */
+void memory_detail_init(struct memory_detail *detail);
+
+/** @brief Re-read both files (one pass each) and compute the vmstat rates.
+ *
+ *  rate (per sec) = (counter_curr - counter_prev) / interval
+ *
+ *  @param detail The collector state.
+ *  @return Void.
+ */
+void memory_detail_sample(struct memory_detail *detail);
+
+/** @brief Prints the memory detail section.
+ *
+ *  Print AnonPages, Shmem, Slab, Dirty/Writeback, HugePages and
+ *  MemAvailable, then the page fault, pgscan/pgsteal and swap-in/out rates.
+ *
+ *  @param detail The collector state.
+ *  @return The number of lines printed.
+ */
+int show_memory_detail(struct memory_detail *detail);
+
+/** @brief Close the files opened by the collector.
+ *  @param detail The collector state.
+ *  @return Void.
+ */
+void memory_detail_close(struct memory_detail *detail);
+
+#endif
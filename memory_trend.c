@@ -0,0 +1,182 @@
+/** @file memory_trend.c
+ *  @brief Fit the growth of the memory, to tell a leak from a fluctuation
+ *
+ *  This file includes the functions that fit a least-squares line through
+ *  the history of the used physical memory, and of the resident memory of
+ *  every process, project when the used memory would run out of
+ *  MemAvailable at that rate, and list the processes growing the fastest.
+ *  The fits are updated online, in O(1) per sample and per process,
+ *  however long the program runs. The processes are read by the process
+ *  cache of the session usage, one scan of /proc for both.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "memory_trend.h"
+#include "session_usage.h"
+
+/** @brief Add a point to a fit.
+ *  @param fit The fit.
+ *  @param t The time.
+ *  @param y The value.
+ *  @return Void.
+ */
+void trend_fit_add(struct trend_fit *fit, double t, double y) {
+    double dt = t - fit->mean_t;
+    double dy = y - fit->mean_y;
+
+    fit->n += 1.0;
+    fit->mean_t += dt / fit->n;
+    fit->mean_y += dy / fit->n;
+    // the old deviation of t times the new deviation of y (Welford)
+    fit->ctt += dt * (t - fit->mean_t);
+    fit->cty += dt * (y - fit->mean_y);
+    fit->cyy += dy * (y - fit->mean_y);
+}
+
+/** @brief The slope of a fit.
+ *  @param fit The fit.
+ *  @return The change of y per unit of t, 0 with less than 2 points.
+ */
+double trend_slope(const struct trend_fit *fit) {
+    return fit->ctt > 0 ? fit->cty / fit->ctt : 0.0;
+}
+
+/** @brief The share of the variance of a fit explained by its line.
+ *  @param fit The fit.
+ *  @return r2, between 0 and 1 (1 for a flat series).
+ */
+static double trend_r2(const struct trend_fit *fit) {
+    if (fit->ctt <= 0 || fit->cyy <= 0) return 1.0;
+    return fit->cty * fit->cty / (fit->ctt * fit->cyy);
+}
+
+/** @brief Print a duration as "3d 4h", "4h 12m" or "12m 30s".
+ *  @param buf Where to store the text.
+ *  @param size The size of buf.
+ *  @param secs The duration.
+ *  @return buf.
+ */
+static char *format_duration(char *buf, size_t size, double secs) {
+    long long s = (long long) secs;
+
+    if (s >= 86400) {
+        snprintf(buf, size, "%lldd %lldh", s / 86400, s % 86400 / 3600);
+    } else if (s >= 3600) {
+        snprintf(buf, size, "%lldh %lldm", s / 3600, s % 3600 / 60);
+    } else {
+        snprintf(buf, size, "%lldm %llds", s / 60, s % 60);
+    }
+    return buf;
+}
+
+/** @brief Keep the process if it grows faster than the listed ones.
+ *  @param trend The collector state.
+ *  @param proc The process.
+ *  @return Void.
+ */
+static void trend_rank(struct memory_trend *trend, struct pid_entry *proc) {
+    double slope = trend_slope(&proc->fit);
+    int j;
+
+    if (proc->fit.n < TREND_MIN_SAMPLES || slope <= 0) return;
+    j = trend->top_count < TREND_TOP ? trend->top_count ++ : TREND_TOP;
+    while (j > 0 && trend_slope(&trend->top[j - 1]->fit) < slope) {
+        if (j < TREND_TOP) trend->top[j] = trend->top[j - 1];
+        j --;
+    }
+    if (j < TREND_TOP) trend->top[j] = proc;
+}
+
+/** @brief Open "/proc/meminfo" and start the fits.
+ *  @param trend The collector state to initialize.
+ *  @return Void.
+ */
+void memory_trend_init(struct memory_trend *trend) {
+    memset(trend, 0, sizeof(*trend));
+    if ((trend->meminfo_fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("/proc/meminfo");
+        exit(1);
+    }
+    time_since(&trend->start);
+}
+
+/** @brief Add the used memory, and the resident memory of every process, to their fits.
+ *
+ *  Used = MemTotal - MemFree - (Buffers + Cached + SReclaimable), as in
+ *  get_memory_info. The processes come from the scan of the process cache
+ *  for this sample (see pid_cache_scan), each is an O(1) update of its fit.
+ *
+ *  @param trend The collector state.
+ *  @param cache The process cache, scanned for this sample.
+ *  @return Void.
+ */
+void memory_trend_sample(struct memory_trend *trend, struct pid_cache *cache) {
+    struct timespec now = trend->start;
+    struct meminfo *mem = &trend->mem;
+
+    trend->now = time_since(&now);
+    if (read_meminfo(trend->meminfo_fd, mem)) {
+        trend->used = (mem->total - mem->free) - (mem->buffers + mem->cached + mem->sreclaimable);
+        trend_fit_add(&trend->fit, trend->now, trend->used);
+    }
+
+    // fit every process of the scan, and rank them
+    trend->top_count = trend->procs = 0;
+    for (int i = 0; i < PID_BUCKETS; i ++) {
+        for (struct pid_entry *entry = cache->bucket[i]; entry != NULL; entry = entry->next) {
+            if (entry->fresh) {
+                // a new process, or the pid was reused: start a new fit
+                memset(&entry->fit, 0, sizeof(entry->fit));
+            }
+            trend_fit_add(&entry->fit, trend->now, entry->rss);
+            trend_rank(trend, entry);
+            trend->procs ++;
+        }
+    }
+}
+
+/** @brief Prints the memory trend section.
+ *
+ *  Print the slope of the used memory and, when it grows, the time until
+ *  it reaches MemAvailable at that rate, then the processes whose resident
+ *  memory grows the fastest.
+ *
+ *  @param trend The collector state.
+ *  @return The number of lines printed.
+ */
+int show_memory_trend(struct memory_trend *trend) {
+    double slope = trend_slope(&trend->fit);  // bytes per second
+    char span[32], left[32];
+    int lines = 3;
+
+    printf("### Memory Trend ### (least squares over %s, %.0f samples)\n",
+        format_duration(span, sizeof(span), trend->now), trend->fit.n);
+    printf(" Used %.2f GB  %+.2f MB/min (r2 %.2f)  Available %.2f GB", trend->used * 1e-9,
+        slope * 60e-6, trend_r2(&trend->fit), trend->mem.available * 1e-9);
+    if (trend->fit.n < TREND_MIN_SAMPLES) {
+        printf("  (fitting)\n");
+    } else if (slope > 0 && trend->mem.available > 0) {
+        // at this rate, the used memory takes the rest of MemAvailable in
+        printf("  full in %s\n", format_duration(left, sizeof(left), trend->mem.available / slope));
+    } else {
+        printf("  not growing\n");
+    }
+
+    for (int i = 0; i < trend->top_count; i ++) {
+        struct pid_entry *proc = trend->top[i];
+        printf(" %7d %-15s rss %9.1f MB  %+8.2f MB/min (r2 %.2f)\n", (int) proc->pid, proc->comm,
+            proc->rss * 1e-6, trend_slope(&proc->fit) * 60e-6, trend_r2(&proc->fit));
+        lines ++;
+    }
+    printf("---------------------------------------\n");
+    return lines;
+}
+
+/** @brief Close "/proc/meminfo" (the processes are in the process cache).
+ *  @param trend The collector state.
+ *  @return Void.
+ */
+void memory_trend_close(struct memory_trend *trend) {
+    close(trend->meminfo_fd);
+}
@@ -0,0 +1,105 @@
+/*
+ * Header file for the memory growth trend ("--trend")
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "stats_functions.h"
+
+#ifndef __Memory_trend_header
+#define __Memory_trend_header
+
+#define TREND_TOP 5              // the number of growing processes listed
+#define TREND_MIN_SAMPLES 3      // the samples a fit needs before being reported
+
+/** @brief An online least-squares fit of y = a + b t.
+ *
+ *  The means and co-moments are updated like Welford's variance, so adding
+ *  a point is O(1) and the fit stays accurate over a long run:
+ *      dt = t - mean_t, mean_t += dt / n, mean_y += (y - mean_y) / n
+ *      ctt += dt (t - mean_t), cty += dt (y - mean_y), cyy likewise
+ *      slope b = cty / ctt, r2 = cty^2 / (ctt cyy)
+ */
+struct trend_fit {
+    double n;
+    double mean_t, mean_y;
+    double ctt, cty, cyy;
+};
+
+struct pid_cache;                    // the processes, shared with the session usage (see session_usage.h)
+struct pid_entry;
+
+/** @brief State of the memory trend collector.
+ *
+ *  The fit of each process is kept in its entry of the process cache.
+ */
+struct memory_trend {
+    int meminfo_fd;                  // fd of "/proc/meminfo"
+    struct meminfo mem;              // the last values of "/proc/meminfo"
+    long long used;                  // the last physical used memory (in bytes)
+    struct trend_fit fit;            // the used memory (bytes) over time (seconds)
+    struct timespec start;           // the time of the first sample
+    double now;                      // the time of the last sample, from start
+    int procs;                       // the number of processes fitted
+    struct pid_entry *top[TREND_TOP];  // the processes growing the fastest
+    int top_count;
+};
+
+/** @brief Add a point to a fit.
+ *  @param fit The fit.
+ *  @param t The time.
+ *  @param y The value.
+ *  @return Void.
+ */
+void trend_fit_add(struct trend_fit *fit, double t, double y);
+
+/** @brief The slope of a fit.
+ *  @param fit The fit.
+ *  @return The change of y per unit of t, 0 with less than 2 points.
+ */
+double trend_slope(const struct trend_fit *fit);
+
+/** @brief Open "/proc/meminfo" and start the fits.
+ *  @param trend The collector state to initialize.
+ *  @return Void.
+ */
+void memory_trend_init(struct memory_trend *trend);
+
+/** @brief Add the used memory, and the resident memory of every process, to their fits.
+ *
+ *  Used = MemTotal - MemFree - (Buffers + Cached + SReclaimable), as in
+ *  get_memory_info. The processes come from the scan of the process cache
+ *  for this sample (see pid_cache_scan), each is an O(1) update of its fit.
+ *
+ *  @param trend The collector state.
+ *  @param cache The process cache, scanned for this sample.
+ *  @return Void.
+ */
+void memory_trend_sample(struct memory_trend *trend, struct pid_cache *cache);
+
+/** @brief Prints the memory trend section.
+ *
+ *  Print the slope of the used memory and, when it grows, the time until
+ *  it reaches MemAvailable at that rate, then the processes whose resident
+ *  memory grows the fastest.
+ *
+ *  @param trend The collector state.
+ *  @return The number of lines printed.
+ */
+int show_memory_trend(struct memory_trend *trend);
+
+/** @brief Close "/proc/meminfo" (the processes are in the process cache).
+ *  @param trend The collector state.
+ *  @return Void.
+ */
+void memory_trend_close(struct memory_trend *trend);
+
+#endif
@@ -0,0 +1,193 @@
+/** @file metrics.c
+ *  @brief Keep the distribution of every sampled metric
+ *
+ *  This file includes the functions that record each value shown by the
+ *  program (CPU use, load, memory, pressure...) under a name, into a HDR
+ *  histogram and a bounded multi-resolution history, and print the
+ *  percentiles of the whole run at the end, or when SIGUSR1 is received.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "metrics.h"
+
+/** @brief The percentiles of the summary. */
+static const double metric_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+/** @brief Hash a name (FNV-1a) into a bucket index.
+ *  @param name The name to hash.
+ *  @return The bucket index.
+ */
+static unsigned int metric_hash(const char *name) {
+    unsigned int hash = 2166136261u;
+
+    while (*name) {
+        hash = (hash ^ (unsigned char) *name ++) * 16777619u;
+    }
+    return hash % METRIC_BUCKETS;
+}
+
+/** @brief Find a metric by name, in its hash bucket.
+ *  @param set The metrics.
+ *  @param name The name of the metric.
+ *  @return The index of the metric, or -1.
+ */
+int metric_find(struct metric_set *set, const char *name) {
+    int id = set->bucket[metric_hash(name)] - 1;
+
+    while (id != -1 && strcmp(set->metric[id].name, name) != 0) {
+        id = set->metric[id].next - 1;
+    }
+    return id;
+}
+
+/** @brief Record a new value of a metric, adding the metric the first time.
+ *  @param set The metrics.
+ *  @param name The name of the metric (copied the first time).
+ *  @param unit The unit of the metric (copied the first time).
+ *  @param value The value, the negative values are counted as 0.
+ *  @return The index of the metric.
+ */
+int metric_record(struct metric_set *set, const char *name, const char *unit, double value) {
+    int id = metric_find(set, name);
+    struct metric *metric;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (set->count == 0) set->start = now;
+    if (id == -1) {
+        if (set->count == set->capacity) {
+            set->capacity = set->capacity > 0 ? set->capacity * 2 : METRIC_GROW;
+            if ((set->metric = realloc(set->metric, set->capacity * sizeof(struct metric))) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        id = set->count ++;
+        metric = &set->metric[id];
+        // the name may come from the output of a collector (see metric_take)
+        if ((metric->name = strdup(name)) == NULL || (metric->unit = strdup(unit)) == NULL) {
+            perror("strdup");
+            exit(1);
+        }
+        if ((metric->hist = malloc(sizeof(struct hdr_histogram))) == NULL ||
+            (metric->history = malloc(sizeof(struct rollup))) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        hdr_init(metric->hist);
+        rollup_init(metric->history);
+
+        unsigned int bucket = metric_hash(name);
+        metric->next = set->bucket[bucket];
+        set->bucket[bucket] = id + 1;
+    }
+    metric = &set->metric[id];
+    metric->value = value;
+    metric->updated = now.tv_sec + now.tv_nsec * 1e-9;
+    hdr_record(metric->hist, value > 0 ? (uint64_t) llround(value * METRIC_SCALE) : 0);
+    rollup_push(metric->history, (now.tv_sec - set->start.tv_sec) +
+        (now.tv_nsec - set->start.tv_nsec) * 1e-9, value);
+    return id;
+}
+
+/** @brief Send a value from a collector child, as a tagged line of its output.
+ *
+ *  The metrics are kept in the parent: a child (or worker) prints its
+ *  values among the lines of its section, and the parent records them
+ *  with metric_take when the run is done in time.
+ *
+ *  @param name The name of the metric.
+ *  @param unit The unit of the metric.
+ *  @param value The value.
+ *  @return Void.
+ */
+void metric_emit(const char *name, const char *unit, double value) {
+    printf("%c%s\t%s\t%.17g\n", METRIC_TAG, name, unit, value);
+}
+
+/** @brief Send a value of one of several instances (e.g. a core), named "PREFIXN.FIELD".
+ *  @param prefix The kind of instance, e.g. "cpu".
+ *  @param index The instance, e.g. the CPU number.
+ *  @param field The name of the value, e.g. "util".
+ *  @param unit The unit of the metric.
+ *  @param value The value.
+ *  @return Void.
+ */
+void metric_emit_at(const char *prefix, int index, const char *field, const char *unit, double value) {
+    printf("%c%s%d.%s\t%s\t%.17g\n", METRIC_TAG, prefix, index, field, unit, value);
+}
+
+/** @brief Record the values sent by a collector, and remove their lines from its output.
+ *  @param set The metrics.
+ *  @param text The output of the collector, changed in place.
+ *  @return The length of the output left.
+ */
+size_t metric_take(struct metric_set *set, char *text) {
+    char *line = text, *out = text, *unit, *value, *end;
+
+    while (*line != '\0') {
+        size_t len = strcspn(line, "\n");
+        end = line + len + (line[len] == '\n');
+        if (*line != METRIC_TAG) {
+            memmove(out, line, end - line);  // a line of the section, kept
+            out += end - line;
+        } else if ((unit = memchr(line, '\t', len)) != NULL &&
+            (value = memchr(unit + 1, '\t', line + len - unit - 1)) != NULL) {
+            line[len] = *unit = *value = '\0';  // "\036name\tunit\tvalue"
+            metric_record(set, line + 1, unit + 1, strtod(value + 1, NULL));
+        }
+        line = end;
+    }
+    *out = '\0';
+    return out - text;
+}
+
+/** @brief Prints the history of every metric, one chart per line, as wide as the terminal.
+ *  @param set The metrics.
+ *  @return The number of lines printed.
+ */
+int show_metric_history(struct metric_set *set) {
+    struct winsize size;
+    int width = 80;
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) {
+        width = size.ws_col;
+    }
+    // the name, the tier, the minimum and the maximum take 49 columns
+    width = width - 50 > 10 ? width - 50 : 10;
+
+    printf("### History ### (metric, resolution, min, max, averages from the oldest)\n");
+    for (int i = 0; i < set->count; i ++) {
+        show_rollup(set->metric[i].history, set->metric[i].name, width);
+    }
+    printf("---------------------------------------\n");
+    return set->count + 2;
+}
+
+/** @brief Prints the min, p50, p90, p99, p99.9 and max of every metric.
+ *  @param set The metrics.
+ *  @param out Where to print (stdout at the end of the run, stderr on SIGUSR1).
+ *  @return The number of lines printed.
+ */
+int show_metric_summary(struct metric_set *set, FILE *out) {
+    int lines = 0;
+
+    fprintf(out, "### Summary ### (percentiles of the whole run)\n");
+    fprintf(out, " %-18s %-5s %6s %10s %10s %10s %10s %10s %10s\n",
+        "metric", "unit", "n", "min", "p50", "p90", "p99", "p99.9", "max");
+    lines += 2;
+    for (int i = 0; i < set->count; i ++) {
+        const struct hdr_histogram *hist = set->metric[i].hist;
+
+        fprintf(out, " %-18s %-5s %6llu %10.2f", set->metric[i].name, set->metric[i].unit,
+            (unsigned long long) hist->total, hist->min / METRIC_SCALE);
+        for (size_t j = 0; j < sizeof(metric_percentiles) / sizeof(double); j ++) {
+            fprintf(out, " %10.2f", hdr_percentile(hist, metric_percentiles[j]) / METRIC_SCALE);
+        }
+        fprintf(out, " %10.2f\n", hist->max / METRIC_SCALE);
+        lines ++;
+    }
+    fprintf(out, "---------------------------------------\n");
+    return lines + 1;
+}
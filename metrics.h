@@ -0,0 +1,105 @@
+/*
+ * Header file for the registry of the sampled metrics
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "hdr_histogram.h"
+#include "rollup.h"
+
+#ifndef __Metrics_header
+#define __Metrics_header
+
+#define METRIC_GROW 32        // the metrics allocated at first, doubled when full
+#define METRIC_BUCKETS 1024   // number of buckets of the name hash table
+#define METRIC_SCALE 1000.0   // the values are counted in thousandths
+#define METRIC_TAG '\036'     // starts the line of a value sent by a collector (see metric_emit)
+
+/** @brief One metric, its last value, the histogram and the history of the whole run.
+ *
+ *  The histogram and the history (about 116 KB) are allocated apart, so
+ *  growing the array of the metrics only moves the small part.
+ */
+struct metric {
+    const char *name;         // e.g. "cpu" or "mem.used"
+    const char *unit;         // e.g. "%" or "GB"
+    double value;             // the last value
+    double updated;           // when it was recorded (CLOCK_MONOTONIC, in secs)
+    int next;                 // 1 + the index of the next metric of the same bucket, 0 if none
+    struct hdr_histogram *hist;
+    struct rollup *history;   // the raw, 10s, 1m and 1h buckets
+};
+
+/** @brief The metrics of a run, in the order they were first recorded, indexed by name. */
+struct metric_set {
+    int count, capacity;
+    struct timespec start;    // the time of the first value
+    struct metric *metric;    // grown as the collectors send new metrics (e.g. a core)
+    int bucket[METRIC_BUCKETS];  // 1 + the index of the first metric of each bucket, 0 if none
+};
+
+/** @brief Find a metric by name, in its hash bucket.
+ *  @param set The metrics.
+ *  @param name The name of the metric.
+ *  @return The index of the metric, or -1.
+ */
+int metric_find(struct metric_set *set, const char *name);
+
+/** @brief Record a new value of a metric, adding the metric the first time.
+ *  @param set The metrics.
+ *  @param name The name of the metric (copied the first time).
+ *  @param unit The unit of the metric (copied the first time).
+ *  @param value The value, the negative values are counted as 0.
+ *  @return The index of the metric.
+ */
+int metric_record(struct metric_set *set, const char *name, const char *unit, double value);
+
+/** @brief Send a value from a collector child, as a tagged line of its output.
+ *
+ *  The metrics are kept in the parent: a child (or worker) prints its
+ *  values among the lines of its section, and the parent records them
+ *  with metric_take when the run is done in time.
+ *
+ *  @param name The name of the metric.
+ *  @param unit The unit of the metric.
+ *  @param value The value.
+ *  @return Void.
+ */
+void metric_emit(const char *name, const char *unit, double value);
+
+/** @brief Send a value of one of several instances (e.g. a core), named "PREFIXN.FIELD".
+ *  @param prefix The kind of instance, e.g. "cpu".
+ *  @param index The instance, e.g. the CPU number.
+ *  @param field The name of the value, e.g. "util".
+ *  @param unit The unit of the metric.
+ *  @param value The value.
+ *  @return Void.
+ */
+void metric_emit_at(const char *prefix, int index, const char *field, const char *unit, double value);
+
+/** @brief Record the values sent by a collector, and remove their lines from its output.
+ *  @param set The metrics.
+ *  @param text The output of the collector, changed in place.
+ *  @return The length of the output left.
+ */
+size_t metric_take(struct metric_set *set, char *text);
+
+/** @brief Prints the history of every metric, one chart per line, as wide as the terminal.
+ *  @param set The metrics.
+ *  @return The number of lines printed.
+ */
+int show_metric_history(struct metric_set *set);
+
+/** @brief Prints the min, p50, p90, p99, p99.9 and max of every metric.
+ *  @param set The metrics.
+ *  @param out Where to print (stdout at the end of the run, stderr on SIGUSR1).
+ *  @return The number of lines printed.
+ */
+int show_metric_summary(struct metric_set *set, FILE *out);
+
+#endif
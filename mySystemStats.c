@@ -27,15 +27,31 @@
 #include <utmp.h>
 #include <unistd.h>
 #include <signal.h>
+#include <errno.h>
 
 #include "stats_functions.h"
+#include "pressure_stats.h"
+#include "cgroup_stats.h"
+#include "cgroup_tree.h"
+#include "numa_stats.h"
+#include "memory_detail.h"
+#include "irq_stats.h"
+#include "sched_stats.h"
+#include "freq_stats.h"
+#include "perf_stats.h"
+#include "session_usage.h"
+#include "alert_rules.h"
+#include "anomaly.h"
+#include "memory_trend.h"
+#include "service.h"
+#include "event_loop.h"
 
 /** @brief Move the cursor up.
  *  @param lines The number of lines the cursor moves.
  *  @return Void.
  */
 void move_up(int lines){
-   printf("\033[%dF", lines);
+   if (lines > 0) printf("\033[%dF", lines);  // "\033[0F" would move one line
 }
 
 /** @brief Move the cursor down.
@@ -46,84 +62,31 @@ void move_down(int lines){
    printf("\033[%dE", lines);
 }
 
-/** @brief A signal handling function to reset behaviour for SIGINT.
- * 
- *  When Ctrl-C is hitted, the program will ask the user whether it
- *  really wants to quit the program or not. If the user type 'y' or
- *  'Y', terminate the program. Otherwise continue the execution.
- * 
- *  @param sig An integer which identify the signal.
- *  @return Void.
- */
-void ctrlc_handler(int sig) {
-    // signal(sig, ctrlc_handler);  // first ignore the ctrl-c
-    fprintf(stderr, "You hit Ctrl-C! Do you really want to quit? [y/n] ");
-    char c;         // a char to store user input
-    c = getchar();  // read user input (y or n)
-    if (c == 'y' || c == 'Y') {
-        exit(0);    // if user does what to quit, terminate
-    } else {        // else reset the ctrl-c to this handler
-        getchar();  // get a newline character
-
-        // reset the ctrl-c to this handler function
-        if (signal(sig, ctrlc_handler) == SIG_ERR) {
-            perror("signal");
-            exit(1);
-        }
-        move_up(1);         // move up one line
-        printf("\033[2K");  // erase the line
-    }
-}
-
-/** @brief A signal handling function to reset behaviour for SIGTSTP.
- * 
- *  When Ctrl-Z is hitted, the program will ignore the signal as the program
- *  should not be run in the background while running interactively.
- * 
- *  @param sig An integer which identify the signal.
- *  @return Void.
- */
-void ctrlz_handler(int sig) {
-    // reset the ctrl-z to this handler function
-    if (signal(sig, ctrlz_handler) == SIG_ERR) {
-        perror("signal");
-        exit(1);
-    }
-    printf("\033[2D");      // erase "^Z"
-}
-
-/** @brief Reset the behaviours of the SIGINT and SIGTSTP signals in parent.
- *
- *  We want to ignore the Ctrl-Z as the program should not be run in the
- *  background while running interactively.
- *  And for Ctrl-C, the program will ask the user whether it really wants
- *  to quit the program or not.
- * 
- *  @return Void.
- */
-void set_signals_parent() {
-    if (signal(SIGINT, ctrlc_handler) == SIG_ERR ||    // reset ctrl-c
-        signal(SIGTSTP, ctrlz_handler) == SIG_ERR) {   // reset ctrl-z
-        perror("signal");
-        exit(1);
-    }
-}
+static struct service svc;  // the signals (read by the main loop) and the output of "--daemon"
 
 /** @brief Ignore the SIGINT and SIGTSTP signals in child.
  *
- *  Since we have reset the behaviours of SIGINT and SIGTSTP signal handlers
- *  in parent, the child will also perform these behaviours when receving the
- *  signals. However we don't want the signals to interupt the job of child,
- *  so we just ignore the signal in child.
+ *  The parent blocks the signals and reads them from a signalfd (see
+ *  service_init), the child inherits the blocked mask. We don't want
+ *  Ctrl-C and Ctrl-Z to interupt the job of child, so we just ignore them
+ *  and unblock the others.
  * 
  *  @return Void.
  */
 void set_signals_child() {
+    sigset_t none;
+
+    sigemptyset(&none);
     if (signal(SIGINT, SIG_IGN) == SIG_ERR ||   // ignore the SIGINT signal
         signal(SIGTSTP, SIG_IGN) == SIG_ERR) {  // ignore the SIGTSTP signal
         perror("signal");
         exit(1);
     }
+    // the parent blocks SIGTERM for its signalfd, a child still dies of it
+    if (sigprocmask(SIG_SETMASK, &none, NULL) == -1) {
+        perror("sigprocmask");
+        exit(1);
+    }
 }
 
 /** @brief Fork a child to report memory utilization.
@@ -137,14 +100,17 @@ void set_signals_child() {
  *  @param fd An array of two integers that contains file descriptors for pipe.
  *  @param prev_used The physical memory used from the previous iteration.
  *  @param gragh An integer to indicate if "--graphics" is been called
- *  @return Void.
+ *  @return The pid of the child.
  */
-void read_memory_info(int *fd, double prev_used, int graph) {
+int read_memory_info(int *fd, double prev_used, int graph) {
     if (pipe(fd) == -1) {           // set up pipe for memory utilization
         perror("pipe");
         exit(1);
     }
 
+    // what is still buffered would be printed again by the child when
+    // stdout is a pipe or a file (a terminal is flushed at each line)
+    fflush(stdout);
     int pid;                        // a variable to store child pid
     if ((pid = fork()) == -1) {     // create a child to report the usage
         perror("fork");
@@ -166,6 +132,7 @@ void read_memory_info(int *fd, double prev_used, int graph) {
     } else {
         close(fd[STDOUT_FILENO]);   // close the writing end in parent
     }
+    return pid;
 }
 
 /** @brief Fork a child to report CPU utilization.
@@ -173,19 +140,22 @@ void read_memory_info(int *fd, double prev_used, int graph) {
  *  Child process is responsible for reporting the information and write
  *  to the parent. After child has done its work, terminate the child.
  *  If in parent, return control to the main loop (i.e. return the function).
- *  When reading the cpu usage, sleep tdelay seconds between opening the
- *  Linux file "/proc/stat".
+ *  When reading the cpu usage, sleep until the end of the sample between
+ *  opening the Linux file "/proc/stat".
  * 
  *  @param fd An array of two integers that contains file descriptors for pipe.
- *  @param tdelay Period of time the statistics refresh (in seconds).
- *  @return Void.
+ *  @param until The end of the sample (the next tick of the event loop).
+ *  @return The pid of the child.
  */
-void read_cpu_info(int *fd, int tdelay) {
+int read_cpu_info(int *fd, const struct timespec *until) {
     if (pipe(fd) == -1) {           // set up pipe for CPU utilization
         perror("pipe");
         exit(1);
     }
 
+    // what is still buffered would be printed again by the child when
+    // stdout is a pipe or a file (a terminal is flushed at each line)
+    fflush(stdout);
     int pid;                        // a variable to store child pid
     if ((pid = fork()) == -1) {     // create a child to report cpu usage
         perror("fork");
@@ -200,48 +170,650 @@ void read_cpu_info(int *fd, int tdelay) {
         }
 
         set_signals_child();        // set the signals in child
-        calculate_cpu_use(tdelay);  // report the CPU usage (sleep for tdelay)
+        calculate_cpu_use(until);   // report the CPU usage (sleep until the tick)
         close(fd[STDOUT_FILENO]);   // close the writing end in child
         exit(0);                    // terminate the child
     } else {
         close(fd[STDOUT_FILENO]);   // close the writing end in parent
     }
+    return pid;
 }
 
-/** @brief Fork a child to report connected user.
- *  
- *  Child process is responsible for reporting the information and write
- *  to the parent. After child has done its work, terminate the child.
- *  If in parent, return control to the main loop (i.e. return the function).
- * 
- *  @param fd An array of two integers that contains file descriptors for pipe.
+/** @brief The command line arguments user gived (see vertify_arg).
+ */
+struct options {
+    int sample, tdelay;     // number of samples and period between them
+    int sys, user;          // "--system" and "--user" flags
+    int graph, sequential;  // "--graphics" and "--sequential" flags
+    int sample_f, tdelay_f; // whether "--samples=N" / "--tdelay=T" is been called
+    int pressure;           // "--pressure" flag
+    long pressure_trigger;  // "--pressure-trigger=US", 0 if not called
+    int cgroup;             // "--cgroup" or "--cgroup=PATH" flag
+    int cgroup_count;       // number of "--cgroup=PATH" called
+    char *cgroup_paths[CGROUP_MAX];  // the paths given to "--cgroup=PATH"
+    int cgroup_top;         // "--cgroup-top=N", 0 if not called
+    int numa;               // "--numa" flag
+    int memory_detail;      // "--memory-detail" flag
+    int interrupts;         // "--interrupts" flag
+    int schedstat;          // "--schedstat" flag
+    int cpufreq;            // "--cpufreq" flag
+    int perf;               // "--perf" flag
+    char *utmp_path;        // "--utmp=PATH", NULL if not called
+    int session_usage;      // "--session-usage" flag
+    int history;            // "--history" flag
+    int alert_count;        // number of "--alert=RULE" called
+    char *alert_rules[ALERT_MAX];  // the rules given to "--alert=RULE"
+    char *alert_file;       // "--alert-file=PATH", NULL if not called
+    char *alert_socket;     // "--alert-socket=PATH", NULL if not called
+    int anomaly;            // "--anomaly" flag
+    int trend;              // "--trend" flag
+    int daemon;             // "--daemon" flag
+    char *output;           // "--output=PATH", NULL if not called
+    char *alert_rules_file; // "--alert-rules=PATH", NULL if not called
+    long timeout;           // "--timeout=MS", COLLECTOR_TIMEOUT_MS if not called
+    int collectors;         // "--collectors" flag
+};
+
+/** @brief Judge the CPU and RSS of each process of the cache, each a series of the anomaly detector.
+ *
+ *  A new process (or a reused pid) starts new series, and the series of
+ *  the processes dropped by the scan are removed, so their places are
+ *  reused and the set stays as large as the process table.
+ *
+ *  @param procs The series of the processes.
+ *  @param cache The process cache, scanned.
  *  @return Void.
  */
-void read_user_info(int *fd) {
-    if (pipe(fd) == -1) {           // set up pipe for user connection
-        perror("pipe");
-        exit(1);
+void feed_processes(struct anomaly_set *procs, struct pid_cache *cache) {
+    static const char *fields[2] = {"cpu", "rss"};
+    char name[ANOMALY_NAME];
+    // ticks -> percentage of one core over the interval
+    double scale = cache->interval > 0 ? 100.0 / cache->clk_tck / cache->interval : 0.0;
+
+    for (int k = 0; k < cache->dropped_count; k ++) {
+        anomaly_remove(procs, cache->dropped[k]);
+    }
+    for (int i = 0; i < PID_BUCKETS; i ++) {
+        for (struct pid_entry *entry = cache->bucket[i]; entry; entry = entry->next) {
+            for (int k = 0; k < 2; k ++) {
+                if (entry->fresh && entry->series[k] != -1) {
+                    anomaly_remove(procs, entry->series[k]);  // the pid was reused
+                    entry->series[k] = -1;
+                }
+                if (entry->series[k] == -1) {
+                    snprintf(name, sizeof(name), "%d/%s.%s", (int) entry->pid, entry->comm, fields[k]);
+                    entry->series[k] = anomaly_add(procs, name);
+                }
+            }
+            procs->value[entry->series[0]] = (entry->ticks - entry->ticks_prev) * scale;
+            procs->value[entry->series[1]] = entry->rss * 1e-6;  // in MB
+        }
     }
+    anomaly_update(procs);
+}
 
-    int pid;                        // a variable to store child pid
-    if ((pid = fork()) == -1) {     // create a child to report the usage
-        perror("fork");
-        exit(1);
-    } else if (pid == 0) {
-        close(fd[STDIN_FILENO]);    // close the reading end in child
+/** @brief Fork the worker of the user section, which keeps the session list.
+ *
+ *  The worker parses utmp and watches it for changes (see session_stats.c),
+ *  then at each run parses it again only if it changed, and reports the
+ *  connected users to the parent. So a utmp file on a slow file system
+ *  (e.g. NFS) stalls the worker, which is killed at its deadline, never
+ *  the main loop. It also keeps the process cache, read once per run for
+ *  "--session-usage", "--trend" and "--anomaly": the memory trend and the
+ *  unusual processes are written after the users, as the second and third
+ *  parts of the output (see show_collector_part).
+ *
+ *  @param coll The user collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_user_info(struct collector *coll, struct options *opt) {
+    struct session_stats sessions;  // the cached session list
+    static struct pid_cache pids;   // the processes, to attribute them to sessions and fit them
+    static struct memory_trend trend;  // the fits of the used memory and of each process
+    static struct anomaly_set procs;   // the CPU and RSS series of each process
+    int user = opt->user == 1, usage = user && opt->session_usage == 1;
+    int fit = opt->sys == 1 && opt->trend == 1, watch = opt->sys == 1 && opt->anomaly == 1;
+    int pid;
 
-        // change the standard out into our pipe writing fd
-        if (dup2(fd[STDOUT_FILENO], STDOUT_FILENO) == -1) {
-            perror("dup2");
-            exit(1);
+    // what is still buffered would be printed again by the worker when
+    // stdout is a pipe or a file (a terminal is flushed at each line)
+    fflush(stdout);
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;                 // in parent, the runs are asked by the main loop
+    }
+
+    set_signals_child();            // set the signals in the worker
+    if (user) {
+        session_init(&sessions, opt->utmp_path);  // parse utmp, and watch it for changes
+    }
+    if (usage || fit || watch) {
+        pid_cache_init(&pids);
+    }
+    if (fit) {
+        memory_trend_init(&trend);
+    }
+    if (watch) {
+        anomaly_init(&procs);
+    }
+    // each run writes to its own pipe, which becomes the standard output
+    while (worker_next(coll)) {
+        if (usage || fit || watch) {
+            pid_cache_scan(&pids);  // one pread() per process, for all of them
+        }
+        if (user) {
+            session_sample(&sessions);  // re-parse utmp only if it changed
+            if (usage) {
+                session_usage_sample(&pids, &sessions);  // CPU and memory of each session
+            }
+            show_session_user(&sessions);  // report user connection
+            metric_emit("sessions", "", sessions.count);
+        }
+        if (fit || watch) {
+            printf("\f\n");        // printed with the optional sections
+        }
+        if (fit) {
+            memory_trend_sample(&trend, &pids);
+            show_memory_trend(&trend);
         }
+        if (watch) {
+            feed_processes(&procs, &pids);
+            printf("\f\n");
+            show_anomalies(&procs, "Process anomalies");
+        }
+        worker_done();
+    }
+    if (watch) anomaly_close(&procs);
+    if (fit) memory_trend_close(&trend);
+    if (usage || fit || watch) pid_cache_close(&pids);
+    if (user) session_close(&sessions);
+    exit(0);                        // the parent is gone
+}
 
-        set_signals_child();        // set the signals in child
-        show_session_user();        // report user connection
-        close(fd[STDOUT_FILENO]);   // close the writing end in child
-        exit(0);                    // terminate the child
-    } else {
-        close(fd[STDOUT_FILENO]);   // close the writing end in parent
+/** @brief Send the IPC and clock of each CPU.
+ *  @param perf The perf counter collector, sampled.
+ *  @return Void.
+ */
+void emit_perf(struct perf_stats *perf) {
+    for (int k = 0; k < perf->count; k ++) {
+        metric_emit_at("cpu", perf->cpu[k].id, "ipc", "", perf->cpu[k].ipc);
+        metric_emit_at("cpu", perf->cpu[k].id, "ghz", "GHz", perf->cpu[k].ghz);
+    }
+}
+
+/** @brief Fork the worker of the perf counters, which keeps them open.
+ *
+ *  Like every worker of an optional section, its first run shows the
+ *  sample taken by the init: a second one would give rates over the
+ *  microseconds since. Its values are sent from the second run.
+ *
+ *  @param coll The perf collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_perf_info(struct collector *coll, struct options *opt) {
+    struct perf_stats perf;         // state of the perf counter collector
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    perf_init(&perf);               // if no counter can be opened, the section says why
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            perf_sample(&perf);
+            emit_perf(&perf);
+        }
+        show_perf_info(&perf);
+        worker_done();
+    }
+    perf_close(&perf);
+    exit(0);
+}
+
+/** @brief Send the utilization and run queue wait of each core, and its frequency and temperature.
+ *  @param sched The scheduler collector, sampled.
+ *  @param freq The frequency collector, sampled, or NULL if it does not run.
+ *  @return Void.
+ */
+void emit_sched(struct sched_stats *sched, struct freq_stats *freq) {
+    for (int k = 0; k < sched->ncpu; k ++) {
+        if (!sched->cpu[k].seen) continue;  // an offline core keeps its last value
+        metric_emit_at("cpu", k, "util", "%", sched->cpu[k].util);
+        if (sched->schedstat_fd != -1) metric_emit_at("cpu", k, "wait", "ms/s", sched->cpu[k].wait_rate);
+    }
+    for (int k = 0; freq != NULL && k < freq->count; k ++) {
+        struct freq_cpu *cpu = &freq->cpu[k];
+        if (cpu->cur_khz > 0) metric_emit_at("cpu", cpu->id, "mhz", "MHz", cpu->cur_khz * 1e-3);
+        if (cpu->throttle_fd != -1) metric_emit_at("cpu", cpu->id, "throttle", "/s", cpu->throttle_rate);
+        if (cpu->sensor != -1) metric_emit_at("cpu", cpu->id, "temp", "C", freq->sensor[cpu->sensor].temp);
+    }
+    for (int k = 0; freq != NULL && k < freq->zones; k ++) {
+        metric_emit_at("zone", k, "temp", "C", freq->zone[k].temp);
+    }
+}
+
+/** @brief Fork the worker of the scheduler and frequency sections.
+ *
+ *  The frequency section shows the per core utilization of the scheduler
+ *  collector, so both share a worker: the scheduler section is the first
+ *  part of its output, the frequency section the second one.
+ *
+ *  @param coll The scheduler collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_sched_info(struct collector *coll, struct options *opt) {
+    struct sched_stats sched;       // state of the scheduler collector
+    struct freq_stats freq;         // state of the frequency collector
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    sched_init(&sched);
+    if (opt->cpufreq == 1) freq_init(&freq);
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            sched_sample(&sched);
+            if (opt->cpufreq == 1) freq_sample(&freq);
+            emit_sched(&sched, opt->cpufreq == 1 ? &freq : NULL);
+        }
+        if (opt->schedstat == 1) show_sched_info(&sched);
+        if (opt->cpufreq == 1) {
+            printf("\f\n");
+            show_freq_info(&freq, &sched);
+        }
+        worker_done();
+    }
+    if (opt->cpufreq == 1) freq_close(&freq);
+    sched_close(&sched);
+    exit(0);
+}
+
+/** @brief Send the memory breakdown and the paging rates.
+ *  @param detail The memory detail collector, sampled.
+ *  @return Void.
+ */
+void emit_memory_detail(struct memory_detail *detail) {
+    double *rate = detail->rate;
+
+    metric_emit("mem.avail", "GB", detail->mem.available * 1e-9);
+    metric_emit("mem.anon", "GB", detail->mem.anon * 1e-9);
+    metric_emit("mem.shmem", "GB", detail->mem.shmem * 1e-9);
+    metric_emit("mem.slab", "GB", detail->mem.slab * 1e-9);
+    metric_emit("mem.dirty", "GB", detail->mem.dirty * 1e-9);
+    metric_emit("mem.writeback", "GB", detail->mem.writeback * 1e-9);
+    metric_emit("faults", "/s", rate[VM_PGFAULT]);
+    metric_emit("majfaults", "/s", rate[VM_PGMAJFAULT]);
+    metric_emit("pgscan", "/s", rate[VM_PGSCAN_KSWAPD] + rate[VM_PGSCAN_DIRECT]);
+    metric_emit("pgsteal", "/s", rate[VM_PGSTEAL_KSWAPD] + rate[VM_PGSTEAL_DIRECT]);
+    metric_emit("swapin", "/s", rate[VM_PSWPIN]);
+    metric_emit("swapout", "/s", rate[VM_PSWPOUT]);
+}
+
+/** @brief Fork the worker of the memory detail section, which keeps its files open.
+ *  @param coll The memory detail collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_memory_detail(struct collector *coll, struct options *opt) {
+    struct memory_detail detail;    // state of the memory detail collector
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    memory_detail_init(&detail);
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            memory_detail_sample(&detail);
+            emit_memory_detail(&detail);
+        }
+        show_memory_detail(&detail);
+        worker_done();
+    }
+    memory_detail_close(&detail);
+    exit(0);
+}
+
+/** @brief Send the CPU, throttling and memory of each cgroup, named in the order of the "--cgroup=PATH" arguments.
+ *  @param cgroups The cgroup collector, sampled.
+ *  @return Void.
+ */
+void emit_cgroups(struct cgroup_set *cgroups) {
+    for (int j = 0; j < cgroups->count; j ++) {
+        struct cgroup_stats *cg = &cgroups->cg[j];
+        metric_emit_at("cgroup", j, "cpu", "cores", cg->cpu_use);
+        metric_emit_at("cgroup", j, "throttled", "s", cg->throttled);
+        if (cg->fd[CG_MEMORY_CURRENT] != -1) {  // the memory controller is enabled
+            metric_emit_at("cgroup", j, "mem", "GB", cg->mem_current * 1e-9);
+        }
+    }
+}
+
+/** @brief Fork the worker of the cgroup section.
+ *
+ *  A cgroup file may block (e.g. memory.stat of a cgroup being reclaimed),
+ *  so the cgroups are read in the worker, killed at its deadline. The
+ *  hierarchy was checked by the parent.
+ *
+ *  @param coll The cgroup collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_cgroup_info(struct collector *coll, struct options *opt) {
+    static struct cgroup_set cgroups;  // state of the cgroup collector
+    char self_cgroup[PATH_MAX];     // the cgroup of this process
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    cgroup_init(&cgroups);
+    for (int j = 0; j < opt->cgroup_count; j ++) {
+        cgroup_add(&cgroups, opt->cgroup_paths[j]);
+    }
+    // If no path is given, detect the cgroup we are running in
+    if (opt->cgroup_count == 0 && cgroup_self_path(self_cgroup, sizeof(self_cgroup))) {
+        cgroup_add(&cgroups, self_cgroup);
+    }
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            cgroup_sample(&cgroups);
+            emit_cgroups(&cgroups);
+        }
+        show_cgroup_info(&cgroups);
+        worker_done();
+    }
+    cgroup_close(&cgroups);
+    exit(0);
+}
+
+/** @brief Send the number of cgroups of the tree, and the top consumer of each resource.
+ *
+ *  The cgroups come and go, and a metric is kept for the whole run, so
+ *  there is no series per cgroup of the tree (see "--cgroup=PATH").
+ *
+ *  @param tree The walker state, sampled.
+ *  @return Void.
+ */
+void emit_cgroup_tree(struct cgroup_tree *tree) {
+    double cpu = 0, memory = 0, io = 0;
+
+    for (int i = 0; i < CGTREE_BUCKETS; i ++) {
+        for (struct cgtree_entry *entry = tree->by_path[i]; entry; entry = entry->next_path) {
+            if (entry->path[0] == '\0') continue;  // the root is the whole host
+            if (entry->cpu_use > cpu) cpu = entry->cpu_use;
+            if (entry->memory > memory) memory = entry->memory;
+            if (entry->io_rate > io) io = entry->io_rate;
+        }
+    }
+    metric_emit("cgroups", "", tree->count);
+    metric_emit("cgtop.cpu", "cores", cpu);
+    metric_emit("cgtop.mem", "GB", memory * 1e-9);
+    metric_emit("cgtop.io", "MB/s", io * 1e-6);
+}
+
+/** @brief Fork the worker of the cgroup tree, which keeps the tree and its files.
+ *
+ *  The first walk of the tree is done by the worker when it starts, so
+ *  it counts in the deadline of its first run.
+ *
+ *  @param coll The cgroup tree collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_cgroup_tree(struct collector *coll, struct options *opt) {
+    static struct cgroup_tree tree; // state of the cgroup tree walker
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    cgroup_tree_init(&tree, opt->cgroup_top);
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            cgroup_tree_sample(&tree);
+            emit_cgroup_tree(&tree);
+        }
+        show_cgroup_tree(&tree);
+        worker_done();
+    }
+    cgroup_tree_close(&tree);
+    exit(0);
+}
+
+/** @brief Send the memory used and the allocation misses of each node.
+ *  @param numa The NUMA collector, sampled.
+ *  @return Void.
+ */
+void emit_numa(struct numa_stats *numa) {
+    for (int k = 0; k < numa->count; k ++) {
+        metric_emit_at("node", numa->node[k].id, "used", "GB", numa->node[k].used * 1e-9);
+        metric_emit_at("node", numa->node[k].id, "miss", "/s", numa->node[k].miss_rate);
+    }
+}
+
+/** @brief Fork the worker of the NUMA section, which keeps the files of each node open.
+ *  @param coll The NUMA collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_numa_info(struct collector *coll, struct options *opt) {
+    static struct numa_stats numa;  // state of the NUMA collector
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    numa_init(&numa);
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            numa_sample(&numa);
+            emit_numa(&numa);
+        }
+        show_numa_info(&numa, opt->graph);
+        worker_done();
+    }
+    numa_close(&numa);
+    exit(0);
+}
+
+/** @brief Send the interrupts and soft interrupts per second, over all their lines.
+ *  @param irq The interrupt collector, sampled.
+ *  @return Void.
+ */
+void emit_irq(struct irq_stats *irq) {
+    struct irq_table *tables[2] = {&irq->irq, &irq->softirq};
+    const char *names[2] = {"irq", "softirq"};
+
+    for (int k = 0; k < 2; k ++) {
+        double total = 0;
+        if (tables[k]->fd == -1) continue;
+        for (int j = 0; j < tables[k]->rows; j ++) {
+            total += tables[k]->rate[j];
+        }
+        metric_emit(names[k], "/s", total);
+    }
+}
+
+/** @brief Fork the worker of the interrupt section, which keeps the previous counts.
+ *  @param coll The interrupt collector.
+ *  @param opt The command line options (see struct options).
+ *  @return The pid of the worker.
+ */
+int read_irq_info(struct collector *coll, struct options *opt) {
+    struct irq_stats irq;           // state of the interrupt collector
+    int pid;
+
+    fflush(stdout);                 // not to be printed again by the worker
+    if ((pid = worker_fork(coll)) != 0) {
+        return pid;
+    }
+    set_signals_child();
+    irq_init(&irq);
+    for (int run = 0; worker_next(coll); run ++) {
+        if (run > 0) {
+            irq_sample(&irq);
+            emit_irq(&irq);
+        }
+        show_irq_info(&irq);
+        worker_done();
+    }
+    irq_close(&irq);
+    exit(0);
+}
+
+/** @brief The collector children and workers, read by the event loop (see
+ *  run_events), then the collectors of the parent (pressure, history and
+ *  anomalies), only timed.
+ */
+enum { COLL_MEMORY, COLL_USER, COLL_CPU, COLL_PERF, COLL_SCHED, COLL_DETAIL, COLL_CGROUP,
+    COLL_CGTREE, COLL_NUMA, COLL_IRQ, COLL_PARENT, COLLECTORS };
+
+/** @brief Run the event loop until the next tick, or until the collectors are done.
+ *
+ *  Each collector pipe is read as soon as its child writes, in any order.
+ *  Each child still running at its own deadline (see collector_start) is
+ *  killed and its collector marked stale. Meanwhile the signals are
+ *  handled, the answer to the quit question is read, and the PSI triggers
+ *  are reported as soon as they fire instead of at the next sample.
+ *
+ *  @param loop The event loop.
+ *  @param coll The collectors (COLLECTORS long).
+ *  @param psi The PSI collector state, or NULL if it is not used.
+ *  @param until EVENT_TICK to wait for the next tick, EVENT_COLLECTOR for the collectors.
+ *  @return 1, or 0 as soon as the program is asked to stop.
+ */
+int run_events(struct event_loop *loop, struct collector *coll, struct psi_stats *psi, int until) {
+    struct epoll_event events[EVENT_MAX];
+    int count, running;
+
+    for (;;) {
+        if (until == EVENT_TICK && loop->pending > 0) {
+            loop->pending = 0;
+            return 1;
+        }
+        for (int j = running = 0; j < COLLECTORS; j ++) {
+            running += coll[j].fd != -1;
+        }
+        if (until == EVENT_COLLECTOR && running == 0) {
+            return 1;
+        }
+        // an interactive program stops at the end of the sample
+        if (svc.stop && (until == EVENT_TICK || svc.daemon)) {
+            return 0;
+        }
+        event_watch_stdin(loop, svc.confirm);  // only while an answer is awaited
+
+        count = event_wait(loop, events);
+        for (int j = 0; j < count; j ++) {
+            int index = EVENT_INDEX(events[j].data.u64);
+            switch (EVENT_KIND(events[j].data.u64)) {
+            case EVENT_TICK:
+                event_tick(loop);
+                break;
+            case EVENT_DEADLINE:
+                if (event_expired(loop)) {
+                    collector_timeouts(loop, coll, COLLECTORS);
+                    collector_arm(loop, coll, COLLECTORS);  // the next deadline
+                }
+                break;
+            case EVENT_SIGNAL:
+                service_signals(&svc);
+                break;
+            case EVENT_STDIN:
+                if (svc.confirm) service_answer(&svc);
+                break;
+            case EVENT_COLLECTOR:
+                collector_read(loop, &coll[index]);
+                break;
+            case EVENT_PSI:
+                pressure_handle_trigger(psi, index);
+                break;
+            }
+        }
+    }
+}
+
+/** @brief Ask a worker for a run, forking it first if it is not running.
+ *
+ *  A worker killed at its deadline (or dead) is forked again, its state
+ *  starts over (e.g. no rate until its second run).
+ *
+ *  @param loop The event loop.
+ *  @param coll The collectors (COLLECTORS long).
+ *  @param index The collector of the worker.
+ *  @param opt The command line options (see struct options).
+ *  @param start The function forking the worker (e.g. read_user_info).
+ *  @return Void.
+ */
+void request_worker(struct event_loop *loop, struct collector *coll, int index, struct options *opt,
+    int (*start)(struct collector *, struct options *)) {
+    struct timespec due;                // the run is due now
+
+    if (coll[index].worker == -1) {
+        start(&coll[index], opt);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &due);
+    if (!collector_request(loop, &coll[index], index, &due, opt->timeout)) {
+        start(&coll[index], opt);       // it died since its last run
+        collector_request(loop, &coll[index], index, &due, opt->timeout);
+    }
+}
+
+/** @brief Compile the alert rules of the command line and of the rules file.
+ *  @param alerts The rules to initialize.
+ *  @param opt The command line options (see struct options).
+ *  @return Void.
+ */
+void load_alerts(struct alert_set *alerts, struct options *opt) {
+    alert_init(alerts, opt->alert_file, opt->alert_socket);
+    for (int j = 0; j < opt->alert_count; j ++) {
+        alert_add(alerts, opt->alert_rules[j]);  // checked by vertify_arg
+    }
+    if (opt->alert_rules_file != NULL && alert_load(alerts, opt->alert_rules_file) == -1) {
+        perror(opt->alert_rules_file);  // keep the rules of the command line
+    }
+}
+
+/** @brief Copy the values of this sample into the anomaly detector.
+ *
+ *  Every metric is a series, including the utilization of each core sent
+ *  by the scheduler worker. A series is added the first time it is seen.
+ *
+ *  @param anomalies The series of the anomaly detector.
+ *  @param metrics The metrics, with the values of the current sample.
+ *  @return Void.
+ */
+void feed_anomalies(struct anomaly_set *anomalies, struct metric_set *metrics) {
+    static int *metric_series = NULL;  // the series of each metric
+    static int series = 0;
+
+    if (metrics->count > series) {
+        if ((metric_series = realloc(metric_series, metrics->count * sizeof(int))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        for (; series < metrics->count; series ++) {
+            metric_series[series] = anomaly_add(anomalies, metrics->metric[series].name);
+        }
+    }
+    for (int j = 0; j < metrics->count; j ++) {
+        anomalies->value[metric_series[j]] = metrics->metric[j].value;
     }
 }
 
@@ -251,45 +823,136 @@ void read_user_info(int *fd) {
  *  for memory and CPU usage.
  *  If sequential flag is 1 (i.e. "--sequantial" is been called), print the
  *  sample sequentially without refreshing the screen.
+ *  The optional sections (e.g. "--cgroup") are printed below the CPU
+ *  section, each collector keeps its state in its worker between samples
+ *  (only the pressure, whose triggers are in the event loop, is read by
+ *  the parent).
  *
- *  @param sample Number of times the statistics are going to be collected.
- *  @param tdelay Period of time the statistics refresh (in seconds).
- *  @param sys An integer flag to indicate if "--system" is been called.
- *  @param user An integer flag to indicate if "--user" is been called.
- *  @param graph An integer flag to indicate if "--graphics" is been called.
- *  @param sequential An integer flag to indicate if "--sequential" is been called.
+ *  @param opt The command line options (see struct options).
  *  @return Void.
  */
-void show_sys_usage(int sample, int tdelay, int sys, int user, int graph, int sequential) {
-    // set up three pipes, fd[0] for communication of memory use,
-    // fd[1] for connected users, and fd[2] for CPU utilization
-    int fd[3][2];
+void show_sys_usage(struct options *opt) {
+    int sample = opt->sample, tdelay = opt->tdelay;
+    int sys = opt->sys, user = opt->user, graph = opt->graph, sequential = opt->sequential;
+
+    // set up two pipes, fd[0] for communication of memory use,
+    // and fd[1] for CPU utilization (the users come from a worker)
+    int fd[2][2];
 
-    double cpu_use, prev_used = -1;     // to store current memory / CPU usage
+    double prev_used = -1;              // to store current memory usage
+    struct cpu_report report;           // to store what the CPU child reports
     int n = 0;                          // to store number of users connected
-    char mem_info[512], user_info[512]; // to store the reported usage
-    FILE *mem_file, *user_file;         // to get what child write
+    int extra = 0;                      // to store number of optional section lines
+    char *mem_info;                     // to store the reported usage
+    static struct event_loop loop;      // the ticks, the collector pipes, the signals and stdin
+    static struct collector coll[COLLECTORS];  // what the children write, and their latencies
+    static const char *lat_metrics[COLLECTORS] = {"lat.memory", "lat.users", "lat.cpu",
+        "lat.perf", "lat.sched", "lat.detail", "lat.cgroup", "lat.cgtree", "lat.numa", "lat.irq",
+        "lat.parent"};
+    struct timespec start;              // when a collector started
+    int fresh;                          // whether the CPU report is of this sample
+    struct pollfd triggers[PSI_RESOURCES];     // the armed PSI triggers
+    int armed;                          // to store number of armed PSI triggers
+    pid_t pid;                          // to store the collector child
+    struct psi_stats psi;               // state of the pressure collector
+    char cgroup_root[PATH_MAX];         // where the cgroup v2 hierarchy is mounted
+    static struct sys_info info;        // the static system information
+    static struct metric_set metrics;   // the distribution of each metric
+    static const char *psi_metrics[PSI_RESOURCES] = {"psi.cpu", "psi.memory", "psi.io"};
+    double virt_used;                   // to store current virtual memory usage
+    static struct window_set cpu_windows, mem_windows;  // 1, 5 and 15 minute windows
+    static struct alert_set alerts;     // the compiled "--alert" rules
+    static struct anomaly_set anomalies; // the EWMA and median/MAD state of each series
+
+    int alerting = opt->alert_count > 0 || opt->alert_rules_file != NULL;
+
+    sys_info_init(&info);               // uname, cores, caches... read once
+    show_sys_info(&info);               // static, so printed once before the samples
+    if (opt->anomaly == 1) anomaly_init(&anomalies);
+    if (alerting) {
+        load_alerts(&alerts, opt);
+    }
+    if (sys == 1 && graph == 1) {
+        window_init(&cpu_windows, tdelay);
+        window_init(&mem_windows, tdelay);
+    }
+
+    // the optional collectors take their first sample in their workers
+    if (sys == 1 && opt->pressure == 1) {
+        pressure_init(&psi, opt->pressure_trigger);
+    }
+    if (sys == 1 && opt->cgroup == 1 && !cgroup_find_root(cgroup_root, sizeof(cgroup_root))) {
+        handle_error("No cgroup v2 hierarchy is mounted, \"--cgroup\" is not available.");
+    }
+    if (sys == 1 && opt->cgroup_top > 0 && !cgroup_find_root(cgroup_root, sizeof(cgroup_root))) {
+        handle_error("No cgroup v2 hierarchy is mounted, \"--cgroup-top=N\" is not available.");
+    }
+
+    // the samples start on the ticks, the children are read as they write
+    event_init(&loop, tdelay);
+    event_add(&loop, svc.sigfd, EPOLLIN, EVENT_SIGNAL, 0);
+    armed = sys == 1 && opt->pressure == 1 ? pressure_poll_fds(&psi, triggers) : 0;
+    for (int j = 0; j < armed; j ++) {
+        event_add(&loop, triggers[j].fd, EPOLLPRI, EVENT_PSI, triggers[j].fd);
+    }
+    collector_init(&coll[COLL_MEMORY], "memory");
+    collector_init(&coll[COLL_USER], user == 1 ? "users" : "procs");
+    collector_init(&coll[COLL_CPU], "cpu");
+    collector_init(&coll[COLL_PERF], "perf");
+    collector_init(&coll[COLL_SCHED], "sched");
+    collector_init(&coll[COLL_DETAIL], "detail");
+    collector_init(&coll[COLL_CGROUP], "cgroup");
+    collector_init(&coll[COLL_CGTREE], "cgtree");
+    collector_init(&coll[COLL_NUMA], "numa");
+    collector_init(&coll[COLL_IRQ], "irq");
+    collector_init(&coll[COLL_PARENT], "parent");
+    if (opt->daemon == 1) {
+        service_notify("READY=1");  // the collectors are started
+    }
 
     // sampling sample times to get the update of system usage
     for (int i = 0; i < sample; i ++) {
+        if (!run_events(&loop, coll, opt->pressure == 1 ? &psi : NULL, EVENT_TICK)) {
+            break;                          // stopped between two samples
+        }
         if (sys == 1) {
-            // create child processes to report system usage
-            read_memory_info(fd[0], prev_used, graph);
-            read_cpu_info(fd[2], tdelay);
+            // create child processes to report system usage, each is due
+            // when forked, except the CPU child which reads "/proc/stat"
+            // again at the next tick
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            pid = read_memory_info(fd[0], prev_used, graph);
+            collector_start(&loop, &coll[COLL_MEMORY], COLL_MEMORY, pid, fd[0][STDIN_FILENO],
+                &start, opt->timeout);
+            pid = read_cpu_info(fd[1], &loop.next_tick);
+            collector_start(&loop, &coll[COLL_CPU], COLL_CPU, pid, fd[1][STDIN_FILENO],
+                &loop.next_tick, opt->timeout);
 
-            // open a file to read what child write
-            if ((mem_file = fdopen(fd[0][STDIN_FILENO], "r")) == NULL) {
-                perror("fdopen");
-                exit(1);
+            // the optional collectors, each in its worker
+            if (opt->perf == 1) request_worker(&loop, coll, COLL_PERF, opt, read_perf_info);
+            if (opt->schedstat == 1 || opt->cpufreq == 1) {
+                request_worker(&loop, coll, COLL_SCHED, opt, read_sched_info);
             }
+            if (opt->memory_detail == 1) request_worker(&loop, coll, COLL_DETAIL, opt, read_memory_detail);
+            if (opt->cgroup == 1) request_worker(&loop, coll, COLL_CGROUP, opt, read_cgroup_info);
+            if (opt->cgroup_top > 0) request_worker(&loop, coll, COLL_CGTREE, opt, read_cgroup_tree);
+            if (opt->numa == 1) request_worker(&loop, coll, COLL_NUMA, opt, read_numa_info);
+            if (opt->interrupts == 1) request_worker(&loop, coll, COLL_IRQ, opt, read_irq_info);
         }
 
-        if (user == 1) {
-            read_user_info(fd[1]);  // create child processes to report user
-            // open a file to read what child write
-            if ((user_file = fdopen(fd[1][STDIN_FILENO], "r")) == NULL) {
-                perror("fdopen");
-                exit(1);
+        if (user == 1 || (sys == 1 && (opt->trend == 1 || opt->anomaly == 1))) {
+            // the worker reporting user keeps the session list and the processes between the runs
+            request_worker(&loop, coll, COLL_USER, opt, read_user_info);
+        }
+
+        // read the children in the order they write, kill each one past its deadline
+        collector_arm(&loop, coll, COLLECTORS);
+        if (!run_events(&loop, coll, opt->pressure == 1 ? &psi : NULL, EVENT_COLLECTOR)) {
+            break;                          // a daemon was asked to stop
+        }
+        for (int j = 0; j < COLLECTORS; j ++) {
+            // the workers send their values with their sections (see metric_emit)
+            if (coll[j].done && coll[j].worker != -1) {
+                coll[j].last_len = metric_take(&metrics, coll[j].last);
             }
         }
 
@@ -304,7 +967,7 @@ void show_sys_usage(int sample, int tdelay, int sys, int user, int graph, int se
             // print the title for memory use section
             printf("### Memory ### (Phys.Used/Tot -- Virtual Used/Tot)\n");
             // print empty lines reserving space for memory usage
-            for (int j = 0; j < i; j ++) {
+            for (int j = 0; opt->daemon == 0 && j < i; j ++) {
                 printf("\n");
             }
         }
@@ -312,32 +975,44 @@ void show_sys_usage(int sample, int tdelay, int sys, int user, int graph, int se
         if (sys == 1) {
             // if sequential is not called, need to refresh the screen
             if (sequential == 0 && i != 0) {
+                move_up(extra);              // move up through the optional sections
+                printf("\033[J");            // erase them, they are printed again
                 move_up(sample - i + 3);     // move up to the memory section
                 if (user == 1) move_up(n);   // move through the user section
                 if (graph == 1) move_up(i);  // move through the cpu graph
             }
 
-            // Read from child 1 (get memory information)
-            if (fgets(mem_info, 512, mem_file) == NULL) {
-                perror("fgets");
-                exit(1);
+            // What child 1 wrote (memory information)
+            mem_info = coll[COLL_MEMORY].last;
+            if (!coll[COLL_MEMORY].done && coll[COLL_MEMORY].good) {
+                // the last good line, without the windows of the graph
+                printf("%.*s  [stale %.0fs]\n", (int) strcspn(mem_info, "\n"), mem_info,
+                    collector_age(&coll[COLL_MEMORY]));
+            } else if (!coll[COLL_MEMORY].done) {
+                show_collector_stale(&coll[COLL_MEMORY]);
             } else {
-                // print the information, and store current memory use
-                printf("%s", mem_info);
-                if (sscanf(mem_info, "%lf GB / ", &prev_used) == -1) {
+                // store current memory use, and print the information
+                if (sscanf(mem_info, "%lf GB / %*f GB -- %lf", &prev_used, &virt_used) != 2) {
                     perror("sscanf");
                     exit(1);
                 }
+                metric_record(&metrics, "mem.used", "GB", prev_used);
+                metric_record(&metrics, "mem.virt", "GB", virt_used);
+                if (graph == 1) {
+                    // the windows are kept in parent, append them to the child's graph
+                    window_push(&mem_windows, prev_used);
+                    mem_info[strcspn(mem_info, "\n")] = '\0';
+                    printf("%s", mem_info);
+                    show_window(&mem_windows);
+                    printf("\n");
+                } else {
+                    printf("%s", mem_info);
+                }
             }
             // print empty lines reserving space for memory usage
-            for (int j = 1; j < sample - i; j ++) {
+            for (int j = 1; opt->daemon == 0 && j < sample - i; j ++) {
                 printf("\n");
             }
-            if (fclose(mem_file) < 0) {  // close the according file
-                perror("fclose");
-                exit(1);
-            }
-            close(fd[0][STDIN_FILENO]);  // close the reading end in parent
             printf("---------------------------------------\n");
         }
 
@@ -345,42 +1020,146 @@ void show_sys_usage(int sample, int tdelay, int sys, int user, int graph, int se
             // if we only want to refresh user section, move up the cursor
             if (sys == 0 && sequential == 0 && i != 0) move_up(n);
 
-            n = 0;    // stores number of user samples
-            // Now read from child 2
-            while (fgets(user_info, 512, user_file) != NULL) {
-                printf("%s", user_info);
-                n ++;
-            }
-            if (fclose(user_file) < 0) { // close the according file
-                perror("fclose");
-                exit(1);
-            }
-            close(fd[1][STDIN_FILENO]);  // close the reading end in parent
-            if (sys == 0) sleep(tdelay); // if system is not called, sleep
+            // Now print what the worker wrote (or the last good list), line by line
+            n = show_collector_part(&coll[COLL_USER], 0);  // stores number of user samples
         }
 
         if (sys == 1) {
-            // Now read from child 3 (cpu usage)
-            if (read(fd[2][STDIN_FILENO], &cpu_use, sizeof(double)) < 0) {
-                perror("read");
-                exit(1);
-            } else {
-                show_cpu_info(cpu_use); // print cpu information (core + cpu usage)
+            // Now what child 3 wrote (cpu usage), or its last good report
+            extra = 0;
+            fresh = coll[COLL_CPU].done && coll[COLL_CPU].last_len == sizeof(report);
+            if (fresh) {
+                memcpy(&report, coll[COLL_CPU].last, sizeof(report));
+                metric_record(&metrics, "cpu", "%", report.cpu_use);
+                metric_record(&metrics, "load1", "", report.load[0]);
+                metric_record(&metrics, "procs.running", "", report.procs_running);
+                metric_record(&metrics, "ctxt", "/s", report.ctxt_rate);
+                metric_record(&metrics, "intr", "/s", report.intr_rate);
+                metric_record(&metrics, "forks", "/s", report.fork_rate);
+                if (graph == 1) window_push(&cpu_windows, report.cpu_use);
+            }
+            sys_info_refresh(&info);           // re-read the topology on a CPU hotplug
+            if (fresh || (coll[COLL_CPU].good && coll[COLL_CPU].last_len == sizeof(report))) {
+                show_cpu_info(report.cpu_use, info.cores); // print cpu information (core + cpu usage)
 
                 if (sequential == 1 && graph == 1) {
-                    show_cpu_graph(cpu_use);  // show cpu graph if applied
+                    show_cpu_graph(report.cpu_use, &cpu_windows);  // show cpu graph if applied
                 } else if (graph == 1) {
                     if (i != 0) move_down(i); // move down to the right position
-                    show_cpu_graph(cpu_use);  // show cpu graph if applied
+                    show_cpu_graph(report.cpu_use, &cpu_windows);  // show cpu graph if applied
                 }
+
+                // the run queue lines are refreshed like the optional sections
+                extra = show_cpu_load(&report, info.cores);
+            } else {
+                printf("Number of cores: %d\n", info.cores);
+                printf(" total cpu use = ?\n");
+                if (graph == 1) {
+                    if (sequential == 0 && i != 0) move_down(i);
+                    printf("\t?\n");
+                }
+            }
+            if (!fresh) {
+                extra += show_collector_stale(&coll[COLL_CPU]);
+            }
+
+            // the sections of the workers, or their last good output marked stale
+            if (opt->perf == 1) extra += show_collector_part(&coll[COLL_PERF], 0);
+            if (opt->schedstat == 1) extra += show_collector_part(&coll[COLL_SCHED], 0);
+            if (opt->cpufreq == 1) extra += show_collector_part(&coll[COLL_SCHED], 1);
+            if (opt->memory_detail == 1) extra += show_collector_part(&coll[COLL_DETAIL], 0);
+            if (opt->trend == 1) {
+                // computed by the worker of the users, with the same process cache
+                extra += show_collector_part(&coll[COLL_USER], 1);
+            }
+
+            // the collectors of the parent are only timed, they cannot be killed
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if (opt->pressure == 1) {
+                pressure_sample(&psi);
+                extra += show_pressure_info(&psi);
+                for (int j = 0; j < PSI_RESOURCES; j ++) {
+                    if (psi.res[j].fd != -1) {
+                        metric_record(&metrics, psi_metrics[j], "%", psi.res[j].some.stall);
+                    }
+                }
+            }
+            if (opt->cgroup == 1) extra += show_collector_part(&coll[COLL_CGROUP], 0);
+            if (opt->cgroup_top > 0) extra += show_collector_part(&coll[COLL_CGTREE], 0);
+            if (opt->numa == 1) extra += show_collector_part(&coll[COLL_NUMA], 0);
+            if (opt->interrupts == 1) extra += show_collector_part(&coll[COLL_IRQ], 0);
+            if (opt->history == 1) {
+                extra += show_metric_history(&metrics);
+            }
+            if (opt->anomaly == 1) {
+                feed_anomalies(&anomalies, &metrics);
+                anomaly_update(&anomalies);
+                extra += show_anomalies(&anomalies, "Anomalies");
+                // the processes are judged by their worker, with the process cache
+                extra += show_collector_part(&coll[COLL_USER], 2);
             }
-            close(fd[2][STDIN_FILENO]); // close the reading end in parent
+            collector_note(&coll[COLL_PARENT], &start);
+        }
+        if (opt->collectors == 1) {
+            for (int j = 0; j < COLLECTORS; j ++) {
+                if (coll[j].done) metric_record(&metrics, lat_metrics[j], "ms", coll[j].latency);
+            }
+            if (sys == 1) {
+                extra += show_collectors(&loop, coll, COLLECTORS);
+            } else {
+                n += show_collectors(&loop, coll, COLLECTORS);  // refreshed with the users
+            }
+        }
+        if (alerting) {
+            alert_eval(&alerts, &metrics);  // against the values of this sample
+        }
+        service_signals(&svc);              // what came after the wait
+        if (svc.summary) {
+            // on stderr, so that the refreshed screen is not shifted
+            svc.summary = 0;
+            show_metric_summary(&metrics, stderr);
+        }
+        if (opt->daemon == 1 && svc.reload) {
+            // SIGHUP: reopen the outputs (rotated by now) and reload the rules
+            svc.reload = 0;
+            svc.reloads ++;
+            service_notify("RELOADING=1");
+            service_reopen(&svc);
+            if (alerting) {
+                alert_close(&alerts);
+                load_alerts(&alerts, opt);
+            }
+            fprintf(stderr, "Reloaded: %d alert rules\n", alerting ? alerts.count : 0);
+            service_notify("READY=1");
+        }
+        if (svc.stop) {
+            break;                          // SIGTERM, or Ctrl-C answered 'y'
         }
+        service_prompt(&svc, sequential);   // Ctrl-C, not answered yet
+        if (opt->daemon == 1) {
+            fflush(stdout);                 // the output file may be followed
+        }
+    }
+    if (opt->daemon == 1) {
+        service_notify("STOPPING=1");
+    }
+    for (int j = 0; j < COLLECTORS; j ++) {
+        collector_close(&loop, &coll[j]);  // kill the children of an interrupted sample
     }
+    event_close(&loop);
     if (sys == 1) {
         printf("---------------------------------------\n");
+        if (opt->pressure == 1) pressure_close(&psi);
+        if (graph == 1) {
+            window_close(&cpu_windows);
+            window_close(&mem_windows);
+        }
     }
-    show_sys_info();
+    if (alerting) alert_close(&alerts);
+    if (opt->anomaly == 1) anomaly_close(&anomalies);
+    show_metric_summary(&metrics, stdout);  // the percentiles of the whole run
+    sys_info_close(&info);
+    service_close(&svc);
 }
 
 /** @brief Validate the command line arguments user gived.
@@ -394,62 +1173,133 @@ void show_sys_usage(int sample, int tdelay, int sys, int user, int graph, int se
  *
  *  @param argc Number of ommand line arguments.
  *  @param argv The array of strings storing command line arguments.
- *  @param sample Number of times the statistics are going to be collected.
- *  @param tdelay Period of time the statistics refresh (in seconds).
- *  @param sys_flag Point to an integer to indicate if "--system" is been called
- *  @param user_flag Point to an integer to indicate if "--user" is been called
- *  @param sequential_flag Point to an integer to indicate if "--sequential" is been called
- *  @param graph_flag Point to an integer to indicate if "--graphics" is been called
- *  @param sample_flag Point to an integer to indicate if "--sample=N" is been called
- *  @param tdelay_flag Point to an integer to indicate if "--tdelay=T" is been called
+ *  @param opt Point to the options to fill (see struct options).
  *  @return Void.
  */
-void vertify_arg(int argc, char *argv[], int *sample, int *tdelay, int *sys_flag,
-    int *user_flag, int *sequential_flag, int *graph_flag, int *sample_flag, int *tdelay_flag) {
+void vertify_arg(int argc, char *argv[], struct options *opt) {
 
     int tmp_sample;  // Store temporary sample size
     int tmp_tdelay;  // Store temporary tdelay secs
     int positional;  // Store temporary positional argument
     int positional_arg = 0;  // Store the number of positional arguments
+    long tmp_trigger;        // Store temporary PSI trigger threshold
 
     for (int i = 1; i < argc; i ++) {
         if (strcmp(argv[i], "--system") == 0) {
-            *sys_flag = 1;   // set the flag to 1
+            opt->sys = 1;   // set the flag to 1
         } else if (strcmp(argv[i], "--user") == 0) {
-            *user_flag = 1;  // set the flag to 1
+            opt->user = 1;  // set the flag to 1
         } else if (strcmp(argv[i], "--graphics") == 0) {
-            *graph_flag = 1; // set the flag to 1
+            opt->graph = 1; // set the flag to 1
         } else if (strcmp(argv[i], "--sequential") == 0) {
-            *sequential_flag = 1; // set the flag to 1
+            opt->sequential = 1; // set the flag to 1
+        } else if (strcmp(argv[i], "--pressure") == 0) {
+            opt->pressure = 1;  // set the flag to 1
+        } else if (sscanf(argv[i], "--pressure-trigger=%ld", &tmp_trigger) == 1) {
+            if (tmp_trigger <= 0) {
+                handle_error("The value given to \"--pressure-trigger=US\" should be an positive integer!");
+            }
+            opt->pressure = 1;  // arming triggers implies the pressure section
+            opt->pressure_trigger = tmp_trigger;
+        } else if (strcmp(argv[i], "--memory-detail") == 0) {
+            opt->memory_detail = 1;  // set the flag to 1
+        } else if (strcmp(argv[i], "--interrupts") == 0) {
+            opt->interrupts = 1;     // set the flag to 1
+        } else if (strcmp(argv[i], "--schedstat") == 0) {
+            opt->schedstat = 1;      // set the flag to 1
+        } else if (strcmp(argv[i], "--cpufreq") == 0) {
+            opt->cpufreq = 1;        // set the flag to 1
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            opt->perf = 1;           // set the flag to 1
+        } else if (strcmp(argv[i], "--alert") == 0 || strncmp(argv[i], "--alert=", 8) == 0) {
+            // the rule is either after '=' or the next argument (it has spaces)
+            char *rule = argv[i][7] == '=' ? argv[i] + 8 : (i + 1 < argc ? argv[++ i] : "");
+            struct alert_rule compiled;
+            if (opt->alert_count == ALERT_MAX) {
+                handle_error("Too many \"--alert=RULE\" arguments!");
+            }
+            if (!alert_parse(rule, &compiled)) {
+                handle_error("The rule given to \"--alert\" should look like 'cpu>90 for 5s' or 'mem.used rate>1GB/min'!");
+            }
+            opt->alert_rules[opt->alert_count ++] = rule;
+        } else if (strncmp(argv[i], "--alert-file=", 13) == 0) {
+            opt->alert_file = argv[i] + 13;    // append the alerts to a file
+        } else if (strncmp(argv[i], "--alert-socket=", 15) == 0) {
+            opt->alert_socket = argv[i] + 15;  // send the alerts to a local socket
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            opt->daemon = 1;         // set the flag to 1
+        } else if (strncmp(argv[i], "--output=", 9) == 0) {
+            if (argv[i][9] == '\0') {
+                handle_error("The value given to \"--output=PATH\" should be a file!");
+            }
+            opt->output = argv[i] + 9;     // append the samples of "--daemon" to a file
+        } else if (strncmp(argv[i], "--alert-rules=", 14) == 0) {
+            if (argv[i][14] == '\0') {
+                handle_error("The value given to \"--alert-rules=PATH\" should be a file!");
+            }
+            opt->alert_rules_file = argv[i] + 14;  // one rule per line, reloaded on SIGHUP
+        } else if (sscanf(argv[i], "--timeout=%ld", &opt->timeout) == 1) {
+            if (opt->timeout <= 0) {
+                handle_error("The value given to \"--timeout=MS\" should be an positive integer!");
+            }
+        } else if (strcmp(argv[i], "--collectors") == 0) {
+            opt->collectors = 1;     // set the flag to 1
+        } else if (strcmp(argv[i], "--trend") == 0) {
+            opt->trend = 1;          // set the flag to 1
+        } else if (strcmp(argv[i], "--anomaly") == 0) {
+            opt->anomaly = 1;        // set the flag to 1
+        } else if (strcmp(argv[i], "--history") == 0) {
+            opt->history = 1;        // set the flag to 1
+        } else if (strcmp(argv[i], "--session-usage") == 0) {
+            opt->session_usage = 1;  // set the flag to 1
+        } else if (strncmp(argv[i], "--utmp=", 7) == 0) {
+            if (argv[i][7] == '\0') {
+                handle_error("The value given to \"--utmp=PATH\" should be a file!");
+            }
+            opt->utmp_path = argv[i] + 7;  // read the sessions from another file
+        } else if (strcmp(argv[i], "--numa") == 0) {
+            opt->numa = 1;      // set the flag to 1
+        } else if (strcmp(argv[i], "--cgroup") == 0) {
+            opt->cgroup = 1;    // set the flag to 1, detect the cgroup
+        } else if (sscanf(argv[i], "--cgroup-top=%d", &opt->cgroup_top) == 1) {
+            if (opt->cgroup_top <= 0 || opt->cgroup_top > CGTREE_TOP_MAX) {
+                handle_error("The value given to \"--cgroup-top=N\" should be between 1 and 32!");
+            }
+        } else if (strncmp(argv[i], "--cgroup=", 9) == 0) {
+            if (opt->cgroup_count == CGROUP_MAX) {
+                handle_error("Too many \"--cgroup=PATH\" arguments!");
+            }
+            opt->cgroup = 1;    // set the flag to 1, and store the path
+            opt->cgroup_paths[opt->cgroup_count ++] = argv[i] + 9;
         } else if (sscanf(argv[i], "--samples=%d", &tmp_sample) == 1) {
-            if (*sample_flag == 0) {
+            if (opt->sample_f == 0) {
                 // If this is the first "--samples=N" argument called,
                 // set the sample value to the input sample value
                 // and label sample_flag to 1.
-                *sample = tmp_sample;
-                *sample_flag = 1;
-            } else if (*sample != tmp_sample) {
+                opt->sample = tmp_sample;
+                opt->sample_f = 1;
+            } else if (opt->sample != tmp_sample) {
                 // If this value does not corresponds to other sample size value,
                 // print an error message.
                 handle_error("The value given to \"--samples=N\" should be consistent!");
             }
-            if (*sample <= 0) {
+            if (opt->sample <= 0) {
                 // If the value is negative, print an error messgae
                 handle_error("The value given to \"--samples=N\" should be an positive integer!");
             }
         } else if (sscanf(argv[i], "--tdelay=%d", &tmp_tdelay) == 1) {
-            if (*tdelay_flag == 0) {
+            if (opt->tdelay_f == 0) {
                 // If this is the first "--tdelay=T" argument called,
                 // set the tdelay value to the input tdelay value
                 // and label tdelay_flag to 1.
-                *tdelay = tmp_tdelay;
-                *tdelay_flag = 1;
-            } else if (*tdelay != tmp_tdelay) {
+                opt->tdelay = tmp_tdelay;
+                opt->tdelay_f = 1;
+            } else if (opt->tdelay != tmp_tdelay) {
                 // If this value does not corresponds to previous tdelay value,
                 // print an error message.
                 handle_error("The value given to \"--tdelay=T\" should be consistent!");
             }
-            if (*tdelay < 0) {
+            if (opt->tdelay < 0) {
                 // If the value is negative, print an error messgae
                 handle_error("The value given to \"--tdelay=T\" should be an positive integer");
             }
@@ -458,30 +1308,30 @@ void vertify_arg(int argc, char *argv[], int *sample, int *tdelay, int *sys_flag
             if (positional_arg == 0) {
                 // If this is the first integer appeared in the arguments,
                 // this would be the sample size value.
-                if (*sample_flag == 0 || *sample == positional) {
+                if (opt->sample_f == 0 || opt->sample == positional) {
                     // If it corresponds to other sample size value (if exists),
                     // set sample value to positional and label sample_flag as 1
-                    *sample = positional;
-                    *sample_flag = 1;
+                    opt->sample = positional;
+                    opt->sample_f = 1;
                 } else {
                     handle_error("The value given to \"--samples=N\" should be consistent!");
                 }
-                if (*sample <= 0) {
+                if (opt->sample <= 0) {
                     // If the value is negative, print an error messgae
                     handle_error("The value given to \"--samples=N\" should be an positive integer!");
                 }
             } else if (positional_arg == 1) {
                 // If this is the second integer appeared in the arguments,
                 // this would be the tdelay value.
-                if (*tdelay_flag == 0 || *tdelay == positional) {
+                if (opt->tdelay_f == 0 || opt->tdelay == positional) {
                     // If it corresponds to previous tdelay value (if exists),
                     // set tdelay to positional and label tdelay_flag as 1
-                    *tdelay = positional;
-                    *tdelay_flag = 1;
+                    opt->tdelay = positional;
+                    opt->tdelay_f = 1;
                 } else {
                     handle_error("The value given to \"--tdelay=T\" should be consistent!");
                 }
-                if (*sample <= 0) {
+                if (opt->sample <= 0) {
                     // If the value is negative, print an error messgae
                     handle_error("The value given to \"--tdelay=T\" should be an positive integer!");
                 }
@@ -506,30 +1356,41 @@ void vertify_arg(int argc, char *argv[], int *sample, int *tdelay, int *sys_flag
  *  @return An integer.
  */
 int main (int argc, char *argv[]) {
-    // initialize sample and tdelay to their defalut value
-    int sample = 10, tdelay = 1;
+    // initialize sample and tdelay to their defalut value, and
     // create flags for each argument to check if they're called
-    int sys = 0, user = 0, sequential = 0, graph = 0, sample_f = 0, tdelay_f = 0;
+    struct options opt = {0};
+    opt.sample = 10;
+    opt.tdelay = 1;
+    opt.timeout = COLLECTOR_TIMEOUT_MS;
 
     // validate the arguments
-    vertify_arg(argc, argv, &sample, &tdelay, &sys, &user, &sequential, &graph,
-        &sample_f, &tdelay_f);
+    vertify_arg(argc, argv, &opt);
+
+    if (opt.daemon == 1) {
+        // headless: one sample after the other, until SIGTERM unless N is given
+        opt.sequential = 1;
+        if (opt.sample_f == 0) opt.sample = INT_MAX;
+    }
 
     // print the values of sample size and tdelay
-    printf("Nbr of samples: %d -- every %d secs\n", sample, tdelay);
+    if (opt.sample == INT_MAX) {
+        printf("Nbr of samples: until SIGTERM -- every %d secs\n", opt.tdelay);
+    } else {
+        printf("Nbr of samples: %d -- every %d secs\n", opt.sample, opt.tdelay);
+    }
 
     // set defalut behaviour
     // if no "--system" or "--user" called, display the usage for both
-    if (sys == 0 && user == 0) {
-        sys = 1;
-        user = 1;
+    if (opt.sys == 0 && opt.user == 0) {
+        opt.sys = 1;
+        opt.user = 1;
     }
 
-    // set signals for the parent
-    set_signals_parent();
+    // read the signals in the main loop (and print a daemon to its output file)
+    service_init(&svc, opt.daemon, opt.output);
 
     // Display system (Memory / User / CPU) usage information
-    show_sys_usage(sample, tdelay, sys, user, graph, sequential);
+    show_sys_usage(&opt);
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,189 @@
+/** @file numa_stats.c
+ *  @brief Report the memory usage and locality of each NUMA node
+ *
+ *  This file includes the functions that read the per-node "meminfo" and
+ *  "numastat" files, so that one exhausted node on a multi-socket machine
+ *  is not hidden by the global memory usage, and that allocations served
+ *  by a remote node (numa_miss / numa_foreign) are visible.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "numa_stats.h"
+
+#define NUMA_BAR_WIDTH 40   // the number of characters of a node bar
+
+/** @brief Compare two nodes by id, for qsort().
+ *  @param a The first node.
+ *  @param b The second node.
+ *  @return A negative, zero or positive integer.
+ */
+static int numa_compare(const void *a, const void *b) {
+    return ((const struct numa_node *) a)->id - ((const struct numa_node *) b)->id;
+}
+
+/** @brief Re-read the files of one node.
+ *
+ *  Each line of "meminfo" looks like "Node 0 MemTotal:  16303420 kB", and
+ *  each line of "numastat" like "numa_hit 123456".
+ *
+ *  @param node The node to read.
+ *  @return Void.
+ */
+static void numa_read(struct numa_node *node) {
+    char buf[4096], key[64];   // the content of the file, and each key
+    long long value, file_pages = 0, sreclaimable = 0;
+    unsigned long long count;
+    ssize_t len;
+    char *line;
+
+    if ((len = pread(node->meminfo_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[len] = '\0';
+        for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+            if (*line == '\n') line ++;
+            if (sscanf(line, "Node %*d %63[^:]: %lld", key, &value) != 2) continue;
+            if (strcmp(key, "MemTotal") == 0) node->total = value * 1024;
+            else if (strcmp(key, "MemFree") == 0) node->free = value * 1024;
+            else if (strcmp(key, "FilePages") == 0) file_pages = value * 1024;
+            else if (strcmp(key, "SReclaimable") == 0) sreclaimable = value * 1024;
+        }
+        // Same as the global formula, FilePages includes buffers and cache
+        node->used = node->total - node->free - (file_pages + sreclaimable);
+    }
+
+    if ((len = pread(node->numastat_fd, buf, sizeof(buf) - 1, 0)) > 0) {
+        buf[len] = '\0';
+        for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+            if (*line == '\n') line ++;
+            if (sscanf(line, "%63s %llu", key, &count) != 2) continue;
+            if (strcmp(key, "numa_hit") == 0) node->hit = count;
+            else if (strcmp(key, "numa_miss") == 0) node->miss = count;
+            else if (strcmp(key, "numa_foreign") == 0) node->foreign = count;
+        }
+    }
+}
+
+/** @brief Find the NUMA nodes and take the first sample.
+ *
+ *  List "/sys/devices/system/node/node*", and open the "meminfo" and
+ *  "numastat" files of each node once for the whole run.
+ *
+ *  @param numa The collector state to initialize.
+ *  @return The number of nodes found.
+ */
+int numa_init(struct numa_stats *numa) {
+    char path[128];
+    struct dirent *dirent;
+    DIR *stream;
+    int id;
+
+    memset(numa, 0, sizeof(*numa));
+    time_since(&numa->last);
+    // A kernel without NUMA support has no node directory, report no node
+    if ((stream = opendir("/sys/devices/system/node")) == NULL) {
+        return 0;
+    }
+    while ((dirent = readdir(stream)) != NULL && numa->count < NUMA_MAX_NODES) {
+        if (sscanf(dirent->d_name, "node%d", &id) != 1) continue;
+
+        struct numa_node *node = &numa->node[numa->count];
+        node->id = id;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", id);
+        node->meminfo_fd = open(path, O_RDONLY | O_CLOEXEC);
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/numastat", id);
+        node->numastat_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (node->meminfo_fd == -1 || node->numastat_fd == -1) {
+            if (node->meminfo_fd != -1) close(node->meminfo_fd);
+            if (node->numastat_fd != -1) close(node->numastat_fd);
+            continue;
+        }
+
+        numa_read(node);
+        node->hit_prev = node->hit;
+        node->miss_prev = node->miss;
+        node->foreign_prev = node->foreign;
+        numa->count ++;
+    }
+    closedir(stream);
+
+    // readdir() does not list the nodes in order
+    qsort(numa->node, numa->count, sizeof(struct numa_node), numa_compare);
+    return numa->count;
+}
+
+/** @brief Re-read the files of every node and compute the numastat rates.
+ *
+ *  rate (pages/sec) = (counter_curr - counter_prev) / interval
+ *
+ *  @param numa The collector state.
+ *  @return Void.
+ */
+void numa_sample(struct numa_stats *numa) {
+    double interval = time_since(&numa->last);
+
+    for (int i = 0; i < numa->count; i ++) {
+        struct numa_node *node = &numa->node[i];
+        numa_read(node);
+        if (interval > 0) {
+            node->hit_rate = (node->hit - node->hit_prev) / interval;
+            node->miss_rate = (node->miss - node->miss_prev) / interval;
+            node->foreign_rate = (node->foreign - node->foreign_prev) / interval;
+        }
+        node->hit_prev = node->hit;
+        node->miss_prev = node->miss;
+        node->foreign_prev = node->foreign;
+    }
+}
+
+/** @brief Prints the NUMA section.
+ *
+ *  If the "--graphics" argument is used, also draw a bar per node, where
+ *  '#' denotes the used memory and '-' the free memory of the node.
+ *
+ *  @param numa The collector state.
+ *  @param graph_flag An interger indicating whether "--graphics" argument is used.
+ *  @return The number of lines printed.
+ */
+int show_numa_info(struct numa_stats *numa, int graph_flag) {
+    int lines = 1;   // the number of lines printed
+
+    printf("### NUMA ### (Used/Tot -- Free, numa_hit/miss/foreign pages/s)\n");
+    if (numa->count == 0) {
+        printf(" no NUMA node found\n");
+        lines ++;
+    }
+    for (int i = 0; i < numa->count; i ++) {
+        struct numa_node *node = &numa->node[i];
+        double percent = node->total > 0 ? 100.0 * node->used / node->total : 0.0;
+
+        printf(" node%d  %.2f GB / %.2f GB  -- %.2f GB free  hit %.0f  miss %.0f  foreign %.0f\n",
+            node->id, node->used * 1e-9, node->total * 1e-9, node->free * 1e-9,
+            node->hit_rate, node->miss_rate, node->foreign_rate);
+        lines ++;
+
+        if (graph_flag == 1) {
+            // '#' in proportion to the used memory, '-' for the rest
+            int used = (int) (percent * NUMA_BAR_WIDTH / 100);
+            printf("        |");
+            for (int j = 0; j < NUMA_BAR_WIDTH; j ++) {
+                printf("%c", j < used ? '#' : '-');
+            }
+            printf("| %.2f%%\n", percent);
+            lines ++;
+        }
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Close every file opened by the collector.
+ *  @param numa The collector state.
+ *  @return Void.
+ */
+void numa_close(struct numa_stats *numa) {
+    for (int i = 0; i < numa->count; i ++) {
+        close(numa->node[i].meminfo_fd);
+        close(numa->node[i].numastat_fd);
+    }
+}
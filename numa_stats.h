@@ -0,0 +1,73 @@
+/*
+ * Header file for the NUMA node memory and locality collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef __Numa_header
+#define __Numa_header
+
+#define NUMA_MAX_NODES 64   // the maximum number of nodes reported
+
+/** @brief State of one NUMA node kept between two samples. */
+struct numa_node {
+    int id;                  // the node number
+    int meminfo_fd;          // fd of ".../nodeN/meminfo"
+    int numastat_fd;         // fd of ".../nodeN/numastat"
+    long long total, free;   // MemTotal and MemFree (in bytes)
+    long long used;          // MemTotal - MemFree - (FilePages + SReclaimable)
+    unsigned long long hit, miss, foreign;  // numastat counters (in pages)
+    unsigned long long hit_prev, miss_prev, foreign_prev;
+    double hit_rate, miss_rate, foreign_rate;  // pages per second
+};
+
+/** @brief State of the NUMA collector. */
+struct numa_stats {
+    int count;               // number of nodes
+    struct numa_node node[NUMA_MAX_NODES];
+    struct timespec last;    // time of the previous sample
+};
+
+/** @brief Find the NUMA nodes and take the first sample.
+ *
+ *  List "/sys/devices/system/node/node*", and open the "meminfo" and
+ *  "numastat" files of each node once for the whole run.
+ *
+ *  @param numa The collector state to initialize.
+ *  @return The number of nodes found.
+ */
+int numa_init(struct numa_stats *numa);
+
+/** @brief Re-read the files of every node and compute the numastat rates.
+ *
+ *  rate (pages/sec) = (counter_curr - counter_prev) / interval
+ *
+ *  @param numa The collector state.
+ *  @return Void.
+ */
+void numa_sample(struct numa_stats *numa);
+
+/** @brief Prints the NUMA section.
+ *
+ *  If the "--graphics" argument is used, also draw a bar per node, where
+ *  '#' denotes the used memory and '-' the free memory of the node.
+ *
+ *  @param numa The collector state.
+ *  @param graph_flag An interger indicating whether "--graphics" argument is used.
+ *  @return The number of lines printed.
+ */
+int show_numa_info(struct numa_stats *numa, int graph_flag);
+
+/** @brief Close every file opened by the collector.
+ *  @param numa The collector state.
+ *  @return Void.
+ */
+void numa_close(struct numa_stats *numa);
+
+#endif
@@ -0,0 +1,292 @@
+/** @file parse_numbers.c
+ *  @brief Parse long runs of decimal numbers from procfs tables in bulk
+ *
+ *  Files like "/proc/stat" on many-core hosts, "/proc/interrupts" and
+ *  "/proc/softirqs" are mostly long runs of space-separated decimal
+ *  numbers. This file includes a parsing kernel which classifies blocks of
+ *  64 bytes (with SSE or AVX2 compares) into bit masks of digits and spaces, finds
+ *  the numbers with bit operations, and converts up to 16 digits at once
+ *  with multiply-add instructions. A scalar kernel is used on other CPUs, and for the last
+ *  bytes of a buffer, so that a SIMD load never reads past its end.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "parse_numbers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PARSE_X86 1
+#define PARSE_BLOCK 64   // the bytes classified at once (one bit each in a uint64_t)
+#endif
+
+/** @brief The portable kernel, one character at a time.
+ *  @return The number of numbers parsed (see parse_u64_run).
+ */
+size_t parse_u64_scalar(const char **text, const char *end, uint64_t *out, size_t max) {
+    const char *ptr = *text;
+    size_t n = 0;
+
+    while (n < max) {
+        while (ptr < end && *ptr == ' ') ptr ++;
+        if (ptr == end || (unsigned) (*ptr - '0') > 9) break;
+
+        uint64_t value = 0;
+        while (ptr < end && (unsigned) (*ptr - '0') <= 9) {
+            value = value * 10 + (*ptr ++ - '0');
+        }
+        out[n ++] = value;
+    }
+    *text = ptr;
+    return n;
+}
+
+#ifdef PARSE_X86
+
+/** @brief Shuffle control moving the first len bytes to the end of a vector.
+ *
+ *  Loading 16 bytes from shift_table + len gives 16 - len bytes of 0x80
+ *  (which pshufb turns into 0), followed by the indexes 0 .. len - 1.
+ */
+static const int8_t shift_table[32] = {
+    -128, -128, -128, -128, -128, -128, -128, -128,
+    -128, -128, -128, -128, -128, -128, -128, -128,
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+/** @brief Convert up to 16 decimal digits at once.
+ *
+ *  The digits are right-aligned in a vector (padded with leading zeros),
+ *  then combined pairwise: 16 x 1 digit -> 8 x 2 digits -> 4 x 4 digits
+ *  -> 2 x 8 digits, with one multiply-add instruction per step.
+ *
+ *  @param ptr The first digit, 16 bytes must be readable from it.
+ *  @param len The number of digits (1 to 16).
+ *  @return The value of the digits.
+ */
+__attribute__((target("sse4.2")))
+static inline uint64_t parse_digits16(const char *ptr, int len) {
+    __m128i v = _mm_loadu_si128((const __m128i *) ptr);
+
+    v = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+    v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *) (shift_table + len)));
+    v = _mm_maddubs_epi16(v, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1,
+                                           10, 1, 10, 1, 10, 1, 10, 1));
+    v = _mm_madd_epi16(v, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    v = _mm_packus_epi32(v, v);
+    v = _mm_madd_epi16(v, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+
+    uint64_t high = (uint32_t) _mm_cvtsi128_si32(v);     // the first 8 digits
+    uint64_t low = (uint32_t) _mm_extract_epi32(v, 1);   // the last 8 digits
+    return high * 100000000ULL + low;
+}
+
+/** @brief Parse the numbers of a block, from its digit and space bit masks.
+ *
+ *  Bit i of a mask is set if byte i of the block is a digit (or a space).
+ *  The first digit of each run is found with digit & ~(digit << 1), and
+ *  its end with the first non-digit after it, so each number costs a few
+ *  bit operations and one parse_digits16, whatever its width.
+ *
+ *  @param block The block of PARSE_BLOCK bytes, which starts outside of a
+ *               number, and from which PARSE_BLOCK + 16 bytes are readable.
+ *  @param digit The digit mask of the block.
+ *  @param space The space mask of the block.
+ *  @param out Where to store the numbers.
+ *  @param n The number of numbers parsed so far, updated.
+ *  @param max The maximum number of numbers to parse.
+ *  @param done Set to 1 when the run is over (max reached or another
+ *              character found).
+ *  @return The number of bytes consumed: a number crossing the end of the
+ *          block is left to the next block, so it starts with it.
+ */
+__attribute__((target("sse4.2")))
+static inline int parse_block(const char *block, uint64_t digit, uint64_t space,
+    uint64_t *out, size_t *n, size_t max, int *done) {
+    uint64_t other = ~(digit | space);
+    int stop = other ? __builtin_ctzll(other) : PARSE_BLOCK;
+    uint64_t starts = digit & ~(digit << 1);
+    uint64_t ends = ~digit & (digit << 1);
+
+    for (; starts != 0; starts &= starts - 1) {
+        int start = __builtin_ctzll(starts);
+        if (start >= stop) break;
+        uint64_t after = ends & (~0ULL << start);
+        if (after == 0) {
+            return start;  // the number continues in the next block
+        }
+
+        int end = __builtin_ctzll(after);
+        if (end - start <= 16) {
+            out[*n] = parse_digits16(block + start, end - start);
+        } else {
+            const char *ptr = block + start;
+            parse_u64_scalar(&ptr, block + end, out + *n, 1);
+        }
+        if (++ *n == max) {
+            *done = 1;
+            return end;
+        }
+    }
+    if (other) {
+        *done = 1;
+        return stop;
+    }
+    return PARSE_BLOCK;
+}
+
+/** @brief Get the digit and space masks of 16 bytes.
+ *  @param ptr The bytes.
+ *  @param space Where to store the space mask.
+ *  @return The digit mask.
+ */
+__attribute__((target("sse4.2")))
+static inline uint64_t classify16(const char *ptr, uint64_t *space) {
+    __m128i block = _mm_loadu_si128((const __m128i *) ptr);
+    // a byte is a digit iff min(byte - '0', 9) == byte - '0' (unsigned)
+    __m128i value = _mm_sub_epi8(block, _mm_set1_epi8('0'));
+    __m128i digit = _mm_cmpeq_epi8(_mm_min_epu8(value, _mm_set1_epi8(9)), value);
+
+    *space = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+    return (uint16_t) _mm_movemask_epi8(digit);
+}
+
+/** @brief Get the digit and space masks of 32 bytes.
+ *  @param ptr The bytes.
+ *  @param space Where to store the space mask.
+ *  @return The digit mask.
+ */
+__attribute__((target("avx2")))
+static inline uint64_t classify32(const char *ptr, uint64_t *space) {
+    __m256i block = _mm256_loadu_si256((const __m256i *) ptr);
+    __m256i value = _mm256_sub_epi8(block, _mm256_set1_epi8('0'));
+    __m256i digit = _mm256_cmpeq_epi8(_mm256_min_epu8(value, _mm256_set1_epi8(9)), value);
+
+    *space = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')));
+    return (uint32_t) _mm256_movemask_epi8(digit);
+}
+
+/** @brief The SSE4.2 kernel.
+ *
+ *  Classify a block with four 16-byte compares, then parse its numbers
+ *  from the bit masks.
+ *
+ *  @return The number of numbers parsed (see parse_u64_run).
+ */
+__attribute__((target("sse4.2")))
+static size_t parse_u64_sse42(const char **text, const char *end, uint64_t *out, size_t max) {
+    const char *ptr = *text;
+    size_t n = 0;
+    int done = 0;
+
+    while (n < max && !done && end - ptr >= PARSE_BLOCK + 16) {
+        uint64_t digit = 0, space = 0, part;
+        for (int i = 0; i < PARSE_BLOCK; i += 16) {
+            digit |= classify16(ptr + i, &part) << i;
+            space |= part << i;
+        }
+
+        int used = parse_block(ptr, digit, space, out, &n, max, &done);
+        if (used == 0 && !done) {
+            n += parse_u64_scalar(&ptr, end, out + n, 1);  // a very long number
+        }
+        ptr += used;
+    }
+    *text = ptr;
+    return done ? n : n + parse_u64_scalar(text, end, out + n, max - n);
+}
+
+/** @brief The AVX2 kernel.
+ *
+ *  The same as the SSE4.2 kernel, with two 32-byte compares per block.
+ *
+ *  @return The number of numbers parsed (see parse_u64_run).
+ */
+__attribute__((target("avx2")))
+static size_t parse_u64_avx2(const char **text, const char *end, uint64_t *out, size_t max) {
+    const char *ptr = *text;
+    size_t n = 0;
+    int done = 0;
+
+    while (n < max && !done && end - ptr >= PARSE_BLOCK + 16) {
+        uint64_t digit = 0, space = 0, part;
+        for (int i = 0; i < PARSE_BLOCK; i += 32) {
+            digit |= classify32(ptr + i, &part) << i;
+            space |= part << i;
+        }
+
+        int used = parse_block(ptr, digit, space, out, &n, max, &done);
+        if (used == 0 && !done) {
+            n += parse_u64_scalar(&ptr, end, out + n, 1);  // a very long number
+        }
+        ptr += used;
+    }
+    *text = ptr;
+    return done ? n : n + parse_u64_scalar(text, end, out + n, max - n);
+}
+
+#endif
+
+/** @brief Get a parsing kernel by name, for benchmarking.
+ *
+ *  @param name "scalar", "sse4.2", "avx2", or NULL for the best supported.
+ *  @return The kernel, or NULL if the CPU does not support it.
+ */
+parse_kernel parse_kernel_get(const char *name) {
+#ifdef PARSE_X86
+    __builtin_cpu_init();
+    if ((name == NULL || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        return parse_u64_avx2;
+    }
+    if ((name == NULL || strcmp(name, "sse4.2") == 0) && __builtin_cpu_supports("sse4.2")) {
+        return parse_u64_sse42;
+    }
+#endif
+    if (name == NULL || strcmp(name, "scalar") == 0) {
+        return parse_u64_scalar;
+    }
+    return NULL;
+}
+
+/** @brief The kernel used by parse_u64_run, selected at the first call. */
+static parse_kernel selected_kernel = NULL;
+
+/** @brief Parse a run of space-separated decimal numbers into uint64 values.
+ *
+ *  Skip the spaces, then convert each digit run, until max numbers have
+ *  been parsed or a character which is neither a space nor a digit is
+ *  reached (e.g. the '\n' or the description of an interrupt line).
+ *  The fastest kernel supported by the CPU (AVX2, SSE4.2 or scalar) is
+ *  selected at the first call, and used for runs of PARSE_SIMD_MIN numbers
+ *  or more (shorter ones are faster to parse one byte at a time). The SIMD
+ *  kernels never read at or after end, the last bytes before end are
+ *  handled by the scalar code.
+ *
+ *  @param text Point to the text, moved after the last number parsed.
+ *  @param end The end of the readable buffer (e.g. its terminating '\0').
+ *  @param out Where to store the numbers.
+ *  @param max The maximum number of numbers to parse.
+ *  @return The number of numbers parsed.
+ */
+size_t parse_u64_run(const char **text, const char *end, uint64_t *out, size_t max) {
+    if (max < PARSE_SIMD_MIN) {
+        return parse_u64_scalar(text, end, out, max);
+    }
+    if (selected_kernel == NULL) {
+        selected_kernel = parse_kernel_get(NULL);
+    }
+    return selected_kernel(text, end, out, max);
+}
+
+/** @brief Get the name of the kernel used by parse_u64_run.
+ *  @return "scalar", "sse4.2" or "avx2".
+ */
+const char *parse_kernel_name() {
+    parse_kernel kernel = selected_kernel != NULL ? selected_kernel : parse_kernel_get(NULL);
+
+#ifdef PARSE_X86
+    if (kernel == parse_u64_avx2) return "avx2";
+    if (kernel == parse_u64_sse42) return "sse4.2";
+#endif
+    return kernel == parse_u64_scalar ? "scalar" : "unknown";
+}
@@ -0,0 +1,55 @@
+/*
+ * Header file for the bulk decimal parser used on wide procfs tables
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef __Parse_numbers_header
+#define __Parse_numbers_header
+
+#define PARSE_SIMD_MIN 8   // the shortest run parsed with the SIMD kernels
+
+/** @brief The type of a parsing kernel (see parse_u64_run). */
+typedef size_t (*parse_kernel)(const char **text, const char *end, uint64_t *out, size_t max);
+
+/** @brief Parse a run of space-separated decimal numbers into uint64 values.
+ *
+ *  Skip the spaces, then convert each digit run, until max numbers have
+ *  been parsed or a character which is neither a space nor a digit is
+ *  reached (e.g. the '\n' or the description of an interrupt line).
+ *  The fastest kernel supported by the CPU (AVX2, SSE4.2 or scalar) is
+ *  selected at the first call, and used for runs of PARSE_SIMD_MIN numbers
+ *  or more (shorter ones are faster to parse one byte at a time). The SIMD
+ *  kernels never read at or after end, the last bytes before end are
+ *  handled by the scalar code.
+ *
+ *  @param text Point to the text, moved after the last number parsed.
+ *  @param end The end of the readable buffer (e.g. its terminating '\0').
+ *  @param out Where to store the numbers.
+ *  @param max The maximum number of numbers to parse.
+ *  @return The number of numbers parsed.
+ */
+size_t parse_u64_run(const char **text, const char *end, uint64_t *out, size_t max);
+
+/** @brief The portable kernel, one character at a time.
+ *  @return The number of numbers parsed (see parse_u64_run).
+ */
+size_t parse_u64_scalar(const char **text, const char *end, uint64_t *out, size_t max);
+
+/** @brief Get a parsing kernel by name, for benchmarking.
+ *
+ *  @param name "scalar", "sse4.2", "avx2", or NULL for the best supported.
+ *  @return The kernel, or NULL if the CPU does not support it.
+ */
+parse_kernel parse_kernel_get(const char *name);
+
+/** @brief Get the name of the kernel used by parse_u64_run.
+ *  @return "scalar", "sse4.2" or "avx2".
+ */
+const char *parse_kernel_name();
+
+#endif
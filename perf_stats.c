@@ -0,0 +1,232 @@
+/** @file perf_stats.c
+ *  @brief Report whether the busy cores retire instructions or stall
+ *
+ *  This file includes the functions that count, on each CPU, the cycles,
+ *  instructions, cache misses and branch misses with perf_event_open(),
+ *  and report the instructions per cycle (IPC) and the miss rates, which
+ *  tell a core busy computing from a core waiting on memory. The events of
+ *  a CPU form a group, so they are scheduled together and read at once.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "perf_stats.h"
+
+/** @brief The hardware event of each counter (see enum perf_counter). */
+static const uint64_t perf_configs[PERF_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/** @brief Open one hardware event counting on a CPU.
+ *  @param config The event (PERF_COUNT_HW_*).
+ *  @param cpu The CPU number.
+ *  @param group_fd The fd of the group leader, -1 to open a leader.
+ *  @return The fd of the event, or -1 on failure (errno is set).
+ */
+static int perf_open(uint64_t config, int cpu, int group_fd) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1;  // the leader enables the whole group
+    attr.read_format = PERF_FORMAT_GROUP |
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // pid -1 and a CPU: count every task running on this CPU
+    return syscall(SYS_perf_event_open, &attr, -1, cpu, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+/** @brief Read the group of a CPU, in one read() on its leader.
+ *  @param cpu The CPU.
+ *  @return 1 on success, 0 otherwise.
+ */
+static int perf_read(struct perf_cpu *cpu) {
+    // nr, time_enabled, time_running, then one value per event
+    uint64_t data[3 + PERF_COUNTERS];
+
+    if (read(cpu->leader, data, sizeof(data)) < (ssize_t) (3 * sizeof(uint64_t))) {
+        return 0;
+    }
+    cpu->enabled = data[1];
+    cpu->running = data[2];
+    for (int i = 0; i < PERF_COUNTERS; i ++) {
+        if (cpu->slot[i] != -1 && (uint64_t) cpu->slot[i] < data[0]) {
+            cpu->value[i] = data[3 + cpu->slot[i]];
+        }
+    }
+    return 1;
+}
+
+/** @brief Compare two CPUs by cycles, for qsort().
+ *  @param a The first CPU.
+ *  @param b The second CPU.
+ *  @return A negative, zero or positive integer.
+ */
+static int perf_compare(const void *a, const void *b) {
+    const struct perf_cpu *x = *(struct perf_cpu * const *) a;
+    const struct perf_cpu *y = *(struct perf_cpu * const *) b;
+
+    if (x->delta[PERF_CYCLES] != y->delta[PERF_CYCLES]) {
+        return x->delta[PERF_CYCLES] < y->delta[PERF_CYCLES] ? 1 : -1;
+    }
+    return x->id - y->id;
+}
+
+/** @brief Open an event group (cycles, instructions, cache and branch misses) per CPU.
+ *
+ *  The groups are opened once for the whole run, and enabled at once. If
+ *  the kernel forbids it (see "/proc/sys/kernel/perf_event_paranoid") or
+ *  has no hardware PMU (e.g. in some VMs), the error is kept and reported
+ *  by show_perf_info, instead of stopping the program.
+ *
+ *  @param perf The collector state to initialize.
+ *  @return The number of CPUs with an open group.
+ */
+int perf_init(struct perf_stats *perf) {
+    int ncpu = (int) sysconf(_SC_NPROCESSORS_CONF);
+
+    memset(perf, 0, sizeof(*perf));
+    if (ncpu < 1) ncpu = 1;
+    if ((perf->cpu = calloc(ncpu, sizeof(struct perf_cpu))) == NULL ||
+        (perf->order = calloc(ncpu, sizeof(struct perf_cpu *))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    for (int id = 0; id < ncpu; id ++) {
+        struct perf_cpu *cpu = &perf->cpu[perf->count];
+        int slots = 0;
+
+        if ((cpu->leader = perf_open(perf_configs[PERF_CYCLES], id, -1)) == -1) {
+            // ENODEV: the CPU is offline, otherwise no counter is available
+            if (errno != ENODEV && perf->error == 0) perf->error = errno;
+            continue;
+        }
+        cpu->id = id;
+        cpu->fd[PERF_CYCLES] = cpu->leader;
+        cpu->slot[PERF_CYCLES] = slots ++;
+        for (int i = PERF_CYCLES + 1; i < PERF_COUNTERS; i ++) {
+            // A missing event (e.g. no cache-misses on this PMU) only hides its rate
+            cpu->fd[i] = perf_open(perf_configs[i], id, cpu->leader);
+            cpu->slot[i] = cpu->fd[i] != -1 ? slots ++ : -1;
+        }
+        ioctl(cpu->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        perf->count ++;
+    }
+    if (perf->count > 0) {
+        perf->error = 0;
+        perf_sample(perf);
+    }
+    return perf->count;
+}
+
+/** @brief Read every group in one read() on its leader, and compute the rates.
+ *
+ *  delta = (value_curr - value_prev) * enabled_diff / running_diff
+ *  IPC = instructions_delta / cycles_delta
+ *  misses per 1000 instructions = misses_delta / instructions_delta * 1000
+ *
+ *  @param perf The collector state.
+ *  @return Void.
+ */
+void perf_sample(struct perf_stats *perf) {
+    time_since(&perf->last);
+
+    for (int i = 0; i < perf->count; i ++) {
+        struct perf_cpu *cpu = &perf->cpu[i];
+        if (!perf_read(cpu)) continue;
+
+        // When there are more events than counters the kernel multiplexes
+        // the groups, so scale the deltas up to the whole interval
+        uint64_t enabled = cpu->enabled - cpu->enabled_prev;
+        uint64_t running = cpu->running - cpu->running_prev;
+        double scale = running > 0 ? (double) enabled / running : 0.0;
+        for (int j = 0; j < PERF_COUNTERS; j ++) {
+            cpu->delta[j] = (cpu->value[j] - cpu->prev[j]) * scale;
+            cpu->prev[j] = cpu->value[j];
+        }
+        cpu->ipc = cpu->delta[PERF_CYCLES] > 0 ?
+            cpu->delta[PERF_INSTRUCTIONS] / cpu->delta[PERF_CYCLES] : 0.0;
+        cpu->ghz = enabled > 0 ? cpu->delta[PERF_CYCLES] / enabled : 0.0;
+        cpu->enabled_prev = cpu->enabled;
+        cpu->running_prev = cpu->running;
+    }
+}
+
+/** @brief Prints the perf section, the totals then the busiest cores.
+ *  @param perf The collector state.
+ *  @return The number of lines printed.
+ */
+int show_perf_info(struct perf_stats *perf) {
+    double total[PERF_COUNTERS] = {0};
+    int lines = 0;
+
+    printf("### Perf counters ### (IPC, misses per 1000 instructions)\n");
+    lines ++;
+    if (perf->count == 0) {
+        FILE *file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int paranoid = 2;
+        if (file != NULL) {
+            if (fscanf(file, "%d", &paranoid) != 1) paranoid = 2;
+            fclose(file);
+        }
+        if (perf->error == EACCES || perf->error == EPERM) {
+            printf(" n/a: %s (perf_event_paranoid = %d, system-wide counting needs <= 0 or CAP_PERFMON)\n",
+                strerror(perf->error), paranoid);
+        } else {
+            printf(" n/a: %s (no hardware counters, e.g. in a VM without a virtual PMU)\n",
+                strerror(perf->error));
+        }
+        printf("---------------------------------------\n");
+        return lines + 2;
+    }
+
+    for (int i = 0; i < perf->count; i ++) {
+        for (int j = 0; j < PERF_COUNTERS; j ++) {
+            total[j] += perf->cpu[i].delta[j];
+        }
+        perf->order[i] = &perf->cpu[i];
+    }
+    qsort(perf->order, perf->count, sizeof(struct perf_cpu *), perf_compare);
+
+    double kilo = total[PERF_INSTRUCTIONS] > 0 ? 1000.0 / total[PERF_INSTRUCTIONS] : 0.0;
+    printf(" all   IPC %5.2f  cache %6.2f  branch %6.2f  (%.2f G instructions)\n",
+        total[PERF_CYCLES] > 0 ? total[PERF_INSTRUCTIONS] / total[PERF_CYCLES] : 0.0,
+        total[PERF_CACHE_MISSES] * kilo, total[PERF_BRANCH_MISSES] * kilo,
+        total[PERF_INSTRUCTIONS] * 1e-9);
+    lines ++;
+
+    for (int i = 0; i < perf->count && i < PERF_TOP; i ++) {
+        struct perf_cpu *cpu = perf->order[i];
+        kilo = cpu->delta[PERF_INSTRUCTIONS] > 0 ? 1000.0 / cpu->delta[PERF_INSTRUCTIONS] : 0.0;
+        printf(" cpu%-3d IPC %5.2f", cpu->id, cpu->ipc);
+        if (cpu->slot[PERF_CACHE_MISSES] != -1) {
+            printf("  cache %6.2f", cpu->delta[PERF_CACHE_MISSES] * kilo);
+        }
+        if (cpu->slot[PERF_BRANCH_MISSES] != -1) {
+            printf("  branch %6.2f", cpu->delta[PERF_BRANCH_MISSES] * kilo);
+        }
+        printf("  %.2f Gcycles/s\n", cpu->ghz);
+        lines ++;
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Close every event.
+ *  @param perf The collector state.
+ *  @return Void.
+ */
+void perf_close(struct perf_stats *perf) {
+    for (int i = 0; i < perf->count; i ++) {
+        for (int j = 0; j < PERF_COUNTERS; j ++) {
+            if (perf->cpu[i].slot[j] != -1) close(perf->cpu[i].fd[j]);
+        }
+    }
+    free(perf->cpu);
+    free(perf->order);
+}
@@ -0,0 +1,86 @@
+/*
+ * Header file for the hardware performance counter collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#ifndef __Perf_header
+#define __Perf_header
+
+#define PERF_TOP 8   // the number of cores listed, busiest first
+
+/** @brief The counters of a per-CPU event group, the first one leads the group. */
+enum perf_counter {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES,
+    PERF_COUNTERS
+};
+
+/** @brief State of the event group of one CPU kept between two samples. */
+struct perf_cpu {
+    int id;                            // the CPU number
+    int leader;                        // fd of the group leader (cycles)
+    int fd[PERF_COUNTERS];             // fd of each event, -1 if not supported
+    int slot[PERF_COUNTERS];           // the position of each event in a group read, or -1
+    uint64_t value[PERF_COUNTERS];     // the counters of the current sample
+    uint64_t prev[PERF_COUNTERS];      // the counters of the previous sample
+    uint64_t enabled, running;         // the times the group was enabled / counting (ns)
+    uint64_t enabled_prev, running_prev;
+    double delta[PERF_COUNTERS];       // the events over the interval (scaled if multiplexed)
+    double ipc;                        // instructions per cycle
+    double ghz;                        // cycles per nanosecond
+};
+
+/** @brief State of the perf collector. */
+struct perf_stats {
+    int count;                  // the number of CPUs with an open group
+    struct perf_cpu *cpu;       // the CPUs
+    struct perf_cpu **order;    // the CPUs sorted for the report
+    int error;                  // errno of the first failure, if no group could be opened
+    struct timespec last;       // time of the previous sample
+};
+
+/** @brief Open an event group (cycles, instructions, cache and branch misses) per CPU.
+ *
+ *  The groups are opened once for the whole run, and enabled at once. If
+ *  the kernel forbids it (see "/proc/sys/kernel/perf_event_paranoid") or
+ *  has no hardware PMU (e.g. in some VMs), the error is kept and reported
+ *  by show_perf_info, instead of stopping the program.
+ *
+ *  @param perf The collector state to initialize.
+ *  @return The number of CPUs with an open group.
+ */
+int perf_init(struct perf_stats *perf);
+
+/** @brief Read every group in one read() on its leader, and compute the rates.
+ *
+ *  delta = (value_curr - value_prev) * enabled_diff / running_diff
+ *  IPC = instructions_delta / cycles_delta
+ *  misses per 1000 instructions = misses_delta / instructions_delta * 1000
+ *
+ *  @param perf The collector state.
+ *  @return Void.
+ */
+void perf_sample(struct perf_stats *perf);
+
+/** @brief Prints the perf section, the totals then the busiest cores.
+ *  @param perf The collector state.
+ *  @return The number of lines printed.
+ */
+int show_perf_info(struct perf_stats *perf);
+
+/** @brief Close every event.
+ *  @param perf The collector state.
+ *  @return Void.
+ */
+void perf_close(struct perf_stats *perf);
+
+#endif
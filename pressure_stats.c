@@ -0,0 +1,227 @@
+/** @file pressure_stats.c
+ *  @brief Report the Pressure Stall Information (PSI) of a system
+ *
+ *  This file includes the functions that read "/proc/pressure/cpu",
+ *  "/proc/pressure/memory" and "/proc/pressure/io", and report how long
+ *  tasks were actually stalled waiting for each resource. Besides the
+ *  averages computed by the kernel, the stall percentage over our own
+ *  sampling interval is computed from the "total=" counters.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "pressure_stats.h"
+
+/** @brief The resources reported by PSI, in display order. */
+static const char *psi_names[PSI_RESOURCES] = {"cpu", "memory", "io"};
+
+/** @brief Open the PSI trigger of a resource.
+ *
+ *  Writing "some <stall us> <window us>" to a pressure file arms a trigger,
+ *  and poll() then reports POLLPRI on the fd when the threshold is reached.
+ *  If the kernel does not allow it (e.g. not enough privilege), return -1
+ *  and the resource is just sampled at every tick.
+ *
+ *  @param path The pressure file of the resource.
+ *  @param trigger_us The stall threshold (in microseconds).
+ *  @return The trigger fd, or -1 on failure.
+ */
+static int pressure_arm_trigger(const char *path, long trigger_us) {
+    char trigger[64];  // the trigger description written to the file
+    int fd;            // the fd of the trigger
+
+    if ((fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    snprintf(trigger, sizeof(trigger), "some %ld %d", trigger_us, PSI_TRIGGER_WINDOW);
+    // the terminating null byte is part of the trigger
+    if (write(fd, trigger, strlen(trigger) + 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/** @brief Parse one line of a pressure file.
+ *  @param text The start of the line (after "some " or "full ").
+ *  @param line Where to store the values.
+ *  @return 1 if the line has been parsed, 0 otherwise.
+ */
+static int pressure_parse_line(const char *text, struct psi_line *line) {
+    return sscanf(text, "avg10=%lf avg60=%lf avg300=%lf total=%llu", &line->avg10,
+        &line->avg60, &line->avg300, &line->total) == 4;
+}
+
+/** @brief Re-read the pressure file of one resource.
+ *  @param res The resource to read.
+ *  @return 1 if the file has been read, 0 otherwise.
+ */
+static int pressure_read(struct psi_resource *res) {
+    char buf[256];    // the whole pressure file (two short lines)
+    char *full;       // the start of the "full" line
+    ssize_t len;
+
+    if ((len = pread(res->fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+
+    if (strncmp(buf, "some ", 5) != 0 || !pressure_parse_line(buf + 5, &res->some)) {
+        return 0;
+    }
+    // The "full" line does not exist for the cpu on older kernels
+    if ((full = strstr(buf, "\nfull ")) == NULL ||
+        !pressure_parse_line(full + 6, &res->full)) {
+        res->full.total = 0;
+    }
+    return 1;
+}
+
+/** @brief Open the files in "/proc/pressure" and take the first sample.
+ *
+ *  The files stay open for the whole run and are re-read with pread().
+ *  If trigger_us is positive, also arm a PSI trigger on each resource
+ *  which fires when tasks are stalled for more than trigger_us
+ *  microseconds within a PSI_TRIGGER_WINDOW window.
+ *
+ *  @param psi The collector state to initialize.
+ *  @param trigger_us The stall threshold of the triggers, 0 for none.
+ *  @return The number of resources available.
+ */
+int pressure_init(struct psi_stats *psi, long trigger_us) {
+    char path[64];       // the path of the pressure file
+    int available = 0;   // the number of resources available
+
+    memset(psi, 0, sizeof(*psi));
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        struct psi_resource *res = &psi->res[i];
+        res->name = psi_names[i];
+        res->trigger_fd = -1;
+
+        snprintf(path, sizeof(path), "/proc/pressure/%s", res->name);
+        // PSI may be disabled (CONFIG_PSI=n or "psi=0"), just skip the resource
+        if ((res->fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) {
+            continue;
+        }
+        if (!pressure_read(res)) {
+            close(res->fd);
+            res->fd = -1;
+            continue;
+        }
+        res->some.prev = res->some.total;
+        res->full.prev = res->full.total;
+        if (trigger_us > 0) {
+            res->trigger_fd = pressure_arm_trigger(path, trigger_us);
+        }
+        available ++;
+    }
+    time_since(&psi->last);  // remember when the first sample is taken
+    return available;
+}
+
+/** @brief Re-read every pressure file and compute the stall deltas.
+ *
+ *  The stall percentage is computed from the "total=" counters:
+ *      stall (%) = (total_curr - total_prev) / interval * 100
+ *
+ *  @param psi The collector state.
+ *  @return Void.
+ */
+void pressure_sample(struct psi_stats *psi) {
+    psi->interval = time_since(&psi->last);
+
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        struct psi_resource *res = &psi->res[i];
+        if (res->fd == -1 || !pressure_read(res)) {
+            continue;
+        }
+
+        // stall (%) = (total_curr - total_prev) / interval * 100,
+        // where total is in microseconds
+        struct psi_line *lines[2] = {&res->some, &res->full};
+        for (int j = 0; j < 2; j ++) {
+            struct psi_line *line = lines[j];
+            unsigned long long delta = line->total - line->prev;
+            line->stall = psi->interval > 0 ? delta / (psi->interval * 1e4) : 0.0;
+            line->prev = line->total;
+        }
+    }
+}
+
+/** @brief Prints the pressure section.
+ *  @param psi The collector state.
+ *  @return The number of lines printed.
+ */
+int show_pressure_info(struct psi_stats *psi) {
+    int lines = 1;  // the number of lines printed
+
+    printf("### Pressure ### (stall%% over interval, avg10/avg60, total)\n");
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        struct psi_resource *res = &psi->res[i];
+        if (res->fd == -1) {
+            printf(" %-6s  unavailable\n", res->name);
+        } else {
+            printf(" %-6s  some %6.2f%% (%.2f/%.2f, %llu us)  full %6.2f%% (%.2f/%.2f, %llu us)",
+                res->name, res->some.stall, res->some.avg10, res->some.avg60, res->some.total,
+                res->full.stall, res->full.avg10, res->full.avg60, res->full.total);
+            if (res->trigger_fd != -1) {
+                printf("  triggers: %ld", res->triggers);
+            }
+            printf("\n");
+        }
+        lines ++;
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Add the armed trigger fds to an array of pollfd.
+ *  @param psi The collector state.
+ *  @param fds The array to fill (at least PSI_RESOURCES long).
+ *  @return The number of fds added.
+ */
+int pressure_poll_fds(struct psi_stats *psi, struct pollfd *fds) {
+    int n = 0;  // the number of fds added
+
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        if (psi->res[i].trigger_fd != -1) {
+            fds[n].fd = psi->res[i].trigger_fd;
+            fds[n].events = POLLPRI;
+            fds[n].revents = 0;
+            n ++;
+        }
+    }
+    return n;
+}
+
+/** @brief Handle a trigger fd reported by poll() as ready.
+ *
+ *  Count the event and report it to the standard error immediately,
+ *  instead of waiting for the next sample.
+ *
+ *  @param psi The collector state.
+ *  @param fd The fd that fired.
+ *  @return Void.
+ */
+void pressure_handle_trigger(struct psi_stats *psi, int fd) {
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        struct psi_resource *res = &psi->res[i];
+        if (res->trigger_fd == fd) {
+            res->triggers ++;
+            fprintf(stderr, "PSI: %s stall threshold reached (%ld times)\n",
+                res->name, res->triggers);
+        }
+    }
+}
+
+/** @brief Close every file opened by the collector.
+ *  @param psi The collector state.
+ *  @return Void.
+ */
+void pressure_close(struct psi_stats *psi) {
+    for (int i = 0; i < PSI_RESOURCES; i ++) {
+        if (psi->res[i].fd != -1) close(psi->res[i].fd);
+        if (psi->res[i].trigger_fd != -1) close(psi->res[i].trigger_fd);
+    }
+}
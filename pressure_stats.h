@@ -0,0 +1,98 @@
+/*
+ * Header file for the Pressure Stall Information (PSI) collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef __Pressure_header
+#define __Pressure_header
+
+#define PSI_RESOURCES 3          // cpu, memory and io
+#define PSI_TRIGGER_WINDOW 2000000  // trigger window (in microseconds)
+
+/** @brief One "some" or "full" line of a file in "/proc/pressure". */
+struct psi_line {
+    double avg10, avg60, avg300;  // kernel averages (in percentage)
+    unsigned long long total;     // total stall time (in microseconds)
+    unsigned long long prev;      // total stall time of the previous sample
+    double stall;                 // our own stall percentage over the interval
+};
+
+/** @brief State of one pressure resource (cpu, memory or io). */
+struct psi_resource {
+    const char *name;       // name of the resource
+    int fd;                 // fd of "/proc/pressure/<name>", -1 if unavailable
+    int trigger_fd;         // fd armed with a PSI trigger, -1 if not armed
+    long triggers;          // number of times the trigger fired
+    struct psi_line some;   // some tasks are stalled
+    struct psi_line full;   // all non-idle tasks are stalled
+};
+
+/** @brief State of the PSI collector kept between two samples. */
+struct psi_stats {
+    struct psi_resource res[PSI_RESOURCES];
+    struct timespec last;   // time of the previous sample
+    double interval;        // seconds between the last two samples
+};
+
+/** @brief Open the files in "/proc/pressure" and take the first sample.
+ *
+ *  The files stay open for the whole run and are re-read with pread().
+ *  If trigger_us is positive, also arm a PSI trigger on each resource
+ *  which fires when tasks are stalled for more than trigger_us
+ *  microseconds within a PSI_TRIGGER_WINDOW window.
+ *
+ *  @param psi The collector state to initialize.
+ *  @param trigger_us The stall threshold of the triggers, 0 for none.
+ *  @return The number of resources available.
+ */
+int pressure_init(struct psi_stats *psi, long trigger_us);
+
+/** @brief Re-read every pressure file and compute the stall deltas.
+ *
+ *  The stall percentage is computed from the "total=" counters:
+ *      stall (%) = (total_curr - total_prev) / interval * 100
+ *
+ *  @param psi The collector state.
+ *  @return Void.
+ */
+void pressure_sample(struct psi_stats *psi);
+
+/** @brief Prints the pressure section.
+ *  @param psi The collector state.
+ *  @return The number of lines printed.
+ */
+int show_pressure_info(struct psi_stats *psi);
+
+/** @brief Add the armed trigger fds to an array of pollfd.
+ *  @param psi The collector state.
+ *  @param fds The array to fill (at least PSI_RESOURCES long).
+ *  @return The number of fds added.
+ */
+int pressure_poll_fds(struct psi_stats *psi, struct pollfd *fds);
+
+/** @brief Handle a trigger fd reported by poll() as ready.
+ *
+ *  Count the event and report it to the standard error immediately,
+ *  instead of waiting for the next sample.
+ *
+ *  @param psi The collector state.
+ *  @param fd The fd that fired.
+ *  @return Void.
+ */
+void pressure_handle_trigger(struct psi_stats *psi, int fd);
+
+/** @brief Close every file opened by the collector.
+ *  @param psi The collector state.
+ *  @return Void.
+ */
+void pressure_close(struct psi_stats *psi);
+
+#endif
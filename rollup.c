@@ -0,0 +1,161 @@
+/** @file rollup.c
+ *  @brief Keep the history of a metric at several resolutions
+ *
+ *  This file includes the functions that downsample the samples of a
+ *  metric into rings of 10 second, 1 minute and 1 hour buckets (min, max,
+ *  average and last value), beside a ring of the raw samples. Every ring
+ *  has a fixed size, so the memory does not grow with the length of the
+ *  run, and a chart can pick the resolution that fits the screen.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "rollup.h"
+
+/** @brief The seconds of a bucket of each tier, and its label. */
+static const double rollup_spans[ROLLUP_TIERS] = {0, 10, 60, 3600};
+static const char *rollup_labels[ROLLUP_TIERS] = {"raw", "10s", "1m", "1h"};
+
+/** @brief Merge a bucket (or a sample) into another one.
+ *  @param into The bucket to update.
+ *  @param from The bucket to add.
+ *  @return Void.
+ */
+static void rollup_merge(struct rollup_bucket *into, const struct rollup_bucket *from) {
+    if (into->count == 0) {
+        long index = into->index;
+        *into = *from;
+        into->index = index;
+        return;
+    }
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+    into->sum += from->sum;
+    into->last = from->last;
+    into->count += from->count;
+}
+
+/** @brief Keep a closed bucket in the ring of a tier, over the oldest one once full.
+ *  @param tier The tier.
+ *  @param bucket The bucket.
+ *  @return Void.
+ */
+static void rollup_append(struct rollup_tier *tier, const struct rollup_bucket *bucket) {
+    if (tier->size < ROLLUP_BUCKETS) {
+        tier->ring[(tier->head + tier->size ++) % ROLLUP_BUCKETS] = *bucket;
+    } else {
+        tier->ring[tier->head] = *bucket;
+        tier->head = (tier->head + 1) % ROLLUP_BUCKETS;
+    }
+    tier->closed ++;
+}
+
+/** @brief Add a bucket to the open bucket of a tier, closing it first if its period ended.
+ *  @param rollup The history.
+ *  @param level The tier (1 or more).
+ *  @param time The start of the added bucket (in seconds).
+ *  @param bucket The bucket.
+ *  @return Void.
+ */
+static void rollup_feed(struct rollup *rollup, int level, double time,
+    const struct rollup_bucket *bucket) {
+    struct rollup_tier *tier = &rollup->tier[level];
+    long index = (long) floor(time / tier->span);
+
+    if (tier->open.count > 0 && tier->open.index != index) {
+        rollup_append(tier, &tier->open);
+        if (level + 1 < ROLLUP_TIERS) {
+            rollup_feed(rollup, level + 1, tier->open.index * tier->span, &tier->open);
+        }
+        tier->open.count = 0;
+    }
+    tier->open.index = index;
+    rollup_merge(&tier->open, bucket);
+}
+
+/** @brief Empty the history.
+ *  @param rollup The history.
+ *  @return Void.
+ */
+void rollup_init(struct rollup *rollup) {
+    memset(rollup, 0, sizeof(*rollup));
+    for (int i = 0; i < ROLLUP_TIERS; i ++) {
+        rollup->tier[i].span = rollup_spans[i];
+    }
+}
+
+/** @brief Add a sample, and close the buckets whose period ended.
+ *
+ *  A sample is a raw bucket and goes into the open 10 second bucket. When
+ *  a sample of the next period arrives, the open bucket is kept in its
+ *  ring and merged into the open bucket of the coarser tier, and so on.
+ *
+ *  @param rollup The history.
+ *  @param time The time of the sample (in seconds).
+ *  @param value The value.
+ *  @return Void.
+ */
+void rollup_push(struct rollup *rollup, double time, double value) {
+    struct rollup_bucket sample = {rollup->tier[0].closed, value, value, value, value, 1};
+
+    rollup_append(&rollup->tier[0], &sample);
+    rollup_feed(rollup, 1, time, &sample);
+}
+
+/** @brief Pick the finest tier that holds the whole history in a number of columns.
+ *  @param rollup The history.
+ *  @param width The number of columns.
+ *  @return The tier, the coarsest one if none holds the whole history.
+ */
+int rollup_pick(struct rollup *rollup, int width) {
+    for (int i = 0; i < ROLLUP_TIERS; i ++) {
+        struct rollup_tier *tier = &rollup->tier[i];
+        // the ring must not have dropped a bucket yet
+        if (tier->closed <= ROLLUP_BUCKETS && tier->size + (tier->open.count > 0) <= width) {
+            return i;
+        }
+    }
+    return ROLLUP_TIERS - 1;
+}
+
+/** @brief Prints the history of a metric as a one line chart of the averages.
+ *
+ *  The tier is picked for the width (see rollup_pick), the levels " .:-=+*#%@"
+ *  go from the minimum to the maximum of the shown buckets.
+ *
+ *  @param rollup The history.
+ *  @param name The name of the metric.
+ *  @param width The number of columns of the chart.
+ *  @return Void.
+ */
+void show_rollup(struct rollup *rollup, const char *name, int width) {
+    static const char levels[] = " .:-=+*#%@";
+    int level = rollup_pick(rollup, width);
+    struct rollup_tier *tier = &rollup->tier[level];
+    const struct rollup_bucket *shown[ROLLUP_BUCKETS + 1];
+    int count = 0;
+    double low = INFINITY, high = -INFINITY;
+
+    // the last buckets of the ring, then the open one (none in the raw tier)
+    for (int i = 0; i < tier->size; i ++) {
+        shown[count ++] = &tier->ring[(tier->head + i) % ROLLUP_BUCKETS];
+    }
+    if (level > 0 && tier->open.count > 0) {
+        shown[count ++] = &tier->open;
+    }
+    int first = count > width ? count - width : 0;
+    for (int i = first; i < count; i ++) {
+        if (shown[i]->min < low) low = shown[i]->min;
+        if (shown[i]->max > high) high = shown[i]->max;
+    }
+
+    printf(" %-18s %-3s %10.2f %10.2f |", name, rollup_labels[level],
+        count > 0 ? low : 0.0, count > 0 ? high : 0.0);
+    for (int i = first; i < count; i ++) {
+        double avg = shown[i]->sum / shown[i]->count;
+        // a flat history is drawn in the middle
+        int j = high > low ? (int) ((avg - low) / (high - low) * (sizeof(levels) - 2) + 0.5) : 3;
+        printf("%c", levels[j]);
+    }
+    printf("|\n");
+}
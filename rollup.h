@@ -0,0 +1,75 @@
+/*
+ * Header file for the multi-resolution history of a metric
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef __Rollup_header
+#define __Rollup_header
+
+#define ROLLUP_TIERS 4        // raw samples, 10 seconds, 1 minute and 1 hour
+#define ROLLUP_BUCKETS 512    // the number of buckets kept in each tier
+
+/** @brief The values of a metric over a period (or one sample, in the raw tier). */
+struct rollup_bucket {
+    long index;               // the start of the period, in periods of the tier
+    double min, max, sum, last;
+    int count;                // the number of samples
+};
+
+/** @brief A ring of the last buckets of one resolution. */
+struct rollup_tier {
+    double span;              // the seconds of a bucket, 0 for the raw samples
+    int head, size;           // the oldest bucket in ring, and the number of buckets
+    long closed;              // the number of buckets ever closed (more than size once full)
+    struct rollup_bucket open;            // the bucket of the current period
+    struct rollup_bucket ring[ROLLUP_BUCKETS];
+};
+
+/** @brief The history of a metric, each tier fed by the buckets closed in the finer one. */
+struct rollup {
+    struct rollup_tier tier[ROLLUP_TIERS];
+};
+
+/** @brief Empty the history.
+ *  @param rollup The history.
+ *  @return Void.
+ */
+void rollup_init(struct rollup *rollup);
+
+/** @brief Add a sample, and close the buckets whose period ended.
+ *
+ *  A sample is a raw bucket and goes into the open 10 second bucket. When
+ *  a sample of the next period arrives, the open bucket is kept in its
+ *  ring and merged into the open bucket of the coarser tier, and so on.
+ *
+ *  @param rollup The history.
+ *  @param time The time of the sample (in seconds).
+ *  @param value The value.
+ *  @return Void.
+ */
+void rollup_push(struct rollup *rollup, double time, double value);
+
+/** @brief Pick the finest tier that holds the whole history in a number of columns.
+ *  @param rollup The history.
+ *  @param width The number of columns.
+ *  @return The tier, the coarsest one if none holds the whole history.
+ */
+int rollup_pick(struct rollup *rollup, int width);
+
+/** @brief Prints the history of a metric as a one line chart of the averages.
+ *
+ *  The tier is picked for the width (see rollup_pick), the levels " .:-=+*#%@"
+ *  go from the minimum to the maximum of the shown buckets.
+ *
+ *  @param rollup The history.
+ *  @param name The name of the metric.
+ *  @param width The number of columns of the chart.
+ *  @return Void.
+ */
+void show_rollup(struct rollup *rollup, const char *name, int width);
+
+#endif
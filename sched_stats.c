@@ -0,0 +1,239 @@
+/** @file sched_stats.c
+ *  @brief Report how long runnable tasks wait for a CPU
+ *
+ *  This file includes the functions that read "/proc/schedstat", where the
+ *  kernel accounts for each CPU the time tasks spent waiting on its run
+ *  queue and the number of timeslices it ran, and report them next to the
+ *  utilization of each core (read from the "cpuN" lines of "/proc/stat").
+ *  A busy core with a long wait is where request latency comes from.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "sched_stats.h"
+#include "parse_numbers.h"
+
+#define SCHED_FIELDS 9   // the numbers of a "cpuN" line of "/proc/schedstat"
+#define SCHED_WAIT 7     // run_delay: the time spent waiting on the run queue (ns)
+#define SCHED_SLICES 8   // pcount: the number of timeslices run
+
+/** @brief Read a whole file into the buffer of the collector, growing it if needed.
+ *  @param sched The collector state.
+ *  @param fd The file to read.
+ *  @return The number of bytes read, or -1 on failure.
+ */
+static ssize_t sched_read_file(struct sched_stats *sched, int fd) {
+    size_t len = 0;
+    ssize_t n;
+
+    while ((n = pread(fd, sched->buf + len, sched->buf_size - len - 1, len)) > 0) {
+        len += n;
+        if (len + 1 == sched->buf_size) {
+            sched->buf_size *= 2;
+            if ((sched->buf = realloc(sched->buf, sched->buf_size)) == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+    }
+    if (n < 0) {
+        return -1;
+    }
+    sched->buf[len] = '\0';
+    return len;
+}
+
+/** @brief Get the entry of a CPU, growing the arrays if a CPU was hotplugged.
+ *  @param sched The collector state.
+ *  @param id The CPU number.
+ *  @return The entry of the CPU.
+ */
+static struct sched_cpu *sched_cpu_get(struct sched_stats *sched, int id) {
+    if (id >= sched->ncpu) {
+        int ncpu = id + 1;
+        if ((sched->cpu = realloc(sched->cpu, ncpu * sizeof(struct sched_cpu))) == NULL ||
+            (sched->order = realloc(sched->order, ncpu * sizeof(struct sched_cpu *))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        memset(sched->cpu + sched->ncpu, 0, (ncpu - sched->ncpu) * sizeof(struct sched_cpu));
+        sched->ncpu = ncpu;
+    }
+    return &sched->cpu[id];
+}
+
+/** @brief Read the "cpuN" lines of "/proc/stat" or "/proc/schedstat".
+ *
+ *  Each line is "cpuN <numbers>", the other lines (the aggregate "cpu"
+ *  line, "domainN" lines, ...) are skipped.
+ *
+ *  @param sched The collector state.
+ *  @param fd The file to read.
+ *  @param schedstat Whether the file is "/proc/schedstat".
+ *  @return Void.
+ */
+static void sched_read(struct sched_stats *sched, int fd, int schedstat) {
+    uint64_t fields[SCHED_FIELDS];
+    const char *line, *ptr, *end;
+    char *next;
+    ssize_t len;
+
+    if ((len = sched_read_file(sched, fd)) <= 0) {
+        return;
+    }
+    end = sched->buf + len;
+    for (line = sched->buf; line != NULL && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') line ++;
+        if (strncmp(line, "cpu", 3) != 0 || line[3] < '0' || line[3] > '9') continue;
+
+        struct sched_cpu *cpu = sched_cpu_get(sched, (int) strtol(line + 3, &next, 10));
+        ptr = next;
+        if (schedstat) {
+            if (parse_u64_run(&ptr, end, fields, SCHED_FIELDS) == SCHED_FIELDS) {
+                cpu->wait = fields[SCHED_WAIT];
+                cpu->slices = fields[SCHED_SLICES];
+            }
+        } else {
+            memset(cpu->times, 0, sizeof(cpu->times));
+            parse_u64_run(&ptr, end, cpu->times, CPU_TIMES);
+            cpu->seen = 1;
+        }
+    }
+}
+
+/** @brief Compare two cores by run queue wait, then by utilization, for qsort().
+ *  @param a The first core.
+ *  @param b The second core.
+ *  @return A negative, zero or positive integer.
+ */
+static int sched_compare(const void *a, const void *b) {
+    const struct sched_cpu *x = *(struct sched_cpu * const *) a;
+    const struct sched_cpu *y = *(struct sched_cpu * const *) b;
+
+    if (x->wait_rate != y->wait_rate) return x->wait_rate < y->wait_rate ? 1 : -1;
+    if (x->util != y->util) return x->util < y->util ? 1 : -1;
+    return 0;
+}
+
+/** @brief Open "/proc/stat" and "/proc/schedstat" and take the first sample.
+ *  @param sched The collector state to initialize.
+ *  @return Void.
+ */
+void sched_init(struct sched_stats *sched) {
+    memset(sched, 0, sizeof(*sched));
+    if ((sched->stat_fd = open("/proc/stat", O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("open");
+        exit(1);
+    }
+    // Only there if the kernel is built with CONFIG_SCHEDSTATS
+    sched->schedstat_fd = open("/proc/schedstat", O_RDONLY | O_CLOEXEC);
+
+    sched->buf_size = 16384;
+    if ((sched->buf = malloc(sched->buf_size)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    sched_sample(sched);
+}
+
+/** @brief Re-read both files and compute the per-core rates.
+ *
+ *  util (%) = use_diff / total_diff * 100 (per core, see calculate_cpu_use)
+ *  wait (ms/sec) = (run_delay_curr - run_delay_prev) / 1e6 / interval
+ *  timeslices (per sec) = (pcount_curr - pcount_prev) / interval
+ *
+ *  @param sched The collector state.
+ *  @return Void.
+ */
+void sched_sample(struct sched_stats *sched) {
+    double interval = time_since(&sched->last);
+
+    for (int i = 0; i < sched->ncpu; i ++) {
+        sched->cpu[i].seen = 0;
+    }
+    sched_read(sched, sched->stat_fd, 0);
+    if (sched->schedstat_fd != -1) {
+        sched_read(sched, sched->schedstat_fd, 1);
+    }
+
+    for (int i = 0; i < sched->ncpu; i ++) {
+        struct sched_cpu *cpu = &sched->cpu[i];
+        if (!cpu->seen) {     // offline, its counters restart when it comes back
+            cpu->valid = 0;
+            cpu->util = cpu->wait_rate = cpu->slice_rate = 0.0;
+            continue;
+        }
+
+        if (cpu->valid && interval > 0) {
+            // The deltas are unsigned, so they are right across a wrap around
+            uint64_t idle = (cpu->times[CPU_IDLE] - cpu->times_prev[CPU_IDLE]) +
+                (cpu->times[CPU_IOWAIT] - cpu->times_prev[CPU_IOWAIT]);
+            uint64_t use = 0;
+            for (int j = CPU_USER; j <= CPU_SOFTIRQ; j ++) {
+                if (j != CPU_IDLE && j != CPU_IOWAIT) use += cpu->times[j] - cpu->times_prev[j];
+            }
+            cpu->util = use + idle > 0 ? 100.0 * use / (use + idle) : 0.0;
+            cpu->wait_rate = (cpu->wait - cpu->wait_prev) * 1e-6 / interval;
+            cpu->slice_rate = (cpu->slices - cpu->slices_prev) / interval;
+        }
+        memcpy(cpu->times_prev, cpu->times, sizeof(cpu->times));
+        cpu->wait_prev = cpu->wait;
+        cpu->slices_prev = cpu->slices;
+        cpu->valid = 1;
+    }
+}
+
+/** @brief Prints the scheduler section.
+ *
+ *  Print the total run queue wait and timeslice rates, then the cores
+ *  whose tasks waited the longest, with their utilization.
+ *
+ *  @param sched The collector state.
+ *  @return The number of lines printed.
+ */
+int show_sched_info(struct sched_stats *sched) {
+    double wait = 0, slices = 0;
+    int count = 0, lines = 0;
+
+    for (int i = 0; i < sched->ncpu; i ++) {
+        if (!sched->cpu[i].seen) continue;
+        wait += sched->cpu[i].wait_rate;
+        slices += sched->cpu[i].slice_rate;
+        sched->order[count ++] = &sched->cpu[i];
+    }
+    qsort(sched->order, count, sizeof(struct sched_cpu *), sched_compare);
+
+    printf("### Scheduler ### (per core: util, run queue wait, timeslices)\n");
+    lines ++;
+    if (sched->schedstat_fd == -1) {
+        printf(" run queue wait n/a (no /proc/schedstat, the kernel lacks CONFIG_SCHEDSTATS)\n");
+    } else {
+        printf(" total wait %.1f ms/s  timeslices %.0f/s  (%.3f ms per slice)\n",
+            wait, slices, slices > 0 ? wait / slices : 0.0);
+    }
+    lines ++;
+
+    for (int i = 0; i < count && i < SCHED_TOP; i ++) {
+        struct sched_cpu *cpu = sched->order[i];
+        printf(" cpu%-4ld util %6.2f%%", (long) (cpu - sched->cpu), cpu->util);
+        if (sched->schedstat_fd != -1) {
+            printf("  wait %8.1f ms/s  slices %8.0f/s", cpu->wait_rate, cpu->slice_rate);
+        }
+        printf("\n");
+        lines ++;
+    }
+    printf("---------------------------------------\n");
+    return lines + 1;
+}
+
+/** @brief Free the buffers and close the files.
+ *  @param sched The collector state.
+ *  @return Void.
+ */
+void sched_close(struct sched_stats *sched) {
+    close(sched->stat_fd);
+    if (sched->schedstat_fd != -1) close(sched->schedstat_fd);
+    free(sched->buf);
+    free(sched->cpu);
+    free(sched->order);
+}
@@ -0,0 +1,81 @@
+/*
+ * Header file for the per-core scheduler latency collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "stats_functions.h"
+
+#ifndef __Sched_header
+#define __Sched_header
+
+#define SCHED_TOP 8   // the number of cores listed, longest run queue wait first
+
+/** @brief State of one CPU kept between two samples.
+ *
+ *  All the counters are 64-bit and only used through unsigned deltas
+ *  (curr - prev), which stay correct when a counter wraps around.
+ */
+struct sched_cpu {
+    int seen;                          // whether the CPU is in the current sample
+    int valid;                         // whether the prev counters are set
+    uint64_t times[CPU_TIMES];         // the "cpuN" line of "/proc/stat"
+    uint64_t times_prev[CPU_TIMES];
+    uint64_t wait, wait_prev;          // the time runnable tasks waited (run_delay, in ns)
+    uint64_t slices, slices_prev;      // the timeslices run (pcount)
+    double util;                       // CPU (%) over the interval
+    double wait_rate;                  // milliseconds waited per second
+    double slice_rate;                 // timeslices per second
+};
+
+/** @brief State of the scheduler collector. */
+struct sched_stats {
+    int stat_fd;              // fd of "/proc/stat"
+    int schedstat_fd;         // fd of "/proc/schedstat", -1 if unavailable
+    char *buf;                // the buffer the files are read into
+    size_t buf_size;          // the size of buf
+    int ncpu;                 // the number of entries of cpu
+    struct sched_cpu *cpu;    // indexed by CPU number
+    struct sched_cpu **order; // the cores sorted for the report
+    struct timespec last;     // time of the previous sample
+};
+
+/** @brief Open "/proc/stat" and "/proc/schedstat" and take the first sample.
+ *  @param sched The collector state to initialize.
+ *  @return Void.
+ */
+void sched_init(struct sched_stats *sched);
+
+/** @brief Re-read both files and compute the per-core rates.
+ *
+ *  util (%) = use_diff / total_diff * 100 (per core, see calculate_cpu_use)
+ *  wait (ms/sec) = (run_delay_curr - run_delay_prev) / 1e6 / interval
+ *  timeslices (per sec) = (pcount_curr - pcount_prev) / interval
+ *
+ *  @param sched The collector state.
+ *  @return Void.
+ */
+void sched_sample(struct sched_stats *sched);
+
+/** @brief Prints the scheduler section.
+ *
+ *  Print the total run queue wait and timeslice rates, then the cores
+ *  whose tasks waited the longest, with their utilization.
+ *
+ *  @param sched The collector state.
+ *  @return The number of lines printed.
+ */
+int show_sched_info(struct sched_stats *sched);
+
+/** @brief Free the buffers and close the files.
+ *  @param sched The collector state.
+ *  @return Void.
+ */
+void sched_close(struct sched_stats *sched);
+
+#endif
@@ -0,0 +1,199 @@
+/** @file service.c
+ *  @brief Read the signals in the main loop, and run as a service
+ *
+ *  This file includes the functions that route the signals to a signalfd
+ *  watched by the main loop with its other fds, so that nothing runs in a
+ *  signal handler: Ctrl-C asks whether to quit while the sampling goes on,
+ *  and the answer is read key by key when it comes. In the "--daemon" mode
+ *  SIGTERM (or SIGINT) stops, SIGHUP reloads the alert rules and reopens
+ *  the outputs, the samples go to a file or nowhere, and the service
+ *  manager is told when the monitor is ready, reloading or stopping.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "service.h"
+
+/** @brief Ask whether to quit: read the answer key by key, without echo.
+ *  @param svc The state.
+ *  @return Void.
+ */
+static void service_ask(struct service *svc) {
+    struct termios raw;
+
+    if (svc->confirm) return;  // already asked
+    svc->confirm = 1;
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &svc->saved) == 0) {
+        // one key answers, and it is not echoed in the middle of the sections
+        raw = svc->saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcflush(STDIN_FILENO, TCIFLUSH);  // what was typed before is not the answer
+        svc->raw = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+}
+
+/** @brief Read the answer to the quit question, stdin being readable.
+ *  @param svc The state.
+ *  @return Void.
+ */
+void service_answer(struct service *svc) {
+    ssize_t len;
+    char c;
+
+    if ((len = read(STDIN_FILENO, &c, 1)) == -1) {
+        if (errno == EINTR || errno == EAGAIN) return;
+        perror("read");
+        exit(1);
+    }
+    if (len == 1 && (c == 'y' || c == 'Y')) {
+        svc->stop = 1;  // if user does want to quit, stop after this step
+    }
+    svc->confirm = 0;   // otherwise (or at the end of stdin) continue
+    if (svc->raw) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &svc->saved);
+        svc->raw = 0;
+    }
+}
+
+/** @brief Route the signals to a signalfd read by the main loop.
+ *
+ *  SIGINT, SIGTERM and SIGUSR1 (plus SIGTSTP interactively, SIGHUP for a
+ *  daemon) are blocked, so no handler runs in the middle of a sample or
+ *  of a printf(); the main loop watches the signalfd with its other fds.
+ *  The children are reaped by the kernel (SIGCHLD ignored). A daemon
+ *  prints to the output file, or to /dev/null.
+ *
+ *  @param svc The state to initialize.
+ *  @param daemon 1 for "--daemon", 0 for the interactive mode.
+ *  @param output The file the samples of a daemon are appended to, or NULL.
+ *  @return Void.
+ */
+void service_init(struct service *svc, int daemon, const char *output) {
+    sigset_t mask;
+
+    memset(svc, 0, sizeof(*svc));
+    svc->daemon = daemon;
+    svc->output = output;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGUSR1);
+    // a daemon reloads on SIGHUP, an interactive program ignores Ctrl-Z
+    sigaddset(&mask, daemon ? SIGHUP : SIGTSTP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1 ||
+        (svc->sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        perror("signalfd");
+        exit(1);
+    }
+    // the children must not stay zombies until the end of the run
+    if (signal(SIGCHLD, SIG_IGN) == SIG_ERR) {
+        perror("signal");
+        exit(1);
+    }
+    if (daemon) service_reopen(svc);
+}
+
+/** @brief Read the pending signals, without blocking.
+ *  @param svc The state, whose flags are set.
+ *  @return 1 if a signal was read, 0 otherwise.
+ */
+int service_signals(struct service *svc) {
+    struct signalfd_siginfo info;
+    int got = 0;
+
+    while (read(svc->sigfd, &info, sizeof(info)) == sizeof(info)) {
+        got = 1;
+        if (info.ssi_signo == SIGTERM || (info.ssi_signo == SIGINT && svc->daemon)) {
+            svc->stop = 1;
+        } else if (info.ssi_signo == SIGINT) {
+            service_ask(svc);   // the question is printed after the sample
+        } else if (info.ssi_signo == SIGHUP) {
+            svc->reload = 1;
+        } else if (info.ssi_signo == SIGUSR1) {
+            svc->summary = 1;
+        } else if (info.ssi_signo == SIGTSTP) {
+            printf("\033[2D");  // ignore Ctrl-Z, erase "^Z"
+        }
+    }
+    return got;
+}
+
+/** @brief Print the quit question, if Ctrl-C was hit and is not answered yet.
+ *
+ *  The question is printed below the last section, without a newline in
+ *  the refresh mode, so the next refresh erases it with the sections
+ *  (and prints it again while it is not answered).
+ *
+ *  @param svc The state.
+ *  @param sequential 1 if the samples are printed sequentially.
+ *  @return Void.
+ */
+void service_prompt(struct service *svc, int sequential) {
+    if (!svc->confirm) return;
+    fflush(stdout);  // after the sections
+    fprintf(stderr, "%s%s", SERVICE_PROMPT, sequential ? "\n" : "");
+}
+
+/** @brief Open the output file again (after it was rotated), or /dev/null.
+ *  @param svc The daemon state.
+ *  @return Void.
+ */
+void service_reopen(struct service *svc) {
+    const char *path = svc->output != NULL ? svc->output : "/dev/null";
+    int fd;
+
+    fflush(stdout);  // what was printed goes to the previous file
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) == -1) {
+        perror(path);
+        exit(1);
+    }
+    if (dup2(fd, STDOUT_FILENO) == -1) {
+        perror("dup2");
+        exit(1);
+    }
+    close(fd);
+}
+
+/** @brief Tell the service manager about the state, like sd_notify().
+ *
+ *  The state (e.g. "READY=1") is sent to the datagram socket of
+ *  $NOTIFY_SOCKET, if it is set, as systemd does for Type=notify units.
+ *
+ *  @param state The state.
+ *  @return Void.
+ */
+void service_notify(const char *state) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr;
+    size_t len;
+    int sock;
+
+    // an absolute path, or an abstract socket written "@name"
+    if (path == NULL || (path[0] != '/' && path[0] != '@') ||
+        (len = strlen(path)) >= sizeof(addr.sun_path)) {
+        return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len);
+    if (addr.sun_path[0] == '@') addr.sun_path[0] = '\0';
+
+    if ((sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)) == -1) {
+        return;  // the service manager only misses the notification
+    }
+    sendto(sock, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *) &addr,
+        offsetof(struct sockaddr_un, sun_path) + len);
+    close(sock);
+}
+
+/** @brief Close the signalfd and restore the terminal.
+ *  @param svc The state.
+ *  @return Void.
+ */
+void service_close(struct service *svc) {
+    if (svc->raw) tcsetattr(STDIN_FILENO, TCSANOW, &svc->saved);
+    close(svc->sigfd);
+}
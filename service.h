@@ -0,0 +1,99 @@
+/*
+ * Header file for the signals of the main loop and the daemon mode ("--daemon")
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef __Service_header
+#define __Service_header
+
+#define SERVICE_PROMPT "You hit Ctrl-C! Do you really want to quit? [y/n] "
+
+/** @brief The signals of the main loop, and the state of the daemon mode. */
+struct service {
+    int sigfd;               // signalfd of the blocked signals
+    int daemon;              // 1 for "--daemon"
+    const char *output;      // "--output=PATH", NULL to discard the samples
+    int stop;                // SIGTERM, or Ctrl-C confirmed (SIGINT for a daemon)
+    int reload;              // SIGHUP was received (daemon)
+    int summary;             // SIGUSR1 was received
+    int confirm;             // Ctrl-C was hit, the answer [y/n] is awaited
+    int raw;                 // the terminal reads the answer key by key, without echo
+    struct termios saved;    // the terminal settings to restore
+    unsigned long reloads;   // the number of SIGHUP handled
+};
+
+/** @brief Route the signals to a signalfd read by the main loop.
+ *
+ *  SIGINT, SIGTERM and SIGUSR1 (plus SIGTSTP interactively, SIGHUP for a
+ *  daemon) are blocked, so no handler runs in the middle of a sample or
+ *  of a printf(); the main loop watches the signalfd with its other fds.
+ *  The children are reaped by the kernel (SIGCHLD ignored). A daemon
+ *  prints to the output file, or to /dev/null.
+ *
+ *  @param svc The state to initialize.
+ *  @param daemon 1 for "--daemon", 0 for the interactive mode.
+ *  @param output The file the samples of a daemon are appended to, or NULL.
+ *  @return Void.
+ */
+void service_init(struct service *svc, int daemon, const char *output);
+
+/** @brief Read the answer to the quit question, stdin being readable.
+ *  @param svc The state.
+ *  @return Void.
+ */
+void service_answer(struct service *svc);
+
+/** @brief Read the pending signals, without blocking.
+ *  @param svc The state, whose flags are set.
+ *  @return 1 if a signal was read, 0 otherwise.
+ */
+int service_signals(struct service *svc);
+
+/** @brief Print the quit question, if Ctrl-C was hit and is not answered yet.
+ *
+ *  The question is printed below the last section, without a newline in
+ *  the refresh mode, so the next refresh erases it with the sections
+ *  (and prints it again while it is not answered).
+ *
+ *  @param svc The state.
+ *  @param sequential 1 if the samples are printed sequentially.
+ *  @return Void.
+ */
+void service_prompt(struct service *svc, int sequential);
+
+/** @brief Open the output file again (after it was rotated), or /dev/null.
+ *  @param svc The daemon state.
+ *  @return Void.
+ */
+void service_reopen(struct service *svc);
+
+/** @brief Tell the service manager about the state, like sd_notify().
+ *
+ *  The state (e.g. "READY=1") is sent to the datagram socket of
+ *  $NOTIFY_SOCKET, if it is set, as systemd does for Type=notify units.
+ *
+ *  @param state The state.
+ *  @return Void.
+ */
+void service_notify(const char *state);
+
+/** @brief Close the signalfd and restore the terminal.
+ *  @param svc The state.
+ *  @return Void.
+ */
+void service_close(struct service *svc);
+
+#endif
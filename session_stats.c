@@ -0,0 +1,194 @@
+/** @file session_stats.c
+ *  @brief Keep the list of the logged in sessions between samples
+ *
+ *  This file includes the functions that parse the USER_PROCESS records of
+ *  the utmp file into a cached session list, and re-parse it only when
+ *  inotify reports that the file changed. Logins are rare compared to the
+ *  samples, so on hosts with thousands of sessions most samples cost one
+ *  non-blocking read() on the inotify fd instead of a walk of the file.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "session_stats.h"
+#include <stddef.h>
+#include <libgen.h>
+
+/** @brief Compare two session counts by key, for qsort().
+ *  @param a The first count.
+ *  @param b The second count.
+ *  @return A negative, zero or positive integer.
+ */
+static int session_key_compare(const void *a, const void *b) {
+    const struct session_count *x = a, *y = b;
+
+    return strncmp(x->key, y->key, x->size);
+}
+
+/** @brief Compare two session counts by count (the largest first), then key, for qsort().
+ *  @param a The first count.
+ *  @param b The second count.
+ *  @return A negative, zero or positive integer.
+ */
+static int session_count_compare(const void *a, const void *b) {
+    const struct session_count *x = a, *y = b;
+
+    if (x->count != y->count) return y->count - x->count;
+    return strncmp(x->key, y->key, x->size);
+}
+
+/** @brief Count the sessions of each distinct value of a field.
+ *  @param sessions The collector state.
+ *  @param offset The offset of the field in struct utmp (ut_user or ut_host).
+ *  @param size The size of the field.
+ *  @param out Where to store the counts (sessions->count entries).
+ *  @return The number of distinct values.
+ */
+static int session_tally(struct session_stats *sessions, size_t offset, int size,
+    struct session_count *out) {
+    int distinct = 0;
+
+    for (int i = 0; i < sessions->count; i ++) {
+        out[i].key = (const char *) sessions->session[i] + offset;
+        out[i].size = size;
+        out[i].count = 1;
+    }
+    // Sort by key, so that the sessions of the same value are next to each other
+    qsort(out, sessions->count, sizeof(struct session_count), session_key_compare);
+    for (int i = 0; i < sessions->count; i ++) {
+        if (distinct > 0 && strncmp(out[distinct - 1].key, out[i].key, size) == 0) {
+            out[distinct - 1].count ++;
+        } else {
+            out[distinct ++] = out[i];
+        }
+    }
+    qsort(out, distinct, sizeof(struct session_count), session_count_compare);
+    return distinct;
+}
+
+/** @brief Read the utmp file in one shot, and list its USER_PROCESS records in place.
+ *
+ *  Unlike getutent(), which reads and copies one record at a time, the
+ *  file is read with a single pread() into a reused buffer, and the
+ *  sessions only point to the records.
+ *
+ *  @param sessions The collector state.
+ *  @return Void.
+ */
+void session_parse(struct session_stats *sessions) {
+    struct stat st;
+    size_t records = 0;
+    ssize_t len;
+    int fd;
+
+    sessions->count = 0;
+    if ((fd = open(sessions->path, O_RDONLY | O_CLOEXEC)) != -1) {
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            // Room for a few more records, in case the file grows meanwhile
+            records = st.st_size / sizeof(struct utmp) + 16;
+            if (records > sessions->buf_size) {
+                sessions->buf_size = records;
+                if ((sessions->buf = realloc(sessions->buf, records * sizeof(struct utmp))) == NULL) {
+                    perror("realloc");
+                    exit(1);
+                }
+            }
+            len = pread(fd, sessions->buf, records * sizeof(struct utmp), 0);
+            records = len > 0 ? len / sizeof(struct utmp) : 0;  // ignore a partial record
+        }
+        close(fd);
+    }
+
+    if (records > (size_t) sessions->capacity) {
+        sessions->capacity = records;
+        if ((sessions->session = realloc(sessions->session,
+                records * sizeof(struct utmp *))) == NULL ||
+            (sessions->by_user = realloc(sessions->by_user,
+                records * sizeof(struct session_count))) == NULL ||
+            (sessions->by_host = realloc(sessions->by_host,
+                records * sizeof(struct session_count))) == NULL ||
+            (sessions->usage != NULL && (sessions->usage = realloc(sessions->usage,
+                records * sizeof(struct session_usage))) == NULL)) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < records; i ++) {
+        if (sessions->buf[i].ut_type == USER_PROCESS) {
+            sessions->session[sessions->count ++] = &sessions->buf[i];
+        }
+    }
+
+    sessions->users = session_tally(sessions, offsetof(struct utmp, ut_user), UT_NAMESIZE,
+        sessions->by_user);
+    sessions->hosts = session_tally(sessions, offsetof(struct utmp, ut_host), UT_HOSTSIZE,
+        sessions->by_host);
+    sessions->parses ++;
+}
+
+/** @brief Parse the utmp file, and watch it for changes.
+ *
+ *  The directory of the file is watched (not the file itself), so that the
+ *  file is still followed when it is created or replaced by a rename.
+ *
+ *  @param sessions The collector state to initialize.
+ *  @param path The utmp file, NULL for the default one (_PATH_UTMP).
+ *  @return Void.
+ */
+void session_init(struct session_stats *sessions, const char *path) {
+    char dir[PATH_MAX];
+
+    memset(sessions, 0, sizeof(*sessions));
+    snprintf(sessions->path, sizeof(sessions->path), "%s", path != NULL ? path : _PATH_UTMP);
+    snprintf(dir, sizeof(dir), "%s", sessions->path);
+    sessions->name = strrchr(sessions->path, '/') != NULL ?
+        strrchr(sessions->path, '/') + 1 : sessions->path;
+
+    // If inotify is not available, fall back to parsing at every sample
+    if ((sessions->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) != -1 &&
+        inotify_add_watch(sessions->inotify_fd, dirname(dir),
+            IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_DELETE) == -1) {
+        close(sessions->inotify_fd);
+        sessions->inotify_fd = -1;
+    }
+    session_parse(sessions);
+}
+
+/** @brief Re-parse the utmp file if inotify reported a change since the last call.
+ *  @param sessions The collector state.
+ *  @return 1 if the file was parsed again, 0 otherwise.
+ */
+int session_sample(struct session_stats *sessions) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    int changed = sessions->inotify_fd == -1;
+    ssize_t len;
+
+    // Drain the events, the other files of the directory are ignored
+    while (sessions->inotify_fd != -1 && (len = read(sessions->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) ptr;
+            if ((event->mask & IN_Q_OVERFLOW) ||
+                (event->len > 0 && strcmp(event->name, sessions->name) == 0)) {
+                changed = 1;
+            }
+        }
+    }
+    if (changed) {
+        session_parse(sessions);
+    }
+    return changed;
+}
+
+/** @brief Free the session list and stop watching the file.
+ *  @param sessions The collector state.
+ *  @return Void.
+ */
+void session_close(struct session_stats *sessions) {
+    if (sessions->inotify_fd != -1) close(sessions->inotify_fd);
+    free(sessions->buf);
+    free(sessions->session);
+    free(sessions->by_user);
+    free(sessions->by_host);
+    free(sessions->usage);
+}
@@ -0,0 +1,90 @@
+/*
+ * Header file for the cached session/user collector
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <utmp.h>
+#include <paths.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#ifndef __Session_header
+#define __Session_header
+
+#define SESSION_TOP 5   // the number of users / hosts listed with their session count
+
+/** @brief The number of sessions of a user or of a host. */
+struct session_count {
+    const char *key;   // the ut_user or ut_host field of a record (not always '\0' terminated)
+    int size;          // the size of the field
+    int count;
+};
+
+/** @brief What the processes of a session cost the machine (see session_usage.c). */
+struct session_usage {
+    dev_t tty;         // the terminal of the session, 0 if unknown
+    double cpu;        // the CPU usage of its processes (in percentage of one core)
+    long long rss;     // their resident memory (in bytes)
+    int procs;         // the number of processes
+};
+
+/** @brief State of the session collector.
+ *
+ *  The sessions are parsed once, then only when inotify reports that the
+ *  utmp file has been written, created or replaced. The whole file is read
+ *  at once into buf, and the sessions point to its USER_PROCESS records.
+ */
+struct session_stats {
+    char path[PATH_MAX];          // the utmp file
+    const char *name;             // the file name of path, inside the watched directory
+    int inotify_fd;               // -1 if inotify is not available
+    struct utmp *buf;             // the records of the file
+    size_t buf_size;              // the number of records buf can hold
+    int count, capacity;          // the number of sessions, and allocated
+    const struct utmp **session;  // the USER_PROCESS records of buf
+    int users, hosts;             // the number of distinct users and hosts
+    struct session_count *by_user, *by_host;  // sorted by count
+    unsigned long parses;         // the number of times the file was parsed
+    struct session_usage *usage;  // per session, NULL if not attributed
+};
+
+/** @brief Parse the utmp file, and watch it for changes.
+ *
+ *  The directory of the file is watched (not the file itself), so that the
+ *  file is still followed when it is created or replaced by a rename.
+ *
+ *  @param sessions The collector state to initialize.
+ *  @param path The utmp file, NULL for the default one (_PATH_UTMP).
+ *  @return Void.
+ */
+void session_init(struct session_stats *sessions, const char *path);
+
+/** @brief Read the utmp file in one shot, and list its USER_PROCESS records in place.
+ *
+ *  Unlike getutent(), which reads and copies one record at a time, the
+ *  file is read with a single pread() into a reused buffer, and the
+ *  sessions only point to the records.
+ *
+ *  @param sessions The collector state.
+ *  @return Void.
+ */
+void session_parse(struct session_stats *sessions);
+
+/** @brief Re-parse the utmp file if inotify reported a change since the last call.
+ *  @param sessions The collector state.
+ *  @return 1 if the file was parsed again, 0 otherwise.
+ */
+int session_sample(struct session_stats *sessions);
+
+/** @brief Free the session list and stop watching the file.
+ *  @param sessions The collector state.
+ *  @return Void.
+ */
+void session_close(struct session_stats *sessions);
+
+#endif
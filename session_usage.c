@@ -0,0 +1,341 @@
+/** @file session_usage.c
+ *  @brief Attribute the CPU and memory of the processes to the sessions
+ *
+ *  This file includes the functions that join each logged in session (a
+ *  USER_PROCESS record of utmp) to its processes, by their session id and
+ *  controlling terminal in "/proc/[pid]/stat", and sum their CPU usage and
+ *  resident memory. The processes are kept in a hash table between scans,
+ *  with their stat file open and their CPU time of the previous scan, so a
+ *  scan is one readdir() of /proc and one pread() per process, whatever
+ *  the number of sessions. The same scan feeds the memory trend.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "stats_functions.h"
+#include "session_usage.h"
+
+/** @brief The time since boot, in clock ticks (the unit of starttime).
+ *  @param clk_tck The number of clock ticks per second.
+ *  @return The time since boot.
+ */
+static double boot_ticks(long clk_tck) {
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_BOOTTIME, &now) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    return (now.tv_sec + now.tv_nsec * 1e-9) * clk_tck;
+}
+
+/** @brief Compare two session keys, for qsort() and bsearch().
+ *  @param a The first key.
+ *  @param b The second key.
+ *  @return A negative, zero or positive integer.
+ */
+static int session_key_compare(const void *a, const void *b) {
+    const struct session_key *x = a, *y = b;
+
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return 0;
+}
+
+/** @brief Find the session of a key.
+ *  @param keys The keys, sorted.
+ *  @param count The number of keys.
+ *  @param key The session id or terminal to find.
+ *  @return The index of the session, or -1.
+ */
+static int session_key_find(const struct session_key *keys, int count, long long key) {
+    struct session_key target = {key, -1};
+    const struct session_key *found = bsearch(&target, keys, count,
+        sizeof(struct session_key), session_key_compare);
+
+    return found != NULL ? found->index : -1;
+}
+
+/** @brief Index the sessions by session id and by terminal, after utmp was parsed again.
+ *  @param cache The process cache.
+ *  @param sessions The session list.
+ *  @return Void.
+ */
+static void session_keys_build(struct pid_cache *cache, struct session_stats *sessions) {
+    char path[sizeof("/dev/") + UT_LINESIZE];
+    struct stat st;
+    int ttys = 0;
+
+    if ((cache->by_sid = realloc(cache->by_sid,
+            (sessions->count + 1) * sizeof(struct session_key))) == NULL ||
+        (cache->by_tty = realloc(cache->by_tty,
+            (sessions->count + 1) * sizeof(struct session_key))) == NULL) {
+        perror("realloc");
+        exit(1);
+    }
+    for (int i = 0; i < sessions->count; i ++) {
+        const struct utmp *record = sessions->session[i];
+
+        // ut_line is the terminal without "/dev/", e.g. "pts/3" or "tty1"
+        snprintf(path, sizeof(path), "/dev/%.*s", UT_LINESIZE, record->ut_line);
+        sessions->usage[i].tty = stat(path, &st) == 0 && S_ISCHR(st.st_mode) ? st.st_rdev : 0;
+        cache->by_sid[i].key = record->ut_pid;
+        cache->by_sid[i].index = i;
+        if (sessions->usage[i].tty != 0) {
+            cache->by_tty[ttys].key = sessions->usage[i].tty;
+            cache->by_tty[ttys ++].index = i;
+        }
+    }
+    qsort(cache->by_sid, sessions->count, sizeof(struct session_key), session_key_compare);
+    qsort(cache->by_tty, ttys, sizeof(struct session_key), session_key_compare);
+    cache->keys = ttys;
+    cache->parses = sessions->parses;
+}
+
+/** @brief Read the stat file of a process into cache->buf.
+ *  @param cache The process cache.
+ *  @param entry The process.
+ *  @return 1 on success, 0 if the process is gone.
+ */
+static int pid_read(struct pid_cache *cache, struct pid_entry *entry) {
+    char path[32];
+    ssize_t len;
+    int fd = entry->fd;
+
+    if (fd == -1) {
+        // out of fds: open the file for this scan only
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int) entry->pid);
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1) return 0;
+    }
+    // once the process has exited, a read on its open stat file fails with ESRCH
+    len = pread(fd, cache->buf, sizeof(cache->buf) - 1, 0);
+    if (fd != entry->fd) close(fd);
+    if (len <= 0) return 0;
+    cache->buf[len] = '\0';
+    return 1;
+}
+
+/** @brief Parse the fields of a stat file kept in the cache.
+ *
+ *  The command name (field 2) is in parentheses and may hold spaces or
+ *  parentheses, so the fields are counted from its last ')'.
+ *
+ *  @param buf The content of "/proc/[pid]/stat".
+ *  @param entry Where to store the command name, the session id (field 6),
+ *         the controlling terminal (field 7) and utime + stime (fields 14 and 15).
+ *  @param starttime Where to store the start time (field 22).
+ *  @param rss Where to store the resident set size in pages (field 24).
+ *  @return 1 on success, 0 otherwise.
+ */
+static int pid_parse(const char *buf, struct pid_entry *entry, unsigned long long *starttime,
+    long long *rss) {
+    const char *first = strchr(buf, '('), *last = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    size_t len;
+
+    if (first == NULL || last == NULL || last < first || sscanf(last + 2,
+            "%*c %*d %*d %d %d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %llu %*u %lld",
+            &entry->sid, &entry->tty, &utime, &stime, starttime, rss) != 6) {
+        return 0;
+    }
+    entry->ticks = utime + stime;
+    len = last - first - 1;
+    if (len > sizeof(entry->comm) - 1) len = sizeof(entry->comm) - 1;
+    memcpy(entry->comm, first + 1, len);
+    entry->comm[len] = '\0';
+    return 1;
+}
+
+/** @brief Start the process cache, and raise the limit of open files.
+ *
+ *  The stat file of each process stays open between scans, so a scan costs
+ *  one pread() per process instead of an open(), a read() and a close().
+ *
+ *  @param cache The cache to initialize.
+ *  @return Void.
+ */
+void pid_cache_init(struct pid_cache *cache) {
+    struct rlimit limit;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->clk_tck = sysconf(_SC_CLK_TCK);
+    cache->page_size = sysconf(_SC_PAGESIZE);
+    cache->boot_ticks = boot_ticks(cache->clk_tck);
+    time_since(&cache->last);
+
+    // One fd per process: use the hard limit, if it is not enough pid_read
+    // falls back to opening the file at every scan
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/** @brief Scan /proc, and read the stat file of every process into the cache.
+ *
+ *  Each process is one pread() of its stat file (kept open between scans).
+ *  A process started since the previous scan is counted from its start
+ *  (ticks_prev is 0), and the processes which have exited are dropped
+ *  (their anomaly series are listed in dropped, for the caller to remove).
+ *
+ *  @param cache The process cache.
+ *  @return Void.
+ */
+void pid_cache_scan(struct pid_cache *cache) {
+    double now = boot_ticks(cache->clk_tck);
+    unsigned long long starttime;
+    long long rss;
+    struct dirent *dir;
+    DIR *proc;
+
+    cache->interval = time_since(&cache->last);
+    cache->dropped_count = 0;
+    // the processes are optional, e.g. /proc may be mounted with hidepid
+    if ((proc = opendir("/proc")) == NULL) {
+        return;
+    }
+    cache->generation ++;
+    while ((dir = readdir(proc)) != NULL) {
+        if (dir->d_name[0] < '1' || dir->d_name[0] > '9') continue;  // not a process
+        pid_t pid = atoi(dir->d_name);
+        struct pid_entry **slot = &cache->bucket[pid & (PID_BUCKETS - 1)];
+        struct pid_entry *entry = *slot;
+        int fresh = 0;
+
+        while (entry != NULL && entry->pid != pid) entry = entry->next;
+        if (entry == NULL) {
+            char path[32];
+
+            if ((entry = calloc(1, sizeof(struct pid_entry))) == NULL) {
+                perror("calloc");
+                exit(1);
+            }
+            entry->pid = pid;
+            entry->series[0] = entry->series[1] = -1;
+            snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+            entry->fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (entry->fd == -1 && errno != EMFILE && errno != ENFILE) {
+                free(entry);  // the process is already gone
+                continue;
+            }
+            entry->next = *slot;
+            *slot = entry;
+            cache->entries ++;
+            fresh = 1;
+        }
+        entry->ticks_prev = entry->ticks;
+        if (!pid_read(cache, entry) || !pid_parse(cache->buf, entry, &starttime, &rss)) {
+            continue;  // the process is gone, the entry is dropped below
+        }
+        if (!fresh && starttime != entry->starttime) {
+            fresh = 1;  // the pid was reused since the previous scan
+        }
+        if (fresh) {
+            // count a process started since the previous scan from its start
+            entry->starttime = starttime;
+            entry->ticks_prev = starttime >= cache->boot_ticks ? 0 : entry->ticks;
+        }
+        entry->fresh = fresh;
+        entry->rss = rss * cache->page_size;
+        entry->generation = cache->generation;
+    }
+    closedir(proc);
+    cache->boot_ticks = now;
+
+    // drop the processes which have exited
+    for (int i = 0; i < PID_BUCKETS; i ++) {
+        struct pid_entry **slot = &cache->bucket[i];
+        while (*slot != NULL) {
+            struct pid_entry *entry = *slot;
+            if (entry->generation == cache->generation) {
+                slot = &entry->next;
+                continue;
+            }
+            *slot = entry->next;
+            for (int k = 0; k < 2 && entry->series[k] != -1; k ++) {
+                if (cache->dropped_count == cache->dropped_size) {
+                    cache->dropped_size = cache->dropped_size > 0 ? cache->dropped_size * 2 : 64;
+                    if ((cache->dropped = realloc(cache->dropped, cache->dropped_size * sizeof(int))) == NULL) {
+                        perror("realloc");
+                        exit(1);
+                    }
+                }
+                cache->dropped[cache->dropped_count ++] = entry->series[k];
+            }
+            if (entry->fd != -1) close(entry->fd);
+            free(entry);
+            cache->entries --;
+        }
+    }
+}
+
+/** @brief Attribute the CPU and memory of each process of the last scan to its session.
+ *
+ *  A process belongs to a session if its session id is the ut_pid of the
+ *  utmp record, or if its controlling terminal is the ut_line of the record.
+ *  The CPU usage of a process is the delta of its utime + stime since the
+ *  previous scan (see pid_cache_scan).
+ *
+ *  @param cache The process cache, scanned for this sample.
+ *  @param sessions The session list, whose usage is filled.
+ *  @return Void.
+ */
+void session_usage_sample(struct pid_cache *cache, struct session_stats *sessions) {
+    int index;
+
+    if (sessions->usage == NULL) {
+        if ((sessions->usage = calloc(sessions->capacity + 1, sizeof(struct session_usage))) == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        cache->parses = 0;
+    }
+    if (cache->parses != sessions->parses) {
+        session_keys_build(cache, sessions);
+    }
+    for (int i = 0; i < sessions->count; i ++) {
+        sessions->usage[i].cpu = 0.0;
+        sessions->usage[i].rss = 0;
+        sessions->usage[i].procs = 0;
+    }
+
+    for (int i = 0; i < PID_BUCKETS; i ++) {
+        for (struct pid_entry *entry = cache->bucket[i]; entry != NULL; entry = entry->next) {
+            index = session_key_find(cache->by_sid, sessions->count, entry->sid);
+            if (index == -1 && entry->tty != 0) {
+                // the kernel encodes the terminal as minor[19:8] major[7:0] minor[7:0]
+                int tty = entry->tty;
+                dev_t dev = makedev((tty >> 8) & 0xfff, (tty & 0xff) | ((tty >> 12) & 0xfff00));
+                index = session_key_find(cache->by_tty, cache->keys, dev);
+            }
+            if (index != -1) {
+                struct session_usage *usage = &sessions->usage[index];
+                usage->cpu += entry->ticks - entry->ticks_prev;
+                usage->rss += entry->rss;
+                usage->procs ++;
+            }
+        }
+    }
+
+    // ticks -> percentage of one core over the interval
+    for (int i = 0; i < sessions->count; i ++) {
+        sessions->usage[i].cpu *= cache->interval > 0 ? 100.0 / cache->clk_tck / cache->interval : 0.0;
+    }
+}
+
+/** @brief Close the stat files and free the cache.
+ *  @param cache The process cache.
+ *  @return Void.
+ */
+void pid_cache_close(struct pid_cache *cache) {
+    for (int i = 0; i < PID_BUCKETS; i ++) {
+        while (cache->bucket[i] != NULL) {
+            struct pid_entry *entry = cache->bucket[i];
+            cache->bucket[i] = entry->next;
+            if (entry->fd != -1) close(entry->fd);
+            free(entry);
+        }
+    }
+    free(cache->by_sid);
+    free(cache->by_tty);
+    free(cache->dropped);
+}
@@ -0,0 +1,110 @@
+/*
+ * Header file for the per session CPU and memory attribution
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/resource.h>
+#include "session_stats.h"
+#include "memory_trend.h"
+
+#ifndef __Session_usage_header
+#define __Session_usage_header
+
+#define PID_BUCKETS 4096   // the number of hash buckets of the process cache (a power of 2)
+
+/** @brief State of one process kept between two scans of /proc.
+ *
+ *  The cache is shared by the collectors which look at every process (the
+ *  session usage and the memory trend), so each process is read once per
+ *  sample, from one stat file kept open.
+ */
+struct pid_entry {
+    pid_t pid;
+    int fd;                          // fd of "/proc/[pid]/stat", -1 if out of fds
+    unsigned long long starttime;    // in clock ticks after boot, tells a reused pid
+    unsigned long long ticks;        // utime + stime at this scan
+    unsigned long long ticks_prev;   // utime + stime at the previous scan (0 for a new process)
+    int sid, tty;                    // the session id and the controlling terminal
+    long long rss;                   // the resident set size (in bytes)
+    char comm[16];                   // the command name
+    int fresh;                       // new (or a reused pid) at this scan
+    struct trend_fit fit;            // rss (bytes) over time (seconds), see memory_trend.c
+    int series[2];                   // its CPU and RSS anomaly series (see read_user_info), -1 if none
+    unsigned long generation;        // the last scan that saw the process
+    struct pid_entry *next;          // the next entry of the bucket
+};
+
+/** @brief A session key (a session id or a terminal) and the index of its session. */
+struct session_key {
+    long long key;
+    int index;
+};
+
+/** @brief State of the attribution, a cache of every process of the system. */
+struct pid_cache {
+    struct pid_entry *bucket[PID_BUCKETS];
+    int entries;                     // the number of cached processes
+    unsigned long generation;        // the number of scans
+    long clk_tck, page_size;
+    double boot_ticks;               // CLOCK_BOOTTIME of the previous scan, in clock ticks
+    struct timespec last;            // time of the previous scan
+    double interval;                 // seconds between the last two scans
+    int *dropped;                    // the series of the processes dropped by the last scan
+    int dropped_count, dropped_size;
+    unsigned long parses;            // the parse of the session list the keys were built from
+    int keys;                        // the number of sessions with a key
+    struct session_key *by_sid, *by_tty;  // sorted by key
+    char buf[1024];                  // the content of a stat file
+};
+
+/** @brief Start the process cache, and raise the limit of open files.
+ *
+ *  The stat file of each process stays open between scans, so a scan costs
+ *  one pread() per process instead of an open(), a read() and a close().
+ *
+ *  @param cache The cache to initialize.
+ *  @return Void.
+ */
+void pid_cache_init(struct pid_cache *cache);
+
+/** @brief Scan /proc, and read the stat file of every process into the cache.
+ *
+ *  Each process is one pread() of its stat file (kept open between scans).
+ *  A process started since the previous scan is counted from its start
+ *  (ticks_prev is 0), and the processes which have exited are dropped
+ *  (their anomaly series are listed in dropped, for the caller to remove).
+ *
+ *  @param cache The process cache.
+ *  @return Void.
+ */
+void pid_cache_scan(struct pid_cache *cache);
+
+/** @brief Attribute the CPU and memory of each process of the last scan to its session.
+ *
+ *  A process belongs to a session if its session id is the ut_pid of the
+ *  utmp record, or if its controlling terminal is the ut_line of the record.
+ *  The CPU usage of a process is the delta of its utime + stime since the
+ *  previous scan (see pid_cache_scan).
+ *
+ *  @param cache The process cache, scanned for this sample.
+ *  @param sessions The session list, whose usage is filled.
+ *  @return Void.
+ */
+void session_usage_sample(struct pid_cache *cache, struct session_stats *sessions);
+
+/** @brief Close the stat files and free the cache.
+ *  @param cache The process cache.
+ *  @return Void.
+ */
+void pid_cache_close(struct pid_cache *cache);
+
+#endif
@@ -18,6 +18,27 @@ void handle_error(char *message) {
     exit(0);
 }
 
+/** @brief Get the time elapsed since the last call (in seconds).
+ *
+ *  Use the monotonic clock, so that the interval between two samples of a
+ *  collector is not affected by changes of the system time.
+ *
+ *  @param last The time of the last call, updated to the current time.
+ *  @return The number of seconds elapsed.
+ */
+double time_since(struct timespec *last) {
+    struct timespec now;  // the current time
+    double elapsed;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == -1) {
+        perror("clock_gettime");
+        exit(1);
+    }
+    elapsed = (now.tv_sec - last->tv_sec) + (now.tv_nsec - last->tv_nsec) * 1e-9;
+    *last = now;
+    return elapsed;
+}
+
 /** @brief Print the memory usage of the current process in C (in kilobytes).
  *  @return Void.
  */
@@ -33,6 +54,63 @@ void show_runtime_info() {
     }
 }
 
+/** @brief Read "/proc/meminfo" in one pass.
+ *
+ *  The file is read at once with pread() (so the fd can stay open between
+ *  two samples), and each line is matched against a table of the keys of
+ *  struct meminfo, whatever the order of the lines is.
+ *
+ *  @param fd An fd of "/proc/meminfo".
+ *  @param mem Where to store the values.
+ *  @return 1 if the file has been read, 0 otherwise.
+ */
+int read_meminfo(int fd, struct meminfo *mem) {
+    // The keys we need, and where to store them in struct meminfo
+    static const struct { const char *key; size_t offset; } keys[] = {
+        {"MemTotal", offsetof(struct meminfo, total)},
+        {"MemFree", offsetof(struct meminfo, free)},
+        {"MemAvailable", offsetof(struct meminfo, available)},
+        {"Buffers", offsetof(struct meminfo, buffers)},
+        {"Cached", offsetof(struct meminfo, cached)},
+        {"SReclaimable", offsetof(struct meminfo, sreclaimable)},
+        {"SwapTotal", offsetof(struct meminfo, swap_total)},
+        {"SwapFree", offsetof(struct meminfo, swap_free)},
+        {"AnonPages", offsetof(struct meminfo, anon)},
+        {"Shmem", offsetof(struct meminfo, shmem)},
+        {"Slab", offsetof(struct meminfo, slab)},
+        {"Dirty", offsetof(struct meminfo, dirty)},
+        {"Writeback", offsetof(struct meminfo, writeback)},
+        {"HugePages_Total", offsetof(struct meminfo, huge_total)},
+        {"HugePages_Free", offsetof(struct meminfo, huge_free)},
+        {"Hugepagesize", offsetof(struct meminfo, huge_size)},
+    };
+    char buf[8192];   // the whole file (about 1.5 KB)
+    char *line, *colon;
+    ssize_t len;
+
+    if ((len = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+    memset(mem, 0, sizeof(*mem));
+
+    for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') line ++;
+        if ((colon = strchr(line, ':')) == NULL) break;
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i ++) {
+            if (strncmp(line, keys[i].key, colon - line) == 0 &&
+                keys[i].key[colon - line] == '\0') {
+                long long value = strtoll(colon + 1, NULL, 10);
+                // Every value is in kB, except the numbers of huge pages
+                if (strstr(keys[i].key, "HugePages_") != keys[i].key) value *= 1024;
+                *(long long *) ((char *) mem + keys[i].offset) = value;
+                break;
+            }
+        }
+    }
+    return 1;
+}
+
 /** @brief Virtualize the physical memory usage difference.
  *
  *  ::::::@ denoted that the total relative change is negative.
@@ -92,51 +170,30 @@ void show_memory_graph(double curr_use, double previous_use) {
  *  @return Void.
  */
 void get_memory_info(double previous_use, int graph_flag) {
-    FILE *meminfo;   // A file pointer pointing to "/proc/meminfo"
-    char line[200];  // A string storing each line of the file
-    long totalram, freeram, bufferram, cachedram, totalswap, freeswap, sreclaimable;
-    long phys_used, total_phys, virtual_used, total_virtual;
+    struct meminfo mem;  // the values read from "/proc/meminfo"
+    int fd;              // the fd of "/proc/meminfo"
+    long long phys_used, total_phys, virtual_used, total_virtual;
 
-    // If cannot open the file, report an error
-    if((meminfo = fopen("/proc/meminfo", "r")) == NULL) {
-        perror("fopen");
+    // If cannot open or read the file, report an error
+    if ((fd = open("/proc/meminfo", O_RDONLY)) == -1 || !read_meminfo(fd, &mem)) {
+        perror("/proc/meminfo");
         exit(1);
     }
-
-    // Loop the file util read all the information we need
-    while(fgets(line, sizeof(line), meminfo)) {
-        if(sscanf(line, "MemTotal: %ld kB", &totalram) == 1) {
-            totalram *= 1024;       // Convert into kilobytes
-            total_phys = totalram;  // Total Physical Memory = MemTotal
-        } else if (sscanf(line, "MemFree: %ld kB", &freeram) == 1){
-            freeram *= 1024;
-        } else if (sscanf(line, "Buffers: %ld kB", &bufferram) == 1) {
-            bufferram *= 1024;
-        } else if (sscanf(line, "Cached: %ld kB", &cachedram) == 1) {
-            cachedram *= 1024;
-        } else if (sscanf(line, "SwapTotal: %ld kB", &totalswap) == 1) {
-            totalswap *= 1024;
-            total_virtual = totalram + totalswap;  // Total Virtual Memory = MemTotal + SwapTotal
-        } else if (sscanf(line, "SwapFree: %ld kB", &freeswap) == 1) {
-            freeswap *= 1024;
-        } else if (sscanf(line, "SReclaimable: %ld kB", &sreclaimable) == 1) {
-            sreclaimable *= 1024;
-            cachedram += sreclaimable;  // Cached memory = Cached + SReclaimable
-            // Used Physical Memory = MemTotal - MemFree - (Buffers + Cached Memory)
-            phys_used = (totalram - freeram) - (bufferram + cachedram);
-            // Used Virtual Memory = MemTotal + SwapTotal - SwapFree - MemFree - (Buffers + Cached Memory)
-            virtual_used = phys_used + totalswap - freeswap;
-
-            // After reading the last argument, close the file.
-            // (Assume the informtion in "/proc/meminfo" is in default order)
-            // If fails, report an error.
-            if (fclose(meminfo) != 0) {
-                perror("fclose");
-                exit(1);
-            }
-        }
+    if (close(fd) != 0) {
+        perror("close");
+        exit(1);
     }
 
+    // Total Physical Memory = MemTotal
+    total_phys = mem.total;
+    // Total Virtual Memory = MemTotal + SwapTotal
+    total_virtual = mem.total + mem.swap_total;
+    // Used Physical Memory = MemTotal - MemFree - (Buffers + Cached Memory),
+    // where Cached memory = Cached + SReclaimable
+    phys_used = (mem.total - mem.free) - (mem.buffers + mem.cached + mem.sreclaimable);
+    // Used Virtual Memory = MemTotal + SwapTotal - SwapFree - MemFree - (Buffers + Cached Memory)
+    virtual_used = phys_used + mem.swap_total - mem.swap_free;
+
     // write to the standrad out (use dup2 to redirect to the pipe writing end)
     printf("%.2f GB / %.2f GB  -- %.2f GB / %.2f GB", phys_used * 1e-9,
         total_phys * 1e-9, virtual_used * 1e-9, total_virtual * 1e-9);
@@ -150,6 +207,78 @@ void get_memory_info(double previous_use, int graph_flag) {
     }
 }
 
+/** @brief Read "/proc/stat" in one pass.
+ *
+ *  The whole file is read at once with pread() (it grows with the number
+ *  of CPUs and interrupts), then the aggregate "cpu" line is parsed with
+ *  parse_u64_run into 64-bit counters, along with the scheduler counters
+ *  (ctxt, intr, processes, procs_running and procs_blocked).
+ *
+ *  @param fd An fd of "/proc/stat".
+ *  @param stat Where to store the values, the missing ones are set to 0.
+ *  @return 1 if the file has been read, 0 otherwise.
+ */
+int read_proc_stat(int fd, struct proc_stat *stat) {
+    size_t size = 8192, len = 0;
+    char *buf = malloc(size);
+    const char *line, *ptr;
+    ssize_t n;
+
+    if (buf == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memset(stat, 0, sizeof(*stat));
+    while ((n = pread(fd, buf + len, size - len - 1, len)) > 0) {
+        len += n;
+        if (len + 1 == size && (buf = realloc(buf, size *= 2)) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    buf[len] = '\0';
+
+    for (line = buf; line != NULL && *line; line = strchr(line, '\n')) {
+        if (*line == '\n') line ++;
+        if (strncmp(line, "cpu ", 4) == 0) {
+            ptr = line + 4;
+            parse_u64_run(&ptr, buf + len, stat->cpu, CPU_TIMES);
+        } else if (strncmp(line, "intr ", 5) == 0) {
+            stat->intr = strtoull(line + 5, NULL, 10);  // the total comes first
+        } else if (strncmp(line, "ctxt ", 5) == 0) {
+            stat->ctxt = strtoull(line + 5, NULL, 10);
+        } else if (strncmp(line, "processes ", 10) == 0) {
+            stat->processes = strtoull(line + 10, NULL, 10);
+        } else if (strncmp(line, "procs_running ", 14) == 0) {
+            stat->procs_running = strtoull(line + 14, NULL, 10);
+        } else if (strncmp(line, "procs_blocked ", 14) == 0) {
+            stat->procs_blocked = strtoull(line + 14, NULL, 10);
+        }
+    }
+    free(buf);
+    return len > 0;
+}
+
+/** @brief Read the load averages and task counts of "/proc/loadavg".
+ *  @param report Where to store the values.
+ *  @return Void.
+ */
+static void read_loadavg(struct cpu_report *report) {
+    FILE *file = fopen("/proc/loadavg", "r");
+
+    if (file == NULL) {
+        perror("fopen");
+        exit(1);
+    }
+    // e.g. "0.52 0.38 0.30 3/412 12345"
+    if (fscanf(file, "%lf %lf %lf %d/%d", &report->load[0], &report->load[1],
+        &report->load[2], &report->runnable, &report->tasks) != 5) {
+        memset(report->load, 0, sizeof(report->load));
+        report->runnable = report->tasks = 0;
+    }
+    fclose(file);
+}
+
 /** @brief Calculate CPU usage (in percentage) in real-time.
  * 
  *  Read the CPU information from Linux file "/proc/stat", and
@@ -160,60 +289,75 @@ void get_memory_info(double previous_use, int graph_flag) {
  *  where,
  *      use = user + nice + system + irq + softirq
  *      total = user + nice + system + idle + iowait + irq + softirq
+ *  The same two reads of "/proc/stat" give the run queue (procs_running,
+ *  procs_blocked) and the ctxt/intr/processes rates, and "/proc/loadavg"
+ *  gives the load averages. All of them are written as a struct cpu_report.
+ *  The second read is at an absolute time (the next tick of the samples),
+ *  so the samples do not drift by the time it takes to fork and print.
  *
- *  @param tdelay The period of time system between each time reading CPU info.
+ *  @param until When to read "/proc/stat" again (CLOCK_MONOTONIC).
  *  @return Void.
  */
-void calculate_cpu_use(int tdelay) {
-    FILE * stat; // A file pointer pointing to "/proc/stat"
+void calculate_cpu_use(const struct timespec *until) {
+    int fd; // An fd of "/proc/stat"
 
     // If fail to open the file, report an error
-    if((stat = fopen("/proc/stat", "r")) == NULL) {
-        perror("fopen");
+    if ((fd = open("/proc/stat", O_RDONLY | O_CLOEXEC)) == -1) {
+        perror("open");
         exit(1);
     }
 
-    // Variables storing the CPU information read from "/proc/stat"
-    int user_prev, nice_prev, system_prev, idle_prev, iowait_prev, irq_prev, softirq_prev;
-    int user_cur, nice_cur, system_cur, idle_cur, iowait_cur, irq_cur, softirq_cur;
-    
-    // Read the first line of the file "/proc/stat"
-    fscanf(stat, "cpu %d %d %d %d %d %d %d", &user_prev, &nice_prev, &system_prev,
-        &idle_prev, &iowait_prev, &irq_prev, &softirq_prev);
+    // The values read from "/proc/stat"
+    struct proc_stat prev, cur;
+    struct timespec last;
+    struct cpu_report report;
+
+    // Read the file "/proc/stat" for the first time
+    read_proc_stat(fd, &prev);
+    time_since(&last);
 
-    // Wait for a period of time
-    sleep(tdelay);
+    // Wait until the end of the sample
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, until, NULL) == EINTR);
 
-    // Read the file again, store the new CPU info in xxx_cur variables
-    rewind(stat);
-    fscanf(stat, "cpu %d %d %d %d %d %d %d", &user_cur, &nice_cur, &system_cur,
-        &idle_cur, &iowait_cur, &irq_cur, &softirq_cur);
+    // Read the file again, store the new CPU info in cur
+    read_proc_stat(fd, &cur);
+    double interval = time_since(&last);
 
     // Close the file. If fails, report an error.
-    if (fclose(stat) != 0) {
-        perror("fclose");
+    if (close(fd) != 0) {
+        perror("close");
         exit(1);
     }
 
     // idle = idle + iowait
-    int idle_previous = idle_prev + iowait_prev;
-    int idle_current = idle_cur + iowait_cur;
+    uint64_t idle_previous = prev.cpu[CPU_IDLE] + prev.cpu[CPU_IOWAIT];
+    uint64_t idle_current = cur.cpu[CPU_IDLE] + cur.cpu[CPU_IOWAIT];
 
     // use = user + nice + system + irq + softirq
-    int use_prev = user_prev + nice_prev + system_prev + irq_prev + softirq_prev;
-    int use_cur = user_cur + nice_cur + system_cur + irq_cur + softirq_cur;
+    uint64_t use_prev = prev.cpu[CPU_USER] + prev.cpu[CPU_NICE] + prev.cpu[CPU_SYSTEM] +
+        prev.cpu[CPU_IRQ] + prev.cpu[CPU_SOFTIRQ];
+    uint64_t use_cur = cur.cpu[CPU_USER] + cur.cpu[CPU_NICE] + cur.cpu[CPU_SYSTEM] +
+        cur.cpu[CPU_IRQ] + cur.cpu[CPU_SOFTIRQ];
 
     // use_diff = use_curr - use_prev
-    int numerator = use_cur - use_prev;
+    uint64_t numerator = use_cur - use_prev;
     // total = user + nice + system + idle + iowait + irq + softirq = use + idle
     // total_diff = total_curr - total_prev = use_diff + idle_diff
-    int denominator = numerator + idle_current - idle_previous;
+    uint64_t denominator = numerator + idle_current - idle_previous;
 
     // CPU (%) = (use_diff / total_diff) * 100
-    double cpu_use = 100 * (double)numerator / (double)denominator;
-
-    // write cpu usage to the stdout (use dup2 to redirect to pipe writing end)
-    if (write(fileno(stdout), &cpu_use, sizeof(double)) == -1) {
+    report.cpu_use = denominator > 0 ? 100 * (double)numerator / (double)denominator : 0.0;
+
+    // rate (per sec) = (counter_curr - counter_prev) / interval
+    report.ctxt_rate = interval > 0 ? (cur.ctxt - prev.ctxt) / interval : 0.0;
+    report.intr_rate = interval > 0 ? (cur.intr - prev.intr) / interval : 0.0;
+    report.fork_rate = interval > 0 ? (cur.processes - prev.processes) / interval : 0.0;
+    report.procs_running = cur.procs_running;
+    report.procs_blocked = cur.procs_blocked;
+    read_loadavg(&report);
+
+    // write the report to the stdout (use dup2 to redirect to pipe writing end)
+    if (write(fileno(stdout), &report, sizeof(report)) == -1) {
         perror("write");
         exit(1);
     }
@@ -222,87 +366,153 @@ void calculate_cpu_use(int tdelay) {
 /** @brief Virtualize the CPU usage (in percentage).
  *
  *  Use '|' to denote the positive percentage increase.
- *  The number of '|' is in proportion to the CPU usage percentage.
+ *  The number of '|' is in proportion to the CPU usage percentage,
+ *  followed by the 1, 5 and 15 minute averages and ranges (see window_stats.c).
  *
  *  @param percent A double representing CPU usage at current stage.
+ *  @param windows The windows of the CPU usage, including the current stage.
  *  @return Void.
  */
-void show_cpu_graph(double percent) {
+void show_cpu_graph(double percent, struct window_set *windows) {
     printf("\t");
     // Print '|' in proportion to the CPU usage percentage
     for (int i = 0; i < (int) (percent * 2); i ++) {
         printf("|");
     }
     // Print the CPU usage percentage at the end of the graph
-    printf(" %.2f\n", percent);
+    printf(" %.2f", percent);
+    show_window(windows);
+    printf("\n");
 }
 
 /** @brief Prints the number of CPU cores and CPU usage percentage.
+ *  @param cpu_use The CPU usage (in percentage).
+ *  @param cores The number of online cores (see sys_info.c).
  *  @return Void.
  */
-void show_cpu_info(double cpu_use) {
-    // Get the number of processors which are currently online.
-    int cores = (int) sysconf(_SC_NPROCESSORS_ONLN);
+void show_cpu_info(double cpu_use, int cores) {
+    printf("Number of cores: %d\n", cores);
 
-    if (cores < 0) {  // If on error (return -1), report the error.
-        perror("sysconf");
-        exit(1);
-    } else {          // Otherwise print the information.
-        printf("Number of cores: %d\n", cores);
-    }
-    
     // display cpu usage
     printf(" total cpu use = %.2f%%\n", cpu_use);
 }
 
+/** @brief Prints the load averages, the run queue and the scheduler rates.
+ *
+ *  The CPUs are saturated when more tasks are runnable than there are
+ *  cores (procs_running includes the tasks currently running). The CPU
+ *  child reading "/proc/stat" is itself running, so it is not counted:
+ *  otherwise an idle single core would always look saturated.
+ *
+ *  @param report The report of the CPU child (see calculate_cpu_use).
+ *  @param cores The number of online cores (see sys_info.c).
+ *  @return The number of lines printed.
+ */
+int show_cpu_load(struct cpu_report *report, int cores) {
+    uint64_t others = report->procs_running > 0 ? report->procs_running - 1 : 0;  // without the sampler
+
+    printf(" load average %.2f %.2f %.2f  runnable %d/%d tasks%s\n",
+        report->load[0], report->load[1], report->load[2],
+        report->runnable, report->tasks,
+        cores > 0 && others > (uint64_t) cores ? "  (saturated: run queue > cores)" : "");
+    printf(" procs running %llu  blocked %llu  ctxt %.0f/s  intr %.0f/s  forks %.0f/s\n",
+        (unsigned long long) report->procs_running, (unsigned long long) report->procs_blocked,
+        report->ctxt_rate, report->intr_rate, report->fork_rate);
+    return 2;
+}
+
 /** @brief Prints User Usage information.
  *
- *  Use getutent() function from <utmp.h> library to get the user usage.
  *  Print user's name, type of the terminal device, and their remote IP
- *  address iff the username exists.
+ *  address for each session of the cached list (see session_stats.c, the
+ *  utmp file is only parsed again when it changes), then the number of
+ *  sessions of the users and remote hosts with the most of them. With
+ *  "--session-usage", each session also shows the CPU and memory of its
+ *  processes.
  *
+ *  @param sessions The session collector state.
  *  @return Void.
  */
-void show_session_user() {
-    struct utmp *users; // a variable to store user information
-    setutent();         // rewinds the file pointer to the beginning of the utmp file
-    users = getutent(); // get the information about who is currently using the system
-
+void show_session_user(struct session_stats *sessions) {
     printf("### Sessions/users ###\n");
 
-    // while we still have users, print their information
-    while(users != NULL) {
-        // print user information if username exists
-        if (users -> ut_type == USER_PROCESS) {
-        	printf(" %s\t%s (%s)\n", users -> ut_user,
-                users -> ut_line, users -> ut_host);
+    // print the information of each session
+    // (the fields of a record are not always '\0' terminated)
+    for (int i = 0; i < sessions->count; i ++) {
+        const struct utmp *users = sessions->session[i];
+        printf(" %.*s\t%.*s (%.*s)", UT_NAMESIZE, users -> ut_user,
+            UT_LINESIZE, users -> ut_line, UT_HOSTSIZE, users -> ut_host);
+        if (sessions->usage != NULL) {
+            // what the processes of the session use (see session_usage.c)
+            printf("  cpu %5.1f%%  rss %7.1f MB  %d procs", sessions->usage[i].cpu,
+                sessions->usage[i].rss / (1024.0 * 1024.0), sessions->usage[i].procs);
         }
-        users = getutent();  // get the next user information
+        printf("\n");
+    }
+
+    // print the users and hosts with the most sessions
+    if (sessions->count > 0) {
+        printf(" %d sessions, %d users:", sessions->count, sessions->users);
+        for (int i = 0; i < sessions->users && i < SESSION_TOP; i ++) {
+            printf(" %.*s %d", UT_NAMESIZE, sessions->by_user[i].key, sessions->by_user[i].count);
+        }
+        printf("\n %d hosts:", sessions->hosts);
+        for (int i = 0; i < sessions->hosts && i < SESSION_TOP; i ++) {
+            const char *host = sessions->by_host[i].key;
+            printf(" %.*s %d", UT_HOSTSIZE, *host ? host : "(local)", sessions->by_host[i].count);
+        }
+        printf("\n");
     }
-    endutent();        // closes the utmp file
     printf("---------------------------------------\n");
 }
 
 /** @brief Prints system information.
  *
- *  Use uname from <sys/utsname.h> library to get the system information.
- *  Print the OS name, release information, architecture, and version of OS.
+ *  Print the OS name, release information, architecture, and version of OS
+ *  (from uname), then the CPU model, cores, caches, NUMA nodes and boot
+ *  time, all from the cache read at startup (see sys_info.c).
  *
+ *  @param info The system information cache.
  *  @return Void.
  */
-void show_sys_info() {
-    struct utsname uts;       // A variable to store system information
-
-    if (uname(&uts) < 0) {    // Get the system information
-        perror("Get Uname");  // If fails, report an error
-        exit(1);
-    }
+void show_sys_info(struct sys_info *info) {
+    struct utsname *uts = &info->uts;
+    char boot[64];
+    long uptime = (long) (time(NULL) - info->boot_time);
 
     printf("### System Information ###\n");
-    printf(" System Name = %s\n", uts.sysname);
-    printf(" Machine Name = %s\n", uts.nodename);
-    printf(" Version = %s\n", uts.version);
-    printf(" Release = %s\n", uts.release);
-    printf(" Architecture = %s\n", uts.machine);
+    printf(" System Name = %s\n", uts->sysname);
+    printf(" Machine Name = %s\n", uts->nodename);
+    printf(" Version = %s\n", uts->version);
+    printf(" Release = %s\n", uts->release);
+    printf(" Architecture = %s\n", uts->machine);
+    printf(" CPU = %s, %d of %d cores online (%s)\n", info->model,
+        info->cores, info->configured, info->online[0] ? info->online : "?");
+
+    if (info->cache_count > 0) {
+        printf(" Caches =");
+        for (int i = 0; i < info->cache_count; i ++) {
+            const struct sys_cache *cache = &info->cache[i];
+            // "L1d", "L1i" or "L2"
+            printf(" L%d%s %s", cache->level, strcmp(cache->type, "Data") == 0 ? "d" :
+                strcmp(cache->type, "Instruction") == 0 ? "i" : "", cache->size);
+            if (cache->shared > 1) printf(" (%d cpus)", cache->shared);
+        }
+        printf("\n");
+    }
+    if (info->node_count > 0) {
+        printf(" NUMA nodes = %d:", info->node_count);
+        for (int i = 0; i < info->node_count; i ++) {
+            printf(" node%d %d cpus %.2f GB", info->node[i].id, info->node[i].cpus,
+                info->node[i].total / (1024.0 * 1024.0 * 1024.0));
+            if (i < info->node_count - 1) printf(",");
+        }
+        printf("\n");
+    }
+    if (info->boot_time > 0 &&
+        strftime(boot, sizeof(boot), "%Y-%m-%d %H:%M:%S", localtime(&info->boot_time)) > 0) {
+        printf(" Boot time = %s (up %ld days %02ld:%02ld)\n", boot,
+            uptime / 86400, uptime / 3600 % 24, uptime / 60 % 60);
+    }
     printf("---------------------------------------\n");
-}
\ No newline at end of file
+}
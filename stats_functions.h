@@ -12,17 +12,83 @@
 #include <sys/types.h>
 #include <utmp.h>
 #include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "parse_numbers.h"
+#include "session_stats.h"
+#include "sys_info.h"
+#include "window_stats.h"
 
 #ifndef __Stats_header
 #define __Stats_header
 
+/** @brief The values read from "/proc/meminfo" (in bytes).
+ */
+struct meminfo {
+    long long total, free, available, buffers, cached, sreclaimable;
+    long long swap_total, swap_free;
+    long long anon, shmem, slab, dirty, writeback;
+    long long huge_total, huge_free, huge_size;  // HugePages_* are in pages
+};
+
+/** @brief The fields of a "cpu" line of "/proc/stat" (in clock ticks).
+ */
+enum cpu_time {
+    CPU_USER, CPU_NICE, CPU_SYSTEM, CPU_IDLE, CPU_IOWAIT,
+    CPU_IRQ, CPU_SOFTIRQ, CPU_STEAL, CPU_GUEST, CPU_GUEST_NICE,
+    CPU_TIMES
+};
+
+/** @brief The values read from "/proc/stat".
+ */
+struct proc_stat {
+    uint64_t cpu[CPU_TIMES];        // the aggregate "cpu" line
+    uint64_t ctxt, intr, processes; // context switches, interrupts and forks since boot
+    uint64_t procs_running, procs_blocked;  // the tasks runnable / blocked on I/O
+};
+
+/** @brief What the CPU child reports to the parent (see calculate_cpu_use).
+ */
+struct cpu_report {
+    double cpu_use;                 // the CPU usage (in percentage)
+    double load[3];                 // the 1, 5 and 15 min load averages
+    int runnable, tasks;            // the runnable and total tasks of "/proc/loadavg"
+    uint64_t procs_running, procs_blocked;
+    double ctxt_rate, intr_rate, fork_rate;  // per sec
+};
+
 void handle_error(char *message);
 
+/** @brief Get the time elapsed since the last call (in seconds).
+ *
+ *  Use the monotonic clock, so that the interval between two samples of a
+ *  collector is not affected by changes of the system time.
+ *
+ *  @param last The time of the last call, updated to the current time.
+ *  @return The number of seconds elapsed.
+ */
+double time_since(struct timespec *last);
+
 /** @brief Print the memory usage of the current process in C (in kilobytes).
  *  @return Void.
  */
 void show_runtime_info();
 
+/** @brief Read "/proc/meminfo" in one pass.
+ *
+ *  The file is read at once with pread() (so the fd can stay open between
+ *  two samples), and each line is matched against a table of the keys of
+ *  struct meminfo, whatever the order of the lines is.
+ *
+ *  @param fd An fd of "/proc/meminfo".
+ *  @param mem Where to store the values.
+ *  @return 1 if the file has been read, 0 otherwise.
+ */
+int read_meminfo(int fd, struct meminfo *mem);
+
 /** @brief Virtualize the physical memory usage difference.
  *
  *  ::::::@ denoted that the total relative change is negative.
@@ -56,6 +122,19 @@ void show_memory_graph(double curr_use, double previous_use);
  */
 void get_memory_info(double previous_use, int graph_flag);
 
+/** @brief Read "/proc/stat" in one pass.
+ *
+ *  The whole file is read at once with pread() (it grows with the number
+ *  of CPUs and interrupts), then the aggregate "cpu" line is parsed with
+ *  parse_u64_run into 64-bit counters, along with the scheduler counters
+ *  (ctxt, intr, processes, procs_running and procs_blocked).
+ *
+ *  @param fd An fd of "/proc/stat".
+ *  @param stat Where to store the values, the missing ones are set to 0.
+ *  @return 1 if the file has been read, 0 otherwise.
+ */
+int read_proc_stat(int fd, struct proc_stat *stat);
+
 /** @brief Calculate CPU usage (in percentage) in real-time.
  * 
  *  Read the CPU information from Linux file "/proc/stat", and
@@ -66,44 +145,72 @@ void get_memory_info(double previous_use, int graph_flag);
  *  where,
  *      use = user + nice + system + irq + softirq
  *      total = user + nice + system + idle + iowait + irq + softirq
+ *  The same two reads of "/proc/stat" give the run queue (procs_running,
+ *  procs_blocked) and the ctxt/intr/processes rates, and "/proc/loadavg"
+ *  gives the load averages. All of them are written as a struct cpu_report.
+ *  The second read is at an absolute time (the next tick of the samples),
+ *  so the samples do not drift by the time it takes to fork and print.
  *
- *  @param tdelay The period of time system between each time reading CPU info.
+ *  @param until When to read "/proc/stat" again (CLOCK_MONOTONIC).
  *  @return Void.
  */
-void calculate_cpu_use(int tdelay);
+void calculate_cpu_use(const struct timespec *until);
 
 /** @brief Virtualize the CPU usage (in percentage).
  *
  *  Use '|' to denote the positive percentage increase.
- *  The number of '|' is in proportion to the CPU usage percentage.
+ *  The number of '|' is in proportion to the CPU usage percentage,
+ *  followed by the 1, 5 and 15 minute averages and ranges (see window_stats.c).
  *
  *  @param percent A double representing CPU usage at current stage.
+ *  @param windows The windows of the CPU usage, including the current stage.
  *  @return Void.
  */
-void show_cpu_graph(double percent);
+void show_cpu_graph(double percent, struct window_set *windows);
 
 /** @brief Prints the number of CPU cores and CPU usage percentage.
+ *  @param cpu_use The CPU usage (in percentage).
+ *  @param cores The number of online cores (see sys_info.c).
  *  @return Void.
  */
-void show_cpu_info(double cpu_use);
+void show_cpu_info(double cpu_use, int cores);
+
+/** @brief Prints the load averages, the run queue and the scheduler rates.
+ *
+ *  The CPUs are saturated when more tasks are runnable than there are
+ *  cores (procs_running includes the tasks currently running). The CPU
+ *  child reading "/proc/stat" is itself running, so it is not counted:
+ *  otherwise an idle single core would always look saturated.
+ *
+ *  @param report The report of the CPU child (see calculate_cpu_use).
+ *  @param cores The number of online cores (see sys_info.c).
+ *  @return The number of lines printed.
+ */
+int show_cpu_load(struct cpu_report *report, int cores);
 
 /** @brief Prints User Usage information.
  *
- *  Use getutent() function from <utmp.h> library to get the user usage.
  *  Print user's name, type of the terminal device, and their remote IP
- *  address iff the username exists.
+ *  address for each session of the cached list (see session_stats.c, the
+ *  utmp file is only parsed again when it changes), then the number of
+ *  sessions of the users and remote hosts with the most of them. With
+ *  "--session-usage", each session also shows the CPU and memory of its
+ *  processes.
  *
+ *  @param sessions The session collector state.
  *  @return Void.
  */
-void show_session_user();
+void show_session_user(struct session_stats *sessions);
 
 /** @brief Prints system information.
  *
- *  Use uname from <sys/utsname.h> library to get the system information.
- *  Print the OS name, release information, architecture, and version of OS.
+ *  Print the OS name, release information, architecture, and version of OS
+ *  (from uname), then the CPU model, cores, caches, NUMA nodes and boot
+ *  time, all from the cache read at startup (see sys_info.c).
  *
+ *  @param info The system information cache.
  *  @return Void.
  */
-void show_sys_info();
+void show_sys_info(struct sys_info *info);
 
 #endif
\ No newline at end of file
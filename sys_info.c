@@ -0,0 +1,224 @@
+/** @file sys_info.c
+ *  @brief Keep the static system information between samples
+ *
+ *  This file includes the functions that read the kernel and host names,
+ *  the number of cores, the CPU model, the cache sizes, the NUMA nodes and
+ *  the boot time once at startup. Only the list of online CPUs is checked
+ *  at every sample, and the CPU topology is read again when it changes
+ *  (a CPU hotplug), instead of asking uname() and sysconf() every time.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "sys_info.h"
+
+/** @brief Compare two NUMA nodes by number, for qsort().
+ *  @param a The first node.
+ *  @param b The second node.
+ *  @return A negative, zero or positive integer.
+ */
+static int sys_node_compare(const void *a, const void *b) {
+    return ((const struct sys_node *) a)->id - ((const struct sys_node *) b)->id;
+}
+
+/** @brief Count the CPUs of a CPU list, e.g. "0-3,8-11" is 8 CPUs.
+ *  @param list The CPU list.
+ *  @return The number of CPUs.
+ */
+static int cpulist_count(const char *list) {
+    int count = 0, first, last, len;
+
+    while (sscanf(list, "%d%n", &first, &len) == 1) {
+        list += len;
+        last = first;
+        if (*list == '-' && sscanf(list + 1, "%d%n", &last, &len) == 1) {
+            list += len + 1;
+        }
+        count += last - first + 1;
+        if (*list != ',') break;
+        list ++;
+    }
+    return count;
+}
+
+/** @brief Read the first line of a small file.
+ *  @param path The file.
+ *  @param buf Where to store the line, without its '\n'.
+ *  @param size The size of buf.
+ *  @return 1 on success, 0 otherwise.
+ */
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *file = fopen(path, "r");
+    int ok;
+
+    if (file == NULL) return 0;
+    ok = fgets(buf, size, file) != NULL;
+    fclose(file);
+    if (ok) buf[strcspn(buf, "\n")] = '\0';
+    return ok;
+}
+
+/** @brief Read the caches of the first online CPU.
+ *  @param info The cache.
+ *  @return Void.
+ */
+static void sys_info_caches(struct sys_info *info) {
+    char path[128], line[SYS_INFO_CPULIST];
+    int cpu = 0;
+
+    sscanf(info->online, "%d", &cpu);
+    info->cache_count = 0;
+    for (int i = 0; info->cache_count < SYS_INFO_MAX_CACHES; i ++) {
+        struct sys_cache *cache = &info->cache[info->cache_count];
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+        if (!read_line(path, line, sizeof(line))) break;  // no more cache
+        cache->level = atoi(line);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, i);
+        if (!read_line(path, cache->type, sizeof(cache->type))) cache->type[0] = '\0';
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, i);
+        if (!read_line(path, cache->size, sizeof(cache->size))) continue;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+        cache->shared = read_line(path, line, sizeof(line)) ? cpulist_count(line) : 1;
+        info->cache_count ++;
+    }
+}
+
+/** @brief Read the NUMA nodes, their CPUs and their memory.
+ *  @param info The cache.
+ *  @return Void.
+ */
+static void sys_info_nodes(struct sys_info *info) {
+    char path[128], line[SYS_INFO_CPULIST];
+    struct dirent *dirent;
+    DIR *stream;
+    long long kb;
+    int id;
+
+    info->node_count = 0;
+    // A kernel without NUMA support has no node directory, report no node
+    if ((stream = opendir("/sys/devices/system/node")) == NULL) {
+        return;
+    }
+    while ((dirent = readdir(stream)) != NULL && info->node_count < SYS_INFO_MAX_NODES) {
+        if (sscanf(dirent->d_name, "node%d", &id) != 1) continue;
+
+        struct sys_node *node = &info->node[info->node_count ++];
+        node->id = id;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", id);
+        node->cpus = read_line(path, line, sizeof(line)) ? cpulist_count(line) : 0;
+        // the first line is "Node N MemTotal: X kB"
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/meminfo", id);
+        node->total = read_line(path, line, sizeof(line)) &&
+            sscanf(line, "Node %*d MemTotal: %lld", &kb) == 1 ? kb * 1024 : 0;
+    }
+    closedir(stream);
+
+    // readdir() does not list the nodes in order
+    qsort(info->node, info->node_count, sizeof(struct sys_node), sys_node_compare);
+}
+
+/** @brief Read what depends on the online CPUs (cores, caches, NUMA nodes).
+ *  @param info The cache.
+ *  @return Void.
+ */
+static void sys_info_topology(struct sys_info *info) {
+    info->cores = info->online[0] != '\0' ? cpulist_count(info->online) :
+        (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (info->cores < 1) info->cores = 1;
+    sys_info_caches(info);
+    sys_info_nodes(info);
+    info->reloads ++;
+}
+
+/** @brief Read the list of the online CPUs.
+ *  @param info The cache.
+ *  @param buf Where to store the list.
+ *  @return 1 on success, 0 otherwise.
+ */
+static int sys_info_online(struct sys_info *info, char *buf) {
+    ssize_t len;
+
+    if (info->online_fd == -1 ||
+        (len = pread(info->online_fd, buf, SYS_INFO_CPULIST - 1, 0)) <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 1;
+}
+
+/** @brief Read the system information once for the whole run.
+ *  @param info The cache to fill.
+ *  @return Void.
+ */
+void sys_info_init(struct sys_info *info) {
+    char line[256];
+    FILE *file;
+
+    memset(info, 0, sizeof(*info));
+    if (uname(&info->uts) < 0) {  // Get the system information
+        perror("Get Uname");      // If fails, report an error
+        exit(1);
+    }
+    info->configured = (int) sysconf(_SC_NPROCESSORS_CONF);
+
+    // the model is "model name" on x86, other architectures use other keys
+    snprintf(info->model, sizeof(info->model), "unknown");
+    if ((file = fopen("/proc/cpuinfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            char *value = strchr(line, ':');
+            if (value == NULL || (strncmp(line, "model name", 10) != 0 &&
+                strncmp(line, "cpu model", 9) != 0 && strncmp(line, "Hardware", 8) != 0)) {
+                continue;
+            }
+            value += strspn(value + 1, " \t") + 1;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(info->model, sizeof(info->model), "%s", value);
+            break;
+        }
+        fclose(file);
+    }
+
+    if ((file = fopen("/proc/stat", "r")) != NULL) {
+        while (fgets(line, sizeof(line), file) != NULL) {
+            long long btime;
+            if (sscanf(line, "btime %lld", &btime) == 1) {
+                info->boot_time = (time_t) btime;
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    info->online_fd = open("/sys/devices/system/cpu/online", O_RDONLY | O_CLOEXEC);
+    if (!sys_info_online(info, info->online)) info->online[0] = '\0';
+    sys_info_topology(info);
+}
+
+/** @brief Read the CPU topology again if the set of online CPUs changed.
+ *
+ *  The check is a single pread() of "/sys/devices/system/cpu/online", so
+ *  it can be done at every sample.
+ *
+ *  @param info The cache.
+ *  @return 1 if a CPU went on or offline, 0 otherwise.
+ */
+int sys_info_refresh(struct sys_info *info) {
+    char online[SYS_INFO_CPULIST];
+
+    if (!sys_info_online(info, online) || strcmp(online, info->online) == 0) {
+        return 0;
+    }
+    memcpy(info->online, online, sizeof(online));
+    sys_info_topology(info);
+    return 1;
+}
+
+/** @brief Close the file watched for CPU hotplug.
+ *  @param info The cache.
+ *  @return Void.
+ */
+void sys_info_close(struct sys_info *info) {
+    if (info->online_fd != -1) close(info->online_fd);
+}
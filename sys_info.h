@@ -0,0 +1,74 @@
+/*
+ * Header file for the cached static system information
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#ifndef __Sys_info_header
+#define __Sys_info_header
+
+#define SYS_INFO_MAX_CACHES 8    // the maximum number of cache levels reported
+#define SYS_INFO_MAX_NODES 64    // the maximum number of NUMA nodes reported
+#define SYS_INFO_CPULIST 256     // the size of a CPU list (e.g. "0-3,8-11")
+
+/** @brief One cache of the first online CPU (a ".../cache/indexN" directory). */
+struct sys_cache {
+    int level;                   // 1, 2, 3...
+    char type[16];               // "Data", "Instruction" or "Unified"
+    char size[16];               // as the kernel writes it, e.g. "32K"
+    int shared;                  // the number of CPUs sharing it
+};
+
+/** @brief One NUMA node. */
+struct sys_node {
+    int id;                      // the node number
+    int cpus;                    // the number of its CPUs
+    long long total;             // its MemTotal (in bytes)
+};
+
+/** @brief The system information, read at startup and when a CPU goes on or offline. */
+struct sys_info {
+    struct utsname uts;          // the kernel and the host
+    int online_fd;               // fd of "/sys/devices/system/cpu/online", -1 if unavailable
+    char online[SYS_INFO_CPULIST];  // its content at the last check
+    int cores;                   // the number of online CPUs
+    int configured;              // the number of CPUs, online or not
+    char model[128];             // the CPU model of /proc/cpuinfo
+    int cache_count;
+    struct sys_cache cache[SYS_INFO_MAX_CACHES];
+    int node_count;
+    struct sys_node node[SYS_INFO_MAX_NODES];
+    time_t boot_time;            // btime of /proc/stat
+    unsigned long reloads;       // the number of times the CPU topology was read
+};
+
+/** @brief Read the system information once for the whole run.
+ *  @param info The cache to fill.
+ *  @return Void.
+ */
+void sys_info_init(struct sys_info *info);
+
+/** @brief Read the CPU topology again if the set of online CPUs changed.
+ *
+ *  The check is a single pread() of "/sys/devices/system/cpu/online", so
+ *  it can be done at every sample.
+ *
+ *  @param info The cache.
+ *  @return 1 if a CPU went on or offline, 0 otherwise.
+ */
+int sys_info_refresh(struct sys_info *info);
+
+/** @brief Close the file watched for CPU hotplug.
+ *  @param info The cache.
+ *  @return Void.
+ */
+void sys_info_close(struct sys_info *info);
+
+#endif
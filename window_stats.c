@@ -0,0 +1,143 @@
+/** @file window_stats.c
+ *  @brief Moving averages and windowed min/max of a metric
+ *
+ *  This file includes the functions that keep the average, the minimum
+ *  and the maximum of a metric over the last 1, 5 and 15 minutes. Each
+ *  window keeps a running sum and two monotonic deques of sample numbers,
+ *  so adding a sample costs O(1) amortized whatever the window length,
+ *  and the history is never scanned again.
+ *
+ *  @author Huang Xinzi
+ */
+
+#include "window_stats.h"
+
+/** @brief The length of each window (in seconds) and its label. */
+static const int window_seconds[WINDOW_COUNT] = {60, 300, 900};
+static const char *window_labels[WINDOW_COUNT] = {"1m", "5m", "15m"};
+
+/** @brief Get an entry of a deque.
+ *  @param deque The deque.
+ *  @param capacity The capacity of its ring.
+ *  @param i The position from the front (0) to the back (size - 1).
+ *  @return The sample number.
+ */
+static inline long deque_at(struct window_deque *deque, int capacity, int i) {
+    return deque->seq[(deque->head + i) % capacity];
+}
+
+/** @brief Add the newest sample to a deque, after the ones it does not supersede.
+ *  @param set The windows (to read the values).
+ *  @param deque The deque.
+ *  @param capacity The capacity of its ring.
+ *  @param length The length of the window.
+ *  @param sign 1 for the minimum deque, -1 for the maximum deque.
+ *  @return Void.
+ */
+static void deque_push(struct window_set *set, struct window_deque *deque, int capacity,
+    int length, int sign) {
+    double value = set->values[set->seq % set->capacity];
+
+    // the front left the window
+    if (deque->size > 0 && deque_at(deque, capacity, 0) <= set->seq - length) {
+        deque->head = (deque->head + 1) % capacity;
+        deque->size --;
+    }
+    // the back can no longer be the minimum (maximum)
+    while (deque->size > 0 &&
+        sign * set->values[deque_at(deque, capacity, deque->size - 1) % set->capacity] >= sign * value) {
+        deque->size --;
+    }
+    deque->seq[(deque->head + deque->size ++) % capacity] = set->seq;
+}
+
+/** @brief Size the windows for a sampling interval.
+ *  @param set The windows to initialize.
+ *  @param interval The seconds between two samples.
+ *  @return Void.
+ */
+void window_init(struct window_set *set, double interval) {
+    memset(set, 0, sizeof(*set));
+    for (int i = 0; i < WINDOW_COUNT; i ++) {
+        struct window *window = &set->window[i];
+
+        window->length = interval > 0 ? (int) (window_seconds[i] / interval + 0.5) : 1;
+        if (window->length < 1) window->length = 1;
+        if (window->length + 1 > set->capacity) set->capacity = window->length + 1;
+        // a deque holds at most length + 1 samples, before its front is dropped
+        if ((window->min.seq = malloc((window->length + 1) * sizeof(long))) == NULL ||
+            (window->max.seq = malloc((window->length + 1) * sizeof(long))) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+    }
+    if ((set->values = calloc(set->capacity, sizeof(double))) == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+}
+
+/** @brief Add a value to every window, in O(1) amortized time.
+ *
+ *  The running sum gains the new value and loses the one leaving the
+ *  window. The minimum deque drops the values not smaller than the new one
+ *  from its back (they can no longer be the minimum) and the value leaving
+ *  the window from its front, so its front is the minimum. Same for the
+ *  maximum.
+ *
+ *  @param set The windows.
+ *  @param value The new value.
+ *  @return Void.
+ */
+void window_push(struct window_set *set, double value) {
+    set->seq ++;
+    set->values[set->seq % set->capacity] = value;
+
+    for (int i = 0; i < WINDOW_COUNT; i ++) {
+        struct window *window = &set->window[i];
+
+        // the ring still holds the value leaving a shorter window
+        window->sum += value;
+        if (set->seq > window->length) {
+            window->sum -= set->values[(set->seq - window->length) % set->capacity];
+        }
+        // recompute the sum once per window length, so the rounding errors do not add up
+        if (set->seq % window->length == 0) {
+            window->sum = 0.0;
+            for (long s = set->seq; s > set->seq - window->length && s > 0; s --) {
+                window->sum += set->values[s % set->capacity];
+            }
+        }
+        deque_push(set, &window->min, window->length + 1, window->length, 1);
+        deque_push(set, &window->max, window->length + 1, window->length, -1);
+    }
+}
+
+/** @brief Prints the average, minimum and maximum of each window, on the current line.
+ *  @param set The windows.
+ *  @return Void.
+ */
+void show_window(struct window_set *set) {
+    if (set->seq == 0) return;
+
+    for (int i = 0; i < WINDOW_COUNT; i ++) {
+        struct window *window = &set->window[i];
+        int count = set->seq < window->length ? (int) set->seq : window->length;
+
+        printf("  %s %.2f [%.2f-%.2f]", window_labels[i], window->sum / count,
+            set->values[deque_at(&window->min, window->length + 1, 0) % set->capacity],
+            set->values[deque_at(&window->max, window->length + 1, 0) % set->capacity]);
+    }
+}
+
+/** @brief Free the windows.
+ *  @param set The windows.
+ *  @return Void.
+ */
+void window_close(struct window_set *set) {
+    for (int i = 0; i < WINDOW_COUNT; i ++) {
+        free(set->window[i].min.seq);
+        free(set->window[i].max.seq);
+    }
+    free(set->values);
+}
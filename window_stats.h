@@ -0,0 +1,68 @@
+/*
+ * Header file for the sliding window aggregates
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __Window_header
+#define __Window_header
+
+#define WINDOW_COUNT 3   // 1, 5 and 15 minutes, like the load averages
+
+/** @brief A ring of sample numbers, used as a monotonic deque. */
+struct window_deque {
+    long *seq;           // the sample numbers, from the oldest to the newest
+    int head, size;      // the position of the oldest and the number of entries
+};
+
+/** @brief One window over the last samples. */
+struct window {
+    int length;                    // the number of samples in the window
+    double sum;                    // the running sum of the samples in the window
+    struct window_deque min, max;  // the candidates for the minimum and maximum
+};
+
+/** @brief The windows of one metric, over a shared ring of its last values. */
+struct window_set {
+    long seq;                      // the number of values pushed
+    int capacity;                  // the length of the longest window, plus the value leaving it
+    double *values;                // the last capacity values, by seq % capacity
+    struct window window[WINDOW_COUNT];
+};
+
+/** @brief Size the windows for a sampling interval.
+ *  @param set The windows to initialize.
+ *  @param interval The seconds between two samples.
+ *  @return Void.
+ */
+void window_init(struct window_set *set, double interval);
+
+/** @brief Add a value to every window, in O(1) amortized time.
+ *
+ *  The running sum gains the new value and loses the one leaving the
+ *  window. The minimum deque drops the values not smaller than the new one
+ *  from its back (they can no longer be the minimum) and the value leaving
+ *  the window from its front, so its front is the minimum. Same for the
+ *  maximum.
+ *
+ *  @param set The windows.
+ *  @param value The new value.
+ *  @return Void.
+ */
+void window_push(struct window_set *set, double value);
+
+/** @brief Prints the average, minimum and maximum of each window, on the current line.
+ *  @param set The windows.
+ *  @return Void.
+ */
+void show_window(struct window_set *set);
+
+/** @brief Free the windows.
+ *  @param set The windows.
+ *  @return Void.
+ */
+void window_close(struct window_set *set);
+
+#endif